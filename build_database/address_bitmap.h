@@ -0,0 +1,57 @@
+/*
+   Copyright 2016, Joel Reardon, UC Berkeley
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef __BTPIR__BUILD_DATABASE__ADDRESS_BITMAP__H__
+#define __BTPIR__BUILD_DATABASE__ADDRESS_BITMAP__H__
+
+#include <cassert>
+#include <cstdint>
+#include <string>
+
+using namespace std;
+
+namespace btpir {
+
+/* Returns the bytes in a bitmap of @nblocks blocks. */
+inline size_t block_bitmap_len(uint64_t nblocks) {
+	return (nblocks + 7) / 8;
+}
+
+/* append_block_bitmap(): appends to @out the format 1 bitmap of @nblocks
+ * bits, one per main database block, in which the @count sorted blocks at
+ * @blocks are set. Block b is bit (7 - b % 8) of byte b / 8, so the bitmap
+ * reads left to right in block order. The last byte is padded with zeros.
+ *
+ * The bitmap is grown zero-filled in one step and only the bits that are set
+ * are touched, so the cost is in the number of blocks an address uses rather
+ * than in @nblocks.
+ */
+inline void append_block_bitmap(const uint32_t* blocks, size_t count,
+				uint64_t nblocks, string* out) {
+	assert(out);
+	size_t start = out->length();
+	out->resize(start + block_bitmap_len(nblocks));
+	uint8_t* bitmap = reinterpret_cast<uint8_t*>(&(*out)[start]);
+	for (size_t i = 0; i < count; ++i) {
+		assert(blocks[i] < nblocks);
+		assert(!i || blocks[i - 1] < blocks[i]);
+		bitmap[blocks[i] >> 3] |= 0x80 >> (blocks[i] & 7);
+	}
+}
+
+}  // namespace btpir
+
+#endif  // __BTPIR__BUILD_DATABASE__ADDRESS_BITMAP__H__
@@ -0,0 +1,209 @@
+/*
+   Copyright 2016, Joel Reardon, UC Berkeley
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef __BTPIR__BUILD_DATABASE__ADDRESS_TABLE__H__
+#define __BTPIR__BUILD_DATABASE__ADDRESS_TABLE__H__
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace btpir {
+
+/* AddressTable interns bitcoin addresses as dense 32-bit ids, assigned in
+ * the order the addresses are first seen. Per-address state can then be kept
+ * in arrays indexed by id rather than in string-keyed trees.
+ *
+ * The address bytes are stored back to back in a single arena, and the
+ * lookup is an open-addressing hash table whose slots hold both the id and
+ * a tag of the hash, so that most probes never touch the arena.
+ */
+class AddressTable {
+public:
+	/* @shortaddr_len: the number of trailing bytes of an address that
+	 * form its short address.
+	 */
+	AddressTable(size_t shortaddr_len = 20)
+		: _shortaddr_len(shortaddr_len), _slots(kInitialSlots, 0) {
+		_offsets.push_back(0);
+	}
+
+	/* intern(): returns the id of @address, adding it if it is new. */
+	uint32_t intern(const string& address) {
+		return intern(address.c_str(), address.length());
+	}
+
+	/* intern(): returns the id of the @len byte address at @address,
+	 * adding it if it is new.
+	 */
+	uint32_t intern(const char* address, size_t len) {
+		assert(len > _shortaddr_len);
+		if (2 * (size() + 1) > _slots.size()) grow();
+
+		uint64_t h = hash(address, len);
+		size_t mask = _slots.size() - 1;
+		for (size_t i = h & mask;; i = (i + 1) & mask) {
+			uint64_t slot = _slots[i];
+			if (!slot) {
+				uint32_t id = size();
+				assert(id < UINT32_MAX);
+				_arena.append(address, len);
+				_offsets.push_back(_arena.length());
+				_slots[i] = make_slot(h, id);
+				return id;
+			}
+			if (tag(slot) == tag(h) && equals(id_of(slot), address, len))
+				return id_of(slot);
+		}
+	}
+
+	/* find(): sets @id to the id of @address and returns true if it has
+	 * been interned, otherwise returns false.
+	 */
+	bool find(const string& address, uint32_t* id) const {
+		assert(id);
+		uint64_t h = hash(address.c_str(), address.length());
+		size_t mask = _slots.size() - 1;
+		for (size_t i = h & mask;; i = (i + 1) & mask) {
+			uint64_t slot = _slots[i];
+			if (!slot) return false;
+			if (tag(slot) == tag(h) &&
+			    equals(id_of(slot), address.c_str(), address.length())) {
+				*id = id_of(slot);
+				return true;
+			}
+		}
+	}
+
+	/* Returns the number of interned addresses. */
+	uint32_t size() const {
+		return _offsets.size() - 1;
+	}
+
+	/* Returns the full bitcoin address for @id */
+	string long_address(uint32_t id) const {
+		return string(data(id), length(id));
+	}
+
+	/* Returns the short form address for @id, i.e., the last
+	 * _shortaddr_len bytes of the address.
+	 */
+	string short_address(uint32_t id) const {
+		return string(short_data(id), _shortaddr_len);
+	}
+
+	/* sorted_by_short(): returns all the ids ordered by their short
+	 * address. Ties are broken by the full address.
+	 */
+	vector<uint32_t> sorted_by_short() const {
+		vector<uint32_t> ids(size());
+		for (uint32_t i = 0; i < ids.size(); ++i) ids[i] = i;
+		sort(ids.begin(), ids.end(), [this](uint32_t a, uint32_t b) {
+			int cmp = memcmp(short_data(a), short_data(b),
+					 _shortaddr_len);
+			if (cmp) return cmp < 0;
+			return long_address(a) < long_address(b);
+		});
+		return ids;
+	}
+
+protected:
+	static const size_t kInitialSlots = 1 << 10;
+
+	/* Returns the bytes of the address @id in the arena */
+	const char* data(uint32_t id) const {
+		return _arena.data() + _offsets[id];
+	}
+
+	/* Returns the length of the address @id */
+	size_t length(uint32_t id) const {
+		return _offsets[id + 1] - _offsets[id];
+	}
+
+	/* Returns the bytes of the short address of @id in the arena */
+	const char* short_data(uint32_t id) const {
+		return data(id) + length(id) - _shortaddr_len;
+	}
+
+	bool equals(uint32_t id, const char* address, size_t len) const {
+		return length(id) == len && !memcmp(data(id), address, len);
+	}
+
+	/* grow(): doubles the hash table and reinserts every id. */
+	void grow() {
+		vector<uint64_t> slots(2 * _slots.size(), 0);
+		size_t mask = slots.size() - 1;
+		for (auto &x : _slots) {
+			if (!x) continue;
+			uint32_t id = id_of(x);
+			size_t i = hash(data(id), length(id)) & mask;
+			while (slots[i]) i = (i + 1) & mask;
+			slots[i] = x;
+		}
+		_slots.swap(slots);
+	}
+
+	/* A slot keeps the high 32 bits of the hash and the id plus one, so
+	 * that zero marks an empty slot.
+	 */
+	static uint64_t make_slot(uint64_t h, uint32_t id) {
+		return (tag(h) << 32) | ((uint64_t) id + 1);
+	}
+
+	static uint64_t tag(uint64_t x) {
+		return x >> 32;
+	}
+
+	static uint32_t id_of(uint64_t slot) {
+		return (uint32_t) slot - 1;
+	}
+
+	/* hash(): FNV-1a with a final avalanche so that both halves of the
+	 * result are usable.
+	 */
+	static uint64_t hash(const char* data, size_t len) {
+		uint64_t h = 14695981039346656037ULL;
+		for (size_t i = 0; i < len; ++i) {
+			h ^= (uint8_t) data[i];
+			h *= 1099511628211ULL;
+		}
+		h ^= h >> 33;
+		h *= 0xff51afd7ed558ccdULL;
+		h ^= h >> 33;
+		return h;
+	}
+
+	/* bytes used for a short address */
+	size_t _shortaddr_len;
+
+	/* all the addresses, back to back, in id order */
+	string _arena;
+
+	/* start of each address in _arena, followed by the arena length */
+	vector<uint64_t> _offsets;
+
+	/* the open-addressing hash table */
+	vector<uint64_t> _slots;
+};
+
+}  // namespace btpir
+
+#endif  // __BTPIR__BUILD_DATABASE__ADDRESS_TABLE__H__
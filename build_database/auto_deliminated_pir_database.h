@@ -75,9 +75,6 @@ public:
 	}
 
 protected:
-	virtual void pre_write() {}
-	virtual void post_write() {}
-
         virtual void start_tx(const string& address, uint32_t length) {
 	}
 	/* In the auto-deliminated, the new block is called before starting
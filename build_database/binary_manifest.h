@@ -0,0 +1,196 @@
+/*
+   Copyright 2016, Joel Reardon, UC Berkeley
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef __BTPIR__BUILD_DATABASE__BINARY_MANIFEST__H__
+#define __BTPIR__BUILD_DATABASE__BINARY_MANIFEST__H__
+
+#include <cassert>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "ib/logger.h"
+
+using namespace std;
+using namespace ib;
+
+namespace btpir {
+
+/* The binary manifest holds the same addresses as the text one (see
+ * pir_database_manifest_base.h), one per block boundary, but only their
+ * short addresses, the last kBinaryManifestShortLen bytes, back to back.
+ * A client can map the file and search it as it is.
+ *
+ * The file is a BinaryManifestHeader, then the entries short addresses,
+ * then the prefix index: 2^index_bits + 1 uint32_t, where entry p is the
+ * first short address whose top index_bits bits are p or more, and the last
+ * is entries. A search for a short address starts in the range its prefix
+ * gives. The header and short addresses are multiples of four bytes, so the
+ * index is aligned.
+ */
+struct BinaryManifestHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t short_len;
+	uint64_t entries;
+	uint32_t index_bits;
+	uint32_t reserved;
+};
+
+static const char kBinaryManifestMagic[8] =
+	{'B', 'T', 'P', 'I', 'R', 'M', 'F', '1'};
+static const uint32_t kBinaryManifestVersion = 1;
+static const uint32_t kBinaryManifestShortLen = 20;
+
+/* BinaryManifestWriter writes a binary manifest as the addresses come,
+ * gathering them into large writes. The index size depends on how many
+ * there are, so the index and the header are written by close().
+ */
+class BinaryManifestWriter {
+public:
+	/* Starts writing the manifest @filename. */
+	BinaryManifestWriter(const string& filename)
+		: _filename(filename), _entries(0),
+		  _counts(1 << kMaxIndexBits, 0) {
+		_fout = fopen(filename.c_str(), "wb");
+		if (!_fout) {
+			Logger::error("(manifest) cannot write %", filename);
+			assert(0);
+		}
+		/* room for the header */
+		_buf.assign(sizeof(BinaryManifestHeader), 0);
+	}
+
+	virtual ~BinaryManifestWriter() {
+		if (_fout) close();
+	}
+
+	/* add(): appends the short address of @address, which must not sort
+	 * before the last one added.
+	 */
+	void add(const string& address) {
+		assert(_fout);
+		assert(address.length() >= kBinaryManifestShortLen);
+		const char* s = address.data() + address.length()
+			- kBinaryManifestShortLen;
+		assert(!_entries || memcmp(_last, s, sizeof(_last)) <= 0);
+		memcpy(_last, s, sizeof(_last));
+		++_counts[prefix(s, kMaxIndexBits)];
+		++_entries;
+		_buf.append(s, kBinaryManifestShortLen);
+		if (_buf.length() >= kBatchBytes) flush();
+	}
+
+	/* close(): writes the index and header and closes the file. */
+	void close() {
+		assert(_fout);
+		uint32_t bits = index_bits(_entries);
+		/* fold the counts down to the chosen prefix length and sum
+		 * them into the start of each prefix
+		 */
+		uint32_t shift = kMaxIndexBits - bits;
+		vector<uint32_t> index((1 << bits) + 1, 0);
+		for (uint64_t p = 0; p < _counts.size(); ++p) {
+			index[(p >> shift) + 1] += _counts[p];
+		}
+		for (uint64_t p = 1; p < index.size(); ++p) {
+			index[p] += index[p - 1];
+		}
+		assert(index.back() == _entries);
+		_buf.append(reinterpret_cast<const char*>(index.data()),
+			    index.size() * sizeof(uint32_t));
+		flush();
+
+		BinaryManifestHeader header;
+		memset(&header, 0, sizeof(header));
+		memcpy(header.magic, kBinaryManifestMagic, sizeof(header.magic));
+		header.version = kBinaryManifestVersion;
+		header.short_len = kBinaryManifestShortLen;
+		header.entries = _entries;
+		header.index_bits = bits;
+		int ret = fseeko(_fout, 0, SEEK_SET);
+		assert(!ret);
+		ret = fwrite(&header, sizeof(header), 1, _fout);
+		assert(ret == 1);
+		ret = fclose(_fout);
+		assert(!ret);
+		_fout = nullptr;
+	}
+
+	/* Returns the addresses added. */
+	uint64_t entries() const {
+		return _entries;
+	}
+
+	/* index_bits(): returns the prefix bits to index @entries entries
+	 * with, giving about kIndexSpan entries per prefix.
+	 */
+	static uint32_t index_bits(uint64_t entries) {
+		uint32_t ret = 0;
+		while (ret < kMaxIndexBits
+		       && (entries >> (ret + 1)) >= kIndexSpan) ++ret;
+		return ret;
+	}
+
+	/* prefix(): returns the top @bits bits of the short address @s. */
+	static uint32_t prefix(const char* s, uint32_t bits) {
+		if (!bits) return 0;
+		const uint8_t* u = reinterpret_cast<const uint8_t*>(s);
+		uint32_t top = ((uint32_t) u[0] << 24) | ((uint32_t) u[1] << 16)
+			| ((uint32_t) u[2] << 8) | u[3];
+		return top >> (32 - bits);
+	}
+
+	/* The most prefix bits indexed. */
+	static const uint32_t kMaxIndexBits = 16;
+
+	/* The entries per prefix the index aims for. */
+	static const uint64_t kIndexSpan = 16;
+
+protected:
+	/* The bytes gathered before writing them out. */
+	static const size_t kBatchBytes = 1 << 20;
+
+	/* flush(): writes out the gathered bytes. */
+	void flush() {
+		if (_buf.empty()) return;
+		size_t ret = fwrite(_buf.data(), 1, _buf.length(), _fout);
+		assert(ret == _buf.length());
+		_buf.clear();
+	}
+
+	// Prohibit copy
+	BinaryManifestWriter(const BinaryManifestWriter& copy) {}
+
+	string _filename;
+	FILE* _fout;
+
+	/* the bytes not yet written */
+	string _buf;
+
+	/* the addresses so far, and the last one's short address */
+	uint64_t _entries;
+	char _last[kBinaryManifestShortLen];
+
+	/* the addresses so far with each kMaxIndexBits prefix */
+	vector<uint32_t> _counts;
+};
+
+}  // namespace btpir
+
+#endif  // __BTPIR__BUILD_DATABASE__BINARY_MANIFEST__H__
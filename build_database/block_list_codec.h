@@ -0,0 +1,124 @@
+/*
+   Copyright 2016, Joel Reardon, UC Berkeley
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef __BTPIR__BUILD_DATABASE__BLOCK_LIST_CODEC__H__
+#define __BTPIR__BUILD_DATABASE__BLOCK_LIST_CODEC__H__
+
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace btpir {
+
+/* The format 3 block list: the number of blocks followed by the first block
+ * and then the gap from each block to the next, all as LEB128 varints (seven
+ * bits per byte, least significant first, high bit set on every byte but the
+ * last). Most addresses have few blocks that are close together, so the
+ * whole list is usually a few bytes, whereas format 2 spends four bytes per
+ * block and format 1 a bit for every block in the main database.
+ */
+
+/* append_varint(): appends @value to @out as a varint. */
+inline void append_varint(uint32_t value, string* out) {
+	while (value >= 0x80) {
+		out->push_back((char) (value | 0x80));
+		value >>= 7;
+	}
+	out->push_back((char) value);
+}
+
+/* read_varint(): decodes a varint at @in, which has @len bytes, into @value.
+ * Returns the bytes used, or 0 if the varint is cut short or too long.
+ */
+inline size_t read_varint(const uint8_t* in, size_t len, uint32_t* value) {
+	uint32_t v = 0;
+	for (size_t i = 0; i < len && i < 5; ++i) {
+		v |= (uint32_t) (in[i] & 0x7f) << (7 * i);
+		if (!(in[i] & 0x80)) {
+			*value = v;
+			return i + 1;
+		}
+	}
+	return 0;
+}
+
+/* append_block_list(): appends the @count sorted blocks at @blocks to @out
+ * in format 3.
+ */
+inline void append_block_list(const uint32_t* blocks, size_t count,
+			      string* out) {
+	assert(out);
+	assert(count < UINT32_MAX);
+	append_varint(count, out);
+	uint32_t prev = 0;
+	for (size_t i = 0; i < count; ++i) {
+		assert(!i || blocks[i - 1] < blocks[i]);
+		append_varint(blocks[i] - prev, out);
+		prev = blocks[i];
+	}
+}
+
+/* decode_block_list(): decodes a format 3 block list at @in, which has @len
+ * bytes, replacing the contents of @blocks. Returns the bytes used, or 0 if
+ * the list is malformed.
+ *
+ * Gaps are almost always below 128, so eight bytes are loaded at once and,
+ * when none has its high bit set, they are eight whole gaps that go through
+ * a fixed-length prefix sum with no branches, which the compiler can keep
+ * in vector registers. Anything else falls back to one varint at a time.
+ */
+inline size_t decode_block_list(const uint8_t* in, size_t len,
+				vector<uint32_t>* blocks) {
+	assert(blocks);
+	uint32_t count;
+	size_t pos = read_varint(in, len, &count);
+	if (!pos || count > len - pos) return 0;
+	blocks->resize(count);
+	uint32_t* out = blocks->data();
+
+	uint32_t prev = 0;
+	size_t i = 0;
+	while (i < count) {
+		if (count - i >= 8 && len - pos >= 8) {
+			uint64_t word;
+			memcpy(&word, in + pos, sizeof(word));
+			if (!(word & 0x8080808080808080ULL)) {
+				for (int j = 0; j < 8; ++j) {
+					prev += in[pos + j];
+					out[i + j] = prev;
+				}
+				pos += 8;
+				i += 8;
+				continue;
+			}
+		}
+		uint32_t gap;
+		size_t used = read_varint(in + pos, len - pos, &gap);
+		if (!used) return 0;
+		prev += gap;
+		out[i++] = prev;
+		pos += used;
+	}
+	return pos;
+}
+
+}  // namespace btpir
+
+#endif  // __BTPIR__BUILD_DATABASE__BLOCK_LIST_CODEC__H__
@@ -0,0 +1,66 @@
+/*
+   Copyright 2016, Joel Reardon, UC Berkeley
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef __BTPIR__BUILD_DATABASE__BLOCK_RANGE__H__
+#define __BTPIR__BUILD_DATABASE__BLOCK_RANGE__H__
+
+#include <cassert>
+#include <cstdint>
+
+namespace btpir {
+
+/* BlockRange is the run of PIR blocks [first, last] that an entry occupies.
+ * Entries are written contiguously, so the blocks they use are always a
+ * single run. An empty range has first > last.
+ */
+struct BlockRange {
+	BlockRange() : first(1), last(0) {}
+
+	/* clear(): makes the range empty. */
+	void clear() {
+		first = 1;
+		last = 0;
+	}
+
+	/* empty(): returns true if no block has been added. */
+	bool empty() const {
+		return first > last;
+	}
+
+	/* add(): extends the range to cover @block, which must not precede
+	 * the blocks already in the range.
+	 */
+	void add(uint32_t block) {
+		if (empty()) {
+			first = block;
+		} else {
+			assert(block >= last);
+		}
+		last = block;
+	}
+
+	/* size(): returns the number of blocks in the range. */
+	uint64_t size() const {
+		return empty() ? 0 : (uint64_t) last - first + 1;
+	}
+
+	uint32_t first;
+	uint32_t last;
+};
+
+}  // namespace btpir
+
+#endif  // __BTPIR__BUILD_DATABASE__BLOCK_RANGE__H__
@@ -0,0 +1,346 @@
+/*
+   Copyright 2016, Joel Reardon, UC Berkeley
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef __BTPIR__BUILD_DATABASE__BLOCK_WRITER__H__
+#define __BTPIR__BUILD_DATABASE__BLOCK_WRITER__H__
+
+#include <cassert>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <functional>
+#include <memory>
+#include <string>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <vector>
+
+#include "ib/logger.h"
+
+using namespace std;
+using namespace ib;
+
+namespace btpir {
+
+/* BlockWriter is the output layer for PIR database files. Bytes are
+ * assembled in a reusable buffer that holds a whole number of PIR blocks,
+ * and each time the buffer fills it is handed to the kernel with a single
+ * write. Since the file starts at a block boundary, every flush but the last
+ * covers complete PIR blocks.
+ *
+ * When closed, it reports the bytes written and the throughput, both overall
+ * and for the time spent inside write(2), so that the rate can be compared
+ * against the disk bandwidth.
+ *
+ * A BlockWriter made without a filename discards its input and only counts
+ * the bytes, for dry runs that need the layout of a database but not its
+ * contents.
+ */
+class BlockWriter {
+public:
+	/* Opens @filename for writing, truncating it.
+	 * @blocksize: the PIR blocksize in bytes. The buffer is a multiple of
+	 * this of at least kMinBuffer bytes.
+	 */
+	BlockWriter(const string& filename, size_t blocksize)
+		: _filename(filename), _fill(0), _written(0), _io_ns(0),
+		  _good(true) {
+		assert(blocksize);
+		size_t blocks = kMinBuffer / blocksize;
+		if (!blocks) blocks = 1;
+		_buf.resize(blocks * blocksize);
+
+		_fd = open(_filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC,
+			   0644);
+		assert(_fd >= 0);
+		_start = chrono::steady_clock::now();
+	}
+
+	/* Opens the existing @filename to continue writing at @offset, which
+	 * need not be a block boundary. Anything after @offset is discarded.
+	 */
+	BlockWriter(const string& filename, size_t blocksize, uint64_t offset)
+		: _filename(filename), _fill(0), _written(0), _io_ns(0),
+		  _good(true) {
+		assert(blocksize);
+		size_t blocks = kMinBuffer / blocksize;
+		if (!blocks) blocks = 1;
+		_buf.resize(blocks * blocksize);
+
+		_fd = open(_filename.c_str(), O_WRONLY);
+		assert(_fd >= 0);
+		struct stat st;
+		int ret = fstat(_fd, &st);
+		assert(!ret);
+		if ((uint64_t) st.st_size < offset) {
+			Logger::error("(btpir) % has % bytes, expected %",
+				      _filename, st.st_size, offset);
+			assert(0);
+		}
+		ret = ftruncate(_fd, offset);
+		assert(!ret);
+		off_t pos = lseek(_fd, offset, SEEK_SET);
+		assert(pos == (off_t) offset);
+		_start = chrono::steady_clock::now();
+	}
+
+	/* Makes a BlockWriter that discards everything written to it. */
+	BlockWriter() : _fd(-1), _fill(0), _written(0), _io_ns(0),
+			_good(true) {}
+
+	virtual ~BlockWriter() {
+		close();
+	}
+
+	/* write(): appends @len bytes from @data to the file. */
+	virtual void write(const char* data, size_t len) {
+		if (discards()) {
+			_written += len;
+			return;
+		}
+		while (len) {
+			if (!_fill && len >= _buf.size()) {
+				/* whole buffers go straight from the caller */
+				size_t n = len - len % _buf.size();
+				write_out(data, n);
+				data += n;
+				len -= n;
+				continue;
+			}
+			size_t n = min(len, _buf.size() - _fill);
+			memcpy(&_buf[_fill], data, n);
+			_fill += n;
+			data += n;
+			len -= n;
+			if (_fill == _buf.size()) flush();
+		}
+	}
+
+	/* write_zeros(): appends @len bytes of zeros to the file. */
+	virtual void write_zeros(size_t len) {
+		if (discards()) {
+			_written += len;
+			return;
+		}
+		while (len) {
+			size_t n = min(len, _buf.size() - _fill);
+			memset(&_buf[_fill], 0, n);
+			_fill += n;
+			len -= n;
+			if (_fill == _buf.size()) flush();
+		}
+	}
+
+	/* flush(): hands the buffered bytes to the kernel. */
+	virtual void flush() {
+		if (!_fill) return;
+		write_out(&_buf[0], _fill);
+		_fill = 0;
+	}
+
+	/* close(): flushes and closes the file, and logs the throughput. */
+	virtual void close() {
+		if (_fd < 0) return;
+		flush();
+		_good = !::close(_fd) && _good;
+		_fd = -1;
+		trace();
+	}
+
+	/* good(): returns false if any write to the file failed. */
+	virtual bool good() const {
+		return _good;
+	}
+
+	/* discards(): returns true if this writer has no file. */
+	virtual bool discards() const {
+		return _buf.empty();
+	}
+
+	/* Returns the bytes written so far, including buffered ones. */
+	virtual uint64_t written() const {
+		return _written + _fill;
+	}
+
+protected:
+	/* The smallest buffer size used, in bytes. */
+	static const size_t kMinBuffer = 1 << 20;
+
+	/* write_out(): writes @len bytes from @data with as few write(2)
+	 * calls as the kernel allows.
+	 */
+	virtual void write_out(const char* data, size_t len) {
+		auto start = chrono::steady_clock::now();
+		while (len) {
+			ssize_t ret = ::write(_fd, data, len);
+			if (ret < 0 && errno == EINTR) continue;
+			if (ret <= 0) {
+				Logger::error("(btpir) write to % failed",
+					      _filename);
+				_good = false;
+				assert(0);
+				return;
+			}
+			data += ret;
+			len -= ret;
+			_written += ret;
+		}
+		_io_ns += chrono::duration_cast<chrono::nanoseconds>(
+			chrono::steady_clock::now() - start).count();
+	}
+
+	/* trace(): outputs the bytes written and the rate. */
+	virtual void trace() const {
+		double secs = chrono::duration_cast<chrono::nanoseconds>(
+			chrono::steady_clock::now() - _start).count() / 1e9;
+		double io_secs = _io_ns / 1e9;
+		double mib = _written / (double) (1 << 20);
+		Logger::info("(btpir) Wrote % MiB to %", mib, _filename);
+		Logger::info("(btpir) Overall  (MiB/s): %",
+			     secs > 0 ? mib / secs : 0);
+		Logger::info("(btpir) In write (MiB/s): %",
+			     io_secs > 0 ? mib / io_secs : 0);
+	}
+
+	// Prohibit copy
+	BlockWriter(const BlockWriter& copy) {}
+
+	string _filename;
+	int _fd;
+
+	/* holds a whole number of PIR blocks */
+	vector<char> _buf;
+
+	/* bytes used in _buf */
+	size_t _fill;
+
+	/* bytes handed to the kernel */
+	uint64_t _written;
+
+	/* nanoseconds spent in write(2) */
+	uint64_t _io_ns;
+
+	bool _good;
+	chrono::steady_clock::time_point _start;
+};
+
+/* ShardedBlockWriter splits what is written to it into shard files of
+ * @shard_bytes bytes each, a whole number of PIR blocks, but for the last,
+ * which has the rest. Each shard is written by its own BlockWriter and opened
+ * when its first byte arrives, so there are no empty shards.
+ */
+class ShardedBlockWriter : public BlockWriter {
+public:
+	/* @filenames(i) returns the name of the file for shard i. */
+	ShardedBlockWriter(function<string(size_t)> filenames,
+			   size_t blocksize, uint64_t shard_bytes)
+		: _filenames(filenames), _blocksize(blocksize),
+		  _shard_bytes(shard_bytes), _shard_written(0) {
+		assert(shard_bytes);
+		assert(shard_bytes % blocksize == 0);
+	}
+
+	virtual ~ShardedBlockWriter() {
+		close();
+	}
+
+	virtual void write(const char* data, size_t len) {
+		while (len) {
+			size_t n = next_shard(len);
+			_shards.back()->write(data, n);
+			data += n;
+			len -= n;
+		}
+	}
+
+	virtual void write_zeros(size_t len) {
+		while (len) {
+			size_t n = next_shard(len);
+			_shards.back()->write_zeros(n);
+			len -= n;
+		}
+	}
+
+	virtual void flush() {
+		if (!_shards.empty()) _shards.back()->flush();
+	}
+
+	virtual void close() {
+		if (!_shards.empty()) _shards.back()->close();
+	}
+
+	virtual bool good() const {
+		for (auto &x : _shards) {
+			if (!x->good()) return false;
+		}
+		return true;
+	}
+
+	virtual bool discards() const {
+		return false;
+	}
+
+	virtual uint64_t written() const {
+		if (_shards.empty()) return 0;
+		return (_shards.size() - 1) * _shard_bytes
+			+ _shards.back()->written();
+	}
+
+	/* shards(): returns the number of shard files opened so far. */
+	size_t shards() const {
+		return _shards.size();
+	}
+
+	/* shard_size(): returns the bytes written to shard @i. */
+	uint64_t shard_size(size_t i) const {
+		assert(i < _shards.size());
+		return _shards[i]->written();
+	}
+
+protected:
+	/* next_shard(): opens the next shard if the current one is full, and
+	 * returns how many of @len bytes fit in the current one.
+	 */
+	size_t next_shard(size_t len) {
+		if (_shards.empty() || _shard_written == _shard_bytes) {
+			if (!_shards.empty()) _shards.back()->close();
+			_shards.emplace_back(new BlockWriter(
+				_filenames(_shards.size()), _blocksize));
+			_shard_written = 0;
+		}
+		size_t n = min((uint64_t) len, _shard_bytes - _shard_written);
+		_shard_written += n;
+		return n;
+	}
+
+	function<string(size_t)> _filenames;
+	size_t _blocksize;
+
+	/* bytes in every shard but the last */
+	uint64_t _shard_bytes;
+
+	/* bytes written to the current shard */
+	uint64_t _shard_written;
+
+	vector<unique_ptr<BlockWriter>> _shards;
+};
+
+}  // namespace btpir
+
+#endif  // __BTPIR__BUILD_DATABASE__BLOCK_WRITER__H__
@@ -0,0 +1,141 @@
+/*
+   Copyright 2016, Joel Reardon, UC Berkeley
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef __BTPIR__BUILD_DATABASE__BUILD_STATE__H__
+#define __BTPIR__BUILD_DATABASE__BUILD_STATE__H__
+
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "ib/logger.h"
+
+using namespace std;
+using namespace ib;
+
+namespace btpir {
+
+/* The state file lets a later build append to the databases of an earlier
+ * one. It starts with an 8-byte magic and a 4-byte version, after which the
+ * TransactionProcessor stores its fields in a fixed order. Numbers and
+ * vectors of plain structs are stored as they are in memory, vectors with a
+ * 64-bit count before them, so a state file is only read on the kind of
+ * machine that wrote it.
+ */
+static const char kStateMagic[8] = {'B', 'T', 'P', 'I', 'R', 'S', 'T', '1'};
+static const uint32_t kStateVersion = 3;
+
+/* StateWriter writes a state file. */
+class StateWriter {
+public:
+	StateWriter(const string& filename)
+		: _filename(filename), _fout(filename, ios::binary | ios::trunc) {
+		assert(_fout.good());
+		_fout.write(kStateMagic, sizeof(kStateMagic));
+		write(kStateVersion);
+	}
+
+	/* write(): stores the plain value @x. */
+	template <typename T>
+	void write(const T& x) {
+		static_assert(is_trivially_copyable<T>::value, "plain types only");
+		_fout.write(reinterpret_cast<const char*>(&x), sizeof(x));
+		assert(_fout.good());
+	}
+
+	/* write(): stores the vector @x of plain values. */
+	template <typename T>
+	void write(const vector<T>& x) {
+		static_assert(is_trivially_copyable<T>::value, "plain types only");
+		write((uint64_t) x.size());
+		_fout.write(reinterpret_cast<const char*>(x.data()),
+			    x.size() * sizeof(T));
+		assert(_fout.good());
+	}
+
+	/* write(): stores the string @x. */
+	void write(const string& x) {
+		write((uint64_t) x.length());
+		_fout.write(x.data(), x.length());
+		assert(_fout.good());
+	}
+
+protected:
+	string _filename;
+	ofstream _fout;
+};
+
+/* StateReader reads back what a StateWriter wrote, in the same order. */
+class StateReader {
+public:
+	StateReader(const string& filename)
+		: _filename(filename), _fin(filename, ios::binary) {
+		if (!_fin.good()) {
+			Logger::error("(state) cannot read %", _filename);
+			assert(0);
+		}
+		char magic[sizeof(kStateMagic)];
+		_fin.read(magic, sizeof(magic));
+		uint32_t version = 0;
+		read(&version);
+		if (memcmp(magic, kStateMagic, sizeof(magic))
+		    || version != kStateVersion) {
+			Logger::error("(state) % is not a version % state file",
+				      _filename, kStateVersion);
+			assert(0);
+		}
+	}
+
+	/* read(): loads a plain value into @x. */
+	template <typename T>
+	void read(T* x) {
+		static_assert(is_trivially_copyable<T>::value, "plain types only");
+		_fin.read(reinterpret_cast<char*>(x), sizeof(*x));
+		assert(_fin.good());
+	}
+
+	/* read(): loads a vector of plain values into @x. */
+	template <typename T>
+	void read(vector<T>* x) {
+		static_assert(is_trivially_copyable<T>::value, "plain types only");
+		uint64_t size;
+		read(&size);
+		x->resize(size);
+		_fin.read(reinterpret_cast<char*>(x->data()), size * sizeof(T));
+		assert(_fin.good());
+	}
+
+	/* read(): loads a string into @x. */
+	void read(string* x) {
+		uint64_t length;
+		read(&length);
+		x->resize(length);
+		_fin.read(&(*x)[0], length);
+		assert(_fin.good());
+	}
+
+protected:
+	string _filename;
+	ifstream _fin;
+};
+
+}  // namespace btpir
+
+#endif  // __BTPIR__BUILD_DATABASE__BUILD_STATE__H__
@@ -55,23 +55,43 @@ namespace btpir {
 class DeliminatedPIRDatabase : public PIRDatabaseManifestBase {
 public:
 	DeliminatedPIRDatabase(const string& directory, const string& filename)
-		: PIRDatabaseManifestBase(directory, filename), _len_len(4) {
+		: PIRDatabaseManifestBase(directory, filename), _len_len(4),
+		  _fixed_blocksize(0) {
 		_fmt = "format_2";
 	}
 	virtual ~DeliminatedPIRDatabase() {
 	}
 
+	/* default_blocksize(): returns the blocksize used for @len bytes of
+	 * entries unless one is set.
+	 */
+	static uint64_t default_blocksize(uint64_t len) {
+		uint64_t db_size_bit = 8 * len;
+		uint64_t pir_blocksize_bit = 16 + (uint64_t) sqrt(
+			(long double) db_size_bit + 256);
+		return pir_blocksize_bit / 8;
+	}
+
+	/* set_pir_blocksize(): uses @blocksize instead of
+	 * default_blocksize(). It must fit the header and an address.
+	 */
+	virtual void set_pir_blocksize(uint64_t blocksize) {
+		assert(blocksize > header_len() + _addr_len);
+		_fixed_blocksize = blocksize;
+	}
+
 	virtual void build(const vector<string>& addresses,
 			   const vector<string>& data) {
 		size_t len = 0;
 		for (auto &x : data) {
 			len += x.length();
 		}
-		uint64_t db_size_bit = 8 * len;
-		uint64_t pir_blocksize_bit = 16 + (uint64_t) sqrt(
-			(long double) db_size_bit + 256);
 
-		set_blocksize(pir_blocksize_bit / 8);
+		if (_fixed_blocksize) {
+			set_blocksize(_fixed_blocksize);
+		} else {
+			set_blocksize(default_blocksize(len));
+		}
 		trace();
 		open_for_write();
 		process_entries(addresses, data);
@@ -103,6 +123,9 @@ protected:
 	}
 
 	int _len_len;
+
+	/* the blocksize set by set_pir_blocksize(), or 0 for none */
+	uint64_t _fixed_blocksize;
 };
 
 }  // namespace bitcoin_pir
@@ -0,0 +1,51 @@
+/*
+   Copyright 2016, Joel Reardon, UC Berkeley
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef __BTPIR__BUILD_DATABASE__DELTA_DELIMINATED_PIR_DATABASE__H__
+#define __BTPIR__BUILD_DATABASE__DELTA_DELIMINATED_PIR_DATABASE__H__
+
+#include "build_database/deliminated_pir_database.h"
+
+#include <string>
+
+using namespace std;
+
+namespace btpir {
+
+/* The DeltaDeliminatedPIRDatabase stores the same mapping as the
+ * DeliminatedPIRDatabase, from address to the list of blocks in the main
+ * database, with the same block layout: a 4-byte remaining count at the start
+ * of each block and the current address forced after it when no entry starts
+ * in that block.
+
+   The entries differ: after the 35-byte address, the list of blocks is delta
+   and varint encoded as described in block_list_codec.h. Since entries are
+   far shorter, fewer and smaller PIR blocks are needed than for format 2.
+ */
+class DeltaDeliminatedPIRDatabase : public DeliminatedPIRDatabase {
+public:
+	DeltaDeliminatedPIRDatabase(const string& directory,
+				    const string& filename)
+		: DeliminatedPIRDatabase(directory, filename) {
+		_fmt = "format_3";
+	}
+	virtual ~DeltaDeliminatedPIRDatabase() {
+	}
+};
+
+}  // namespace btpir
+
+#endif  // __BTPIR__BUILD_DATABASE__DELTA_DELIMINATED_PIR_DATABASE__H__
@@ -0,0 +1,363 @@
+/*
+   Copyright 2016, Joel Reardon, UC Berkeley
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef __BTPIR__BUILD_DATABASE__HASHED_PIR_DATABASE__H__
+#define __BTPIR__BUILD_DATABASE__HASHED_PIR_DATABASE__H__
+
+#include "build_database/pir_database_base.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "build_database/deliminated_pir_database.h"
+#include "ib/logger.h"
+
+using namespace std;
+using namespace ib;
+
+namespace btpir {
+
+/* hashed_bucket(): returns candidate bucket @i of @address among @buckets
+ * buckets in a hashed database built with @seed. This is FNV-1a over the
+ * address, started from the seed and candidate, with a final mix so that
+ * every bit of the result depends on every byte.
+ */
+inline uint64_t hashed_bucket(const string& address, uint32_t i,
+			      uint64_t seed, uint64_t buckets) {
+	assert(buckets);
+	uint64_t h = 0xcbf29ce484222325ULL ^ seed
+		^ ((uint64_t) (i + 1) * 0x9e3779b97f4a7c15ULL);
+	for (auto &x : address) {
+		h ^= (uint8_t) x;
+		h *= 0x100000001b3ULL;
+	}
+	h ^= h >> 30;
+	h *= 0xbf58476d1ce4e5b9ULL;
+	h ^= h >> 27;
+	h *= 0x94d049bb133111ebULL;
+	h ^= h >> 31;
+	return h % buckets;
+}
+
+/* The HashedPIRDatabase stores the same entries as format 3, the 35-byte
+ * address and its varint block list (block_list_codec.h), but puts each one
+ * where a hash of the address says rather than in address order. Each PIR
+ * block is a bucket, and every address has kHashes candidate buckets given
+ * by hashed_bucket(). Entries are placed by cuckoo hashing: one that finds
+ * no room in its candidates evicts entries from one of them, and those go
+ * on to their other candidates. A client computes the candidates of its
+ * address and fetches those blocks, so it needs no manifest, only the small
+ * parameter file.
+ *
+ * The entries in a bucket are back to back, with zeros after the last. An
+ * entry that does not fit in a bucket, or that cuckoo hashing gives up on,
+ * goes to the stash instead: the blocks after the buckets, holding such
+ * entries back to back as they run on across blocks. The stash is usually
+ * empty, and otherwise a client fetches all of it with each lookup, so
+ * that every lookup fetches the same blocks whether the address is in the
+ * stash or not.
+ *
+ * The parameter file has the name of the database file with ".params"
+ * attached, and one line: the candidates per address, the buckets, the
+ * stash blocks and the seed.
+ */
+class HashedPIRDatabase : public PIRDatabaseBase {
+public:
+	/* candidate buckets per address */
+	static const uint32_t kHashes = 3;
+
+	HashedPIRDatabase(const string& directory, const string& filename)
+		: PIRDatabaseBase(directory, filename), _fixed_blocksize(0),
+		  _seed(kSeed), _buckets(0), _stash_blocks(0) {
+		_fmt = "format_4 (hashed)";
+	}
+
+	/* Destructor writes the parameter file, as the database file is
+	 * renamed.
+	 */
+	virtual ~HashedPIRDatabase() {
+		if (!_buckets) return;
+		string name = final_filename() + ".params";
+		ofstream fout(name);
+		assert(fout.good());
+		fout << kHashes << " " << _buckets << " " << _stash_blocks
+		     << " " << _seed << endl;
+		assert(fout.good());
+	}
+
+	/* default_blocksize(): returns the blocksize used for @entries
+	 * unless one is set: that of format 3, but at least enough for
+	 * kMinEntriesPerBucket entries of the median size, since cuckoo
+	 * hashing needs room to move entries around. The median keeps a few
+	 * addresses with long lists from making every bucket large.
+	 */
+	static uint64_t default_blocksize(const vector<string>& entries) {
+		uint64_t len = 0;
+		vector<uint64_t> sizes;
+		for (auto &x : entries) {
+			len += x.length();
+			sizes.push_back(x.length());
+		}
+		uint64_t ret = DeliminatedPIRDatabase::default_blocksize(len);
+		if (sizes.empty()) return ret;
+		nth_element(sizes.begin(), sizes.begin() + sizes.size() / 2,
+			    sizes.end());
+		uint64_t min_size = kMinEntriesPerBucket
+			* sizes[sizes.size() / 2];
+		return ret > min_size ? ret : min_size;
+	}
+
+	/* set_pir_blocksize(): uses @blocksize instead of
+	 * default_blocksize(). It must fit an address.
+	 */
+	virtual void set_pir_blocksize(uint64_t blocksize) {
+		assert(blocksize > _addr_len);
+		_fixed_blocksize = blocksize;
+	}
+
+	/* set_seed(): hashes with @seed instead of the default. */
+	virtual void set_seed(uint64_t seed) {
+		_seed = seed;
+	}
+
+	/* build(): places the format 3 @entries of @addresses and writes the
+	 * database.
+	 */
+	virtual void build(const vector<string>& addresses,
+			   const vector<string>& entries) {
+		assert(addresses.size() == entries.size());
+		assert(entries.size());
+		set_blocksize(_fixed_blocksize ? _fixed_blocksize
+			      : default_blocksize(entries));
+		/* entries too large for a bucket go to the stash */
+		uint64_t fits = 0;
+		for (auto &x : entries) {
+			if (x.length() <= _pir_blocksize_bytes) fits += x.length();
+		}
+		_buckets = (fits * 100 + _pir_blocksize_bytes * kTargetLoad - 1)
+			/ (_pir_blocksize_bytes * kTargetLoad);
+		if (!_buckets) _buckets = 1;
+		trace();
+
+		place(addresses, entries);
+		open_for_write();
+		write_buckets(entries);
+		_fout->close();
+		trace_placement(entries);
+	}
+
+	/* Returns the buckets. */
+	uint64_t buckets() const {
+		return _buckets;
+	}
+
+	/* Returns the stash blocks after the buckets. */
+	uint64_t stash_blocks() const {
+		return _stash_blocks;
+	}
+
+	/* Returns the entries in the stash. */
+	uint64_t stash_entries() const {
+		return _stash.size();
+	}
+
+protected:
+	/* The seed hashed with unless set_seed() is called. */
+	static const uint64_t kSeed = 0x6274706972ULL;
+
+	/* The percentage of bucket space to fill. */
+	static const uint64_t kTargetLoad = 90;
+
+	/* The entries of average size a default bucket holds. */
+	static const uint64_t kMinEntriesPerBucket = 8;
+
+	/* Evictions tried for an entry before it goes to the stash. */
+	static const uint64_t kMaxKicks = 500;
+
+	/* place(): assigns every entry to a bucket or to the stash, largest
+	 * first since small ones fill in the gaps best. The evictions are
+	 * drawn from a fixed seed so the output is the same on every run.
+	 */
+	void place(const vector<string>& addresses,
+		   const vector<string>& entries) {
+		_contents.assign(_buckets, vector<uint32_t>());
+		_used.assign(_buckets, 0);
+		_candidates.resize(entries.size() * kHashes);
+		for (size_t i = 0; i < entries.size(); ++i) {
+			for (uint32_t h = 0; h < kHashes; ++h) {
+				_candidates[i * kHashes + h] = hashed_bucket(
+					addresses[i], h, _seed, _buckets);
+			}
+		}
+		vector<uint32_t> order(entries.size());
+		for (size_t i = 0; i < order.size(); ++i) order[i] = i;
+		stable_sort(order.begin(), order.end(),
+			    [&entries](uint32_t a, uint32_t b) {
+				    return entries[a].length()
+					    > entries[b].length();
+			    });
+
+		mt19937_64 rng(_seed);
+		_kicks = 0;
+		_max_kicks = 0;
+		_oversized = 0;
+		for (auto &x : order) {
+			if (entries[x].length() > _pir_blocksize_bytes) {
+				++_oversized;
+				_stash.push_back(x);
+				continue;
+			}
+			insert(x, entries, &rng);
+		}
+		sort(_stash.begin(), _stash.end());
+	}
+
+	/* insert(): places entry @entry, evicting others as needed, and
+	 * stashes whichever entry is left over if it takes too long.
+	 */
+	void insert(uint32_t entry, const vector<string>& entries,
+		    mt19937_64* rng) {
+		vector<uint32_t> pending(1, entry);
+		uint64_t kicks = 0;
+		uint64_t last = _buckets;
+		while (!pending.empty()) {
+			uint32_t x = pending.back();
+			pending.pop_back();
+			uint64_t size = entries[x].length();
+			const uint64_t* cand = &_candidates[x * kHashes];
+
+			/* the candidate with the most room */
+			uint64_t best = cand[0];
+			for (uint32_t h = 1; h < kHashes; ++h) {
+				if (_used[cand[h]] < _used[best]) best = cand[h];
+			}
+			if (_used[best] + size <= _pir_blocksize_bytes) {
+				add(best, x, size);
+				continue;
+			}
+			if (kicks == kMaxKicks) {
+				_stash.push_back(x);
+				for (auto &y : pending) _stash.push_back(y);
+				break;
+			}
+			++kicks;
+
+			/* evict from a random candidate, other than the one
+			 * it was just evicted from, until it fits
+			 */
+			uint64_t b = cand[(*rng)() % kHashes];
+			for (uint32_t h = 0; b == last && h < kHashes; ++h) {
+				b = cand[h];
+			}
+			vector<uint32_t>& in = _contents[b];
+			while (_used[b] + size > _pir_blocksize_bytes) {
+				assert(!in.empty());
+				size_t at = (*rng)() % in.size();
+				uint32_t y = in[at];
+				in[at] = in.back();
+				in.pop_back();
+				_used[b] -= entries[y].length();
+				pending.push_back(y);
+			}
+			add(b, x, size);
+			last = b;
+		}
+		_kicks += kicks;
+		if (kicks > _max_kicks) _max_kicks = kicks;
+	}
+
+	/* add(): puts entry @x, of @size bytes, in bucket @b. */
+	void add(uint64_t b, uint32_t x, uint64_t size) {
+		_contents[b].push_back(x);
+		_used[b] += size;
+		assert(_used[b] <= _pir_blocksize_bytes);
+	}
+
+	/* write_buckets(): writes each bucket, its entries in the order of
+	 * @entries, and then the stash.
+	 */
+	void write_buckets(const vector<string>& entries) {
+		for (uint64_t b = 0; b < _buckets; ++b) {
+			vector<uint32_t>& in = _contents[b];
+			sort(in.begin(), in.end());
+			for (auto &x : in) write(entries[x]);
+			finish_block();
+		}
+		uint64_t before = _blocks;
+		for (auto &x : _stash) write(entries[x]);
+		if (!_stash.empty()) finish_block();
+		_stash_blocks = _blocks - before;
+	}
+
+	/* finish_block(): fills the rest of the block with zeros and starts
+	 * the next one.
+	 */
+	void finish_block() {
+		safe_write(nullptr, get_safe_len());
+		new_block(0);
+	}
+
+	/* trace_placement(): outputs how full the buckets are and what went
+	 * to the stash.
+	 */
+	void trace_placement(const vector<string>& entries) const {
+		uint64_t placed = 0, stashed = 0;
+		for (auto &x : _used) placed += x;
+		for (auto &x : _stash) stashed += entries[x].length();
+		Logger::info("(btpir) Buckets        : %", _buckets);
+		Logger::info("(btpir) Load factor    : %",
+			     (double) placed / (_buckets * _pir_blocksize_bytes));
+		Logger::info("(btpir) Entries/bucket : %",
+			     (double) (entries.size() - _stash.size())
+			     / _buckets);
+		Logger::info("(btpir) Evictions      : % (at most % for an "
+			     "entry)", _kicks, _max_kicks);
+		Logger::info("(btpir) Stash entries  : % (% too large, % B, "
+			     "% blocks)", _stash.size(), _oversized, stashed,
+			     _stash_blocks);
+	}
+
+	/* the blocksize set by set_pir_blocksize(), or 0 for none */
+	uint64_t _fixed_blocksize;
+
+	uint64_t _seed;
+	uint64_t _buckets;
+	uint64_t _stash_blocks;
+
+	/* the candidate buckets of each entry, kHashes each */
+	vector<uint64_t> _candidates;
+
+	/* the entries in each bucket, and the bytes they use */
+	vector<vector<uint32_t>> _contents;
+	vector<uint64_t> _used;
+
+	/* the entries in the stash, in order */
+	vector<uint32_t> _stash;
+
+	/* placement statistics */
+	uint64_t _kicks;
+	uint64_t _max_kicks;
+	uint64_t _oversized;
+};
+
+}  // namespace btpir
+
+#endif  // __BTPIR__BUILD_DATABASE__HASHED_PIR_DATABASE__H__
@@ -0,0 +1,137 @@
+/*
+   Copyright 2016, Joel Reardon, UC Berkeley
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef __BTPIR__BUILD_DATABASE__LOCALITY_ORDER__H__
+#define __BTPIR__BUILD_DATABASE__LOCALITY_ORDER__H__
+
+#include <cassert>
+#include <cstdint>
+#include <functional>
+#include <queue>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+namespace btpir {
+
+/* LocalityOrder orders transactions so that each address's transactions
+ * sit together, and so take few main database blocks. Transactions and
+ * addresses form a bipartite graph; the order is a traversal of it that
+ * places all of an address's remaining transactions at once when it visits
+ * the address, and then goes on to the other addresses of those
+ * transactions.
+ *
+ * Among the addresses reached, the one with the fewest transactions is
+ * visited first. A transaction shared between a small address and a large
+ * one then goes with the small one, which could otherwise need a block for
+ * it alone, while the large one takes many blocks whatever the order and is
+ * often skipped anyway. Each traversal starts from the first transaction
+ * not yet placed, so unrelated transactions keep their order.
+ */
+class LocalityOrder {
+public:
+	/* For @transactions transactions among @addresses addresses. */
+	LocalityOrder(uint64_t transactions, uint32_t addresses)
+		: _transactions(transactions), _addresses(addresses) {}
+
+	/* add(): notes that transaction @tx has address @address. Every
+	 * transaction's addresses must be added together, in increasing order
+	 * of transaction.
+	 */
+	void add(uint64_t tx, uint32_t address) {
+		assert(tx < _transactions);
+		assert(address < _addresses);
+		assert(_tx_of.empty() || _tx_of.back() <= tx);
+		_tx_of.push_back(tx);
+		_address_of.push_back(address);
+	}
+
+	/* order(): returns the transactions in their new order. */
+	vector<uint32_t> order() const {
+		/* the addresses of each transaction */
+		vector<uint64_t> tx_start(_transactions + 1, 0);
+		for (auto &x : _tx_of) ++tx_start[x + 1];
+		for (uint64_t i = 0; i < _transactions; ++i) {
+			tx_start[i + 1] += tx_start[i];
+		}
+
+		/* the transactions of each address, in order */
+		vector<uint64_t> addr_start(_addresses + 1, 0);
+		for (auto &x : _address_of) ++addr_start[x + 1];
+		for (uint32_t i = 0; i < _addresses; ++i) {
+			addr_start[i + 1] += addr_start[i];
+		}
+		vector<uint32_t> addr_txs(_tx_of.size());
+		vector<uint64_t> fill(addr_start.begin(), addr_start.end() - 1);
+		for (size_t i = 0; i < _tx_of.size(); ++i) {
+			addr_txs[fill[_address_of[i]]++] = _tx_of[i];
+		}
+
+		vector<uint32_t> ret;
+		ret.reserve(_transactions);
+		vector<bool> placed(_transactions, false);
+		vector<bool> reached(_addresses, false);
+
+		/* addresses reached, fewest transactions first */
+		typedef pair<uint64_t, uint32_t> Reached;
+		priority_queue<Reached, vector<Reached>, greater<Reached>> next;
+		auto reach = [&](uint64_t tx) {
+			for (uint64_t i = tx_start[tx]; i < tx_start[tx + 1];
+			     ++i) {
+				uint32_t a = _address_of[i];
+				if (reached[a]) continue;
+				reached[a] = true;
+				next.push(Reached(addr_start[a + 1]
+						  - addr_start[a], a));
+			}
+		};
+		auto place = [&](uint64_t tx) {
+			placed[tx] = true;
+			ret.push_back(tx);
+			reach(tx);
+		};
+
+		for (uint64_t tx = 0; tx < _transactions; ++tx) {
+			if (placed[tx]) continue;
+			place(tx);
+			while (!next.empty()) {
+				uint32_t a = next.top().second;
+				next.pop();
+				for (uint64_t i = addr_start[a];
+				     i < addr_start[a + 1]; ++i) {
+					if (!placed[addr_txs[i]]) {
+						place(addr_txs[i]);
+					}
+				}
+			}
+		}
+		assert(ret.size() == _transactions);
+		return ret;
+	}
+
+protected:
+	uint64_t _transactions;
+	uint32_t _addresses;
+
+	/* each (transaction, address) pair, by transaction */
+	vector<uint32_t> _tx_of;
+	vector<uint32_t> _address_of;
+};
+
+}  // namespace btpir
+
+#endif  // __BTPIR__BUILD_DATABASE__LOCALITY_ORDER__H__
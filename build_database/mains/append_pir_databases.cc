@@ -0,0 +1,50 @@
+#include "build_database/transaction_processor.h"
+#include "build_database/tx_file_reader.h"
+
+#include <cassert>
+#include <cstdlib>
+#include <thread>
+
+#include "ib/logger.h"
+
+using namespace std;
+using namespace ib;
+using namespace btpir;
+
+int main(int argc, char **argv) {
+	if (argc != 4 && argc != 5) {
+		Logger::error("usage: % new_tx_file output_directory "
+			      "output_file_prefix [threads]", argv[0]);
+		Logger::error("");
+		Logger::error("Appends the transactions in NEW_TX_FILE to the "
+			      "databases that build_pir_databases (or an "
+			      "earlier append) wrote with the same directory "
+			      "and prefix, using <output_file_prefix>_state. "
+			      "NEW_TX_FILE is in the same format as TX_FILE. "
+			      "The skip_threshold, hints, hint_file, "
+			      "hint_clients, hashed and reorder given to "
+			      "build_pir_databases are kept.");
+		return -1;
+	}
+	string tx_file = argv[1];
+	string directory = argv[2];
+	string filename = argv[3];
+	size_t threads = thread::hardware_concurrency();
+	if (argc == 5) threads = strtoul(argv[4], nullptr, 10);
+
+	TransactionProcessor processor(directory, filename);
+	processor.spill_to_disk();
+	processor.set_threads(threads);
+	processor.resume_build();
+
+	TxFileReader reader(tx_file);
+	vector<TxChunk> chunks = reader.split(threads);
+	for (size_t i = 0; i < chunks.size(); ++i) {
+		if (i + 1 < chunks.size()) reader.prefetch(chunks[i + 1]);
+		reader.for_each(chunks[i], [&processor](const TxRecord& record) {
+			processor.add_tx(record.addresses, record.data);
+		});
+	}
+
+	return 0;
+}
@@ -0,0 +1,28 @@
+#include "build_database/pir_delta.h"
+
+#include <string>
+
+#include "ib/logger.h"
+
+using namespace std;
+using namespace ib;
+using namespace btpir;
+
+int main(int argc, char **argv) {
+	if (argc < 3) {
+		Logger::error("usage: % pir_directory delta_file "
+			      "[delta_file ...]", argv[0]);
+		Logger::error("");
+		Logger::error("Patches the PIR databases in PIR_DIRECTORY in "
+			      "place with the delta files written when "
+			      "appending, in the order given. Each names the "
+			      "database it updates, which is renamed to its "
+			      "new name.");
+		return -1;
+	}
+	string directory = argv[1];
+	for (int i = 2; i < argc; ++i) {
+		if (!PIRDelta::apply(argv[i], directory)) return 1;
+	}
+	return 0;
+}
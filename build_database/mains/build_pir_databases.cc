@@ -1,7 +1,10 @@
 #include "build_database/transaction_processor.h"
+#include "build_database/tx_file_reader.h"
 
 #include <cassert>
+#include <cstdlib>
 #include <fstream>
+#include <thread>
 
 #include "ib/logger.h"
 
@@ -10,9 +13,39 @@ using namespace ib;
 using namespace btpir;
 
 int main(int argc, char **argv) {
-	if (argc != 4) {
+	if (argc < 4 || argc > 12) {
 		Logger::error("usage: % tx_file output_directory "
-			      "output_file_prefix", argv[0]);
+			      "output_file_prefix [threads [skip_threshold "
+			      "[shards [hints [hashed [reorder "
+			      "[hint_file [hint_clients]]]]]]]]", argv[0]);
+		Logger::error("skip_threshold: addresses with more blocks to "
+			      "get are left out of the address databases "
+			      "(default 0: the square root of the main "
+			      "database's blocks)");
+		Logger::error("shards: files to split the main database into "
+			      "for serving from several machines (default 1)");
+		Logger::error("hints: offline/online PIR hint sets to make for "
+			      "the main database (default 0); about 4 times "
+			      "the square root of its blocks covers nearly all "
+			      "of them. Needs hint_file");
+		Logger::error("hashed: 1 to also write the hashed address "
+			      "database, addr_db.fmt4, which clients look up "
+			      "without a manifest (default 0)");
+		Logger::error("reorder: 1 to lay out the transactions so that "
+			      "each address's are close together, and so take "
+			      "fewer blocks, instead of in the order of "
+			      "TX_FILE (default 0)");
+		Logger::error("hint_file: where to write the hints, outside "
+			      "output_directory, one file for each client with "
+			      ".0, .1, ... attached. WARNING: the hints are "
+			      "for clients only. A server holding them can tell "
+			      "which block each hinted query fetches, so never "
+			      "serve them or give them to a server. Never "
+			      "share a hint file between clients either: two "
+			      "clients using the same hint give away both the "
+			      "blocks they fetch with it");
+		Logger::error("hint_clients: hint files to make, one for "
+			      "each client (default 1)");
 		Logger::error("");
 		Logger::error("");
 		Logger::error("---------------------------------------");
@@ -32,54 +65,57 @@ int main(int argc, char **argv) {
 		Logger::error("<TX2 binary string of transaction length>");
 		Logger::error("...");
 		Logger::error("---------------------------------------");
+		Logger::error("");
+		Logger::error("TX_FILE may also be in the binary format "
+			      "written by convert_tx_file.");
 		return -1;
 	}
 	string tx_file = argv[1];
 	string directory = argv[2];
 	string filename = argv[3];
-	vector<set<string>> addresses;
-	vector<string> transactions;
-
-	{
-		ifstream fin(tx_file);
-		assert(fin.good());
-
-		while (fin.good()) {
-			size_t number_addresses;
-			size_t transaction_length;
-			fin >> number_addresses;
-			if (!fin.good()) break;
-			addresses.push_back(set<string>());
-			for (size_t i = 0; i < number_addresses; ++i) {
-				string address;
-				fin >> address;
-				assert(fin.good());
-				assert(!addresses.back().count(address));
-				addresses.back().insert(address);
-			}
-			string dummy;
-			fin >> transaction_length;
-			getline(fin, dummy);
-			assert(fin.good());
-			assert(dummy.empty());
-			unique_ptr<char[]> buf(new char[transaction_length]);
-			fin.read(buf.get(), transaction_length);
-			assert(fin.good());
-			getline(fin, dummy);
-			assert(fin.good());
-
-			assert(dummy.empty());
-			transactions.push_back("");
-			transactions.back().assign(buf.get(),
-						   transaction_length);
-
-		}
+	size_t threads = thread::hardware_concurrency();
+	if (argc >= 5) threads = strtoul(argv[4], nullptr, 10);
+	uint64_t skip_threshold = 0;
+	if (argc >= 6) skip_threshold = strtoull(argv[5], nullptr, 10);
+	size_t shards = 1;
+	if (argc >= 7) shards = strtoul(argv[6], nullptr, 10);
+	uint64_t hints = 0;
+	if (argc >= 8) hints = strtoull(argv[7], nullptr, 10);
+	bool hashed = false;
+	if (argc >= 9) hashed = strtoul(argv[8], nullptr, 10);
+	bool reorder = false;
+	if (argc >= 10) reorder = strtoul(argv[9], nullptr, 10);
+	string hint_file;
+	if (argc >= 11) hint_file = argv[10];
+	uint64_t hint_clients = 1;
+	if (argc == 12) hint_clients = strtoull(argv[11], nullptr, 10);
+	if (hints && hint_file.empty()) {
+		Logger::error("hints need a hint_file outside %", directory);
+		return -1;
+	}
+	if (hints && !hint_clients) {
+		Logger::error("hints need at least one hint client");
+		return -1;
 	}
-	assert(addresses.size() == transactions.size());
 
 	TransactionProcessor processor(directory, filename);
-	for (size_t i = 0; i < addresses.size(); ++i) {
-		processor.add_tx(addresses[i], transactions[i]);
+	processor.spill_to_disk();
+	processor.set_threads(threads);
+	processor.set_skip_threshold(skip_threshold);
+	processor.set_shards(shards);
+	processor.set_hints(hints, hint_file, hint_clients);
+	processor.set_hashed(hashed);
+	processor.set_reorder(reorder);
+
+	TxFileReader reader(tx_file);
+	vector<TxChunk> chunks = reader.split(threads);
+	Logger::info("(main) % bytes in % chunks", reader.size(), chunks.size());
+
+	for (size_t i = 0; i < chunks.size(); ++i) {
+		if (i + 1 < chunks.size()) reader.prefetch(chunks[i + 1]);
+		reader.for_each(chunks[i], [&processor](const TxRecord& record) {
+			processor.add_tx(record.addresses, record.data);
+		});
 	}
 
 	return 0;
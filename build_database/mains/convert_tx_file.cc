@@ -0,0 +1,43 @@
+#include "build_database/tx_file_reader.h"
+#include "build_database/tx_file_writer.h"
+
+#include <cassert>
+#include <cstdlib>
+#include <string>
+
+#include "ib/logger.h"
+
+using namespace std;
+using namespace ib;
+using namespace btpir;
+
+static const uint32_t kDefaultStride = 1024;
+
+int main(int argc, char **argv) {
+	if (argc != 3 && argc != 4) {
+		Logger::error("usage: % text_tx_file binary_tx_file "
+			      "[index_stride]", argv[0]);
+		Logger::error("");
+		Logger::error("Converts a TX_FILE in the text format read by "
+			      "build_pir_databases to the binary format.");
+		Logger::error("Every index_stride-th record offset is written "
+			      "to binary_tx_file.idx (default %, 0 for none).",
+			      kDefaultStride);
+		return -1;
+	}
+	string text_file = argv[1];
+	string binary_file = argv[2];
+	uint32_t stride = kDefaultStride;
+	if (argc == 4) stride = strtoul(argv[3], nullptr, 10);
+
+	TxFileReader reader(text_file);
+	assert(!reader.binary());
+	TxFileWriter writer(binary_file, stride);
+	for (auto &x : reader.split(1)) {
+		reader.for_each(x, [&writer](const TxRecord& record) {
+			writer.write(record.addresses, record.data);
+		});
+	}
+	writer.close();
+	return 0;
+}
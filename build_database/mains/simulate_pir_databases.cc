@@ -0,0 +1,53 @@
+#include "build_database/transaction_processor.h"
+#include "build_database/tx_file_reader.h"
+
+#include <cassert>
+#include <cstdlib>
+#include <thread>
+
+#include "ib/logger.h"
+
+using namespace std;
+using namespace ib;
+using namespace btpir;
+
+int main(int argc, char **argv) {
+	if (argc < 5) {
+		Logger::error("usage: % tx_file output_directory "
+			      "output_file_prefix blocksize [blocksize ...]",
+			      argv[0]);
+		Logger::error("");
+		Logger::error("Lays out the main database with every blocksize "
+			      "given, without writing it, and writes the block "
+			      "count, padding and blocks-to-get histogram of "
+			      "each to <output_file_prefix>_geometry.");
+		return -1;
+	}
+	string tx_file = argv[1];
+	string directory = argv[2];
+	string filename = argv[3];
+	vector<uint64_t> blocksizes;
+	for (int i = 4; i < argc; ++i) {
+		blocksizes.push_back(strtoull(argv[i], nullptr, 10));
+		if (blocksizes.back() <= 8) {
+			Logger::error("blocksize % is too small", argv[i]);
+			return -1;
+		}
+	}
+	size_t threads = thread::hardware_concurrency();
+
+	TransactionProcessor processor(directory, filename);
+	processor.set_threads(threads);
+	processor.simulate_blocksizes(blocksizes);
+
+	TxFileReader reader(tx_file);
+	vector<TxChunk> chunks = reader.split(threads);
+	for (size_t i = 0; i < chunks.size(); ++i) {
+		if (i + 1 < chunks.size()) reader.prefetch(chunks[i + 1]);
+		reader.for_each(chunks[i], [&processor](const TxRecord& record) {
+			processor.add_tx(record.addresses, record.data);
+		});
+	}
+
+	return 0;
+}
@@ -0,0 +1,53 @@
+#include "build_database/pir_cost_model.h"
+#include "build_database/transaction_processor.h"
+#include "build_database/tx_file_reader.h"
+
+#include <cassert>
+#include <cstdlib>
+#include <thread>
+
+#include "ib/logger.h"
+
+using namespace std;
+using namespace ib;
+using namespace btpir;
+
+int main(int argc, char **argv) {
+	if (argc != 7 && argc != 8) {
+		Logger::error("usage: % tx_file output_directory "
+			      "output_file_prefix upload_cost download_cost "
+			      "scan_cost [threads]", argv[0]);
+		Logger::error("");
+		Logger::error("Builds the same databases as build_pir_databases "
+			      "but picks each blocksize to minimize the cost "
+			      "of a lookup, where the costs are per byte of "
+			      "query sent, per byte of response and per byte "
+			      "the server reads. The cost of every blocksize "
+			      "tried is written to "
+			      "<output_file_prefix>_blocksize_costs.");
+		return -1;
+	}
+	string tx_file = argv[1];
+	string directory = argv[2];
+	string filename = argv[3];
+	PIRCostModel model(strtod(argv[4], nullptr), strtod(argv[5], nullptr),
+			   strtod(argv[6], nullptr));
+	size_t threads = thread::hardware_concurrency();
+	if (argc == 8) threads = strtoul(argv[7], nullptr, 10);
+
+	TransactionProcessor processor(directory, filename);
+	processor.spill_to_disk();
+	processor.set_threads(threads);
+	processor.tune_blocksizes(model);
+
+	TxFileReader reader(tx_file);
+	vector<TxChunk> chunks = reader.split(threads);
+	for (size_t i = 0; i < chunks.size(); ++i) {
+		if (i + 1 < chunks.size()) reader.prefetch(chunks[i + 1]);
+		reader.for_each(chunks[i], [&processor](const TxRecord& record) {
+			processor.add_tx(record.addresses, record.data);
+		});
+	}
+
+	return 0;
+}
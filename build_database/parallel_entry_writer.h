@@ -0,0 +1,336 @@
+/*
+   Copyright 2016, Joel Reardon, UC Berkeley
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef __BTPIR__BUILD_DATABASE__PARALLEL_ENTRY_WRITER__H__
+#define __BTPIR__BUILD_DATABASE__PARALLEL_ENTRY_WRITER__H__
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <functional>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+#include "ib/logger.h"
+#include "build_database/thread_pool.h"
+#include "build_database/transaction_spill.h"
+
+using namespace std;
+using namespace ib;
+
+namespace btpir {
+
+/* ParallelEntryWriter writes the main database file from its layout, the
+ * file offset of each entry's length, with several threads at once. The file
+ * is sized up front and cut into windows of whole PIR blocks; each window is
+ * filled in memory by one thread, from its block headers, entries and padding,
+ * and written where it goes with pwrite(2).
+ *
+ * The bytes are the ones TransactionPIRDatabase writes one after another:
+ * each block starts with the count of the bytes of the entry running into it
+ * still to come, each entry is its 4-byte length and then its bytes, and an
+ * entry whose length fills a block has its bytes start the next one. Entries
+ * are read as records, the 4-byte length and then the entry, as they are in
+ * a TransactionSpill.
+ */
+class ParallelEntryWriter {
+public:
+	/* For a file of @end bytes in blocks of @blocksize bytes whose entry
+	 * i has length @lengths[i] at offset @offsets[i].
+	 */
+	ParallelEntryWriter(uint64_t blocksize,
+			    const vector<uint32_t>& lengths,
+			    const vector<uint64_t>& offsets, uint64_t end)
+		: _blocksize(blocksize), _lengths(lengths), _offsets(offsets),
+		  _end(end) {
+		/* a length is never split, so a block holds one past its
+		 * header */
+		assert(blocksize >= 2 * kHeaderLen);
+		assert(lengths.size() == offsets.size());
+		size_t blocks = kMinWindow / blocksize;
+		if (!blocks) blocks = 1;
+		_window = blocks * blocksize;
+	}
+
+	/* write(): writes the file @filename with the entries @entries using
+	 * @threads threads, or one per hardware thread if 0.
+	 */
+	void write(const string& filename, const vector<string>& entries,
+		   size_t threads) {
+		assert(entries.size() == _lengths.size());
+		write(filename, threads, [&](uint64_t lo, uint64_t hi,
+					     char* buf) {
+			fill(lo, hi, buf, [&](uint64_t pos, uint64_t i,
+					      uint64_t offset, size_t len) {
+				copy_record(entries[i], offset, len,
+					    buf + pos - lo);
+			});
+		});
+	}
+
+	/* write(): as above, but reads the entries from @spill. Each window
+	 * needs a contiguous run of it, found from where each record starts,
+	 * which is read with a single pread(2).
+	 */
+	void write(const string& filename, TransactionSpill* spill,
+		   size_t threads) {
+		assert(spill);
+		assert(spill->records() == _lengths.size());
+		spill->rewind();
+		ThreadPool pool(threads);
+		vector<uint64_t> records = record_offsets(&pool);
+		write(filename, &pool, [&](uint64_t lo, uint64_t hi,
+					   char* buf) {
+			/* the span of the spill this window takes */
+			uint64_t first = UINT64_MAX;
+			uint64_t last = 0;
+			fill(lo, hi, nullptr, [&](uint64_t pos, uint64_t i,
+						  uint64_t offset, size_t len) {
+				first = min(first, records[i] + offset);
+				last = max(last, records[i] + offset + len);
+			});
+			string run(first < last ? last - first : 0, 0);
+			if (!run.empty()) {
+				spill->read_at(first, &run[0], run.length());
+			}
+			fill(lo, hi, buf, [&](uint64_t pos, uint64_t i,
+					      uint64_t offset, size_t len) {
+				memcpy(buf + pos - lo,
+				       &run[records[i] + offset - first], len);
+			});
+		});
+	}
+
+	/* The header of each PIR block. */
+	static const uint64_t kHeaderLen = sizeof(uint32_t);
+
+protected:
+	/* The smallest window size used, in bytes. */
+	static const size_t kMinWindow = 1 << 20;
+
+	/* Emit(pos, i, offset, len) takes the @len bytes of record @i from
+	 * @offset that go at @pos in the file.
+	 */
+	typedef function<void(uint64_t, uint64_t, uint64_t, size_t)> Emit;
+
+	/* write(): sizes @filename and has @threads threads call
+	 * @window(lo, hi, buf) to fill buf, which is zeroed, with the bytes of
+	 * the file in [lo, hi) for each window, which it then writes.
+	 */
+	void write(const string& filename, size_t threads,
+		   function<void(uint64_t, uint64_t, char*)> window) {
+		ThreadPool pool(threads);
+		write(filename, &pool, window);
+	}
+
+	void write(const string& filename, ThreadPool* pool,
+		   function<void(uint64_t, uint64_t, char*)> window) {
+		auto start = chrono::steady_clock::now();
+		int fd = open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC,
+			      0644);
+		assert(fd >= 0);
+		int ret = ftruncate(fd, _end);
+		assert(!ret);
+
+		uint64_t windows = (_end + _window - 1) / _window;
+		pool->parallel_for(0, windows, [&](size_t begin, size_t end) {
+			vector<char> buf(_window);
+			for (size_t w = begin; w < end; ++w) {
+				uint64_t lo = w * _window;
+				uint64_t hi = min(lo + _window, _end);
+				memset(&buf[0], 0, hi - lo);
+				window(lo, hi, &buf[0]);
+				write_out(fd, filename, &buf[0], hi - lo, lo);
+			}
+		});
+		ret = ::close(fd);
+		assert(!ret);
+
+		double secs = chrono::duration_cast<chrono::nanoseconds>(
+			chrono::steady_clock::now() - start).count() / 1e9;
+		double mib = _end / (double) (1 << 20);
+		Logger::info("(btpir) Wrote % MiB to % with % threads", mib,
+			     filename, pool->size());
+		Logger::info("(btpir) Overall  (MiB/s): %",
+			     secs > 0 ? mib / secs : 0);
+	}
+
+	/* fill(): calls @emit for each run of entry bytes in [@lo, @hi) of
+	 * the file, and writes the block headers there into @buf, which holds
+	 * that range, unless it is null. Block 0 and the blocks that no entry
+	 * runs into have a zero header, like the padding, so they are left
+	 * alone.
+	 */
+	void fill(uint64_t lo, uint64_t hi, char* buf, const Emit& emit) const {
+		/* the entry running into the window, if any */
+		uint64_t i = upper_bound(_offsets.begin(), _offsets.end(), lo)
+			- _offsets.begin();
+		if (i) --i;
+		for (; i < _offsets.size() && _offsets[i] < hi; ++i) {
+			lay_entry(i, lo, hi, buf, emit);
+		}
+	}
+
+	/* lay_entry(): as fill(), for entry @i, following
+	 * TransactionPIRDatabase::process_entry().
+	 */
+	void lay_entry(uint64_t i, uint64_t lo, uint64_t hi, char* buf,
+		       const Emit& emit) const {
+		uint64_t pos = _offsets[i];
+		uint64_t length = _lengths[i];
+		clip(pos, i, 0, kHeaderLen, lo, hi, emit);
+		pos += kHeaderLen;
+		if (!(pos % _blocksize)) {
+			header(pos, length, lo, hi, buf);
+			pos += kHeaderLen;
+		}
+		uint64_t done = 0;
+		while (done < length && pos < hi) {
+			/* jump the whole blocks before the window */
+			if (pos % _blocksize == kHeaderLen
+			    && pos + _blocksize <= lo) {
+				uint64_t skip = min(
+					(lo - pos) / _blocksize,
+					(length - done - 1)
+					/ (_blocksize - kHeaderLen));
+				pos += skip * _blocksize;
+				done += skip * (_blocksize - kHeaderLen);
+			}
+			uint64_t n = min(length - done,
+					 _blocksize - pos % _blocksize);
+			clip(pos, i, kHeaderLen + done, n, lo, hi, emit);
+			pos += n;
+			done += n;
+			if (done < length) {
+				header(pos, length - done, lo, hi, buf);
+				pos += kHeaderLen;
+			}
+		}
+	}
+
+	/* header(): writes the part of the block header @remaining at @pos
+	 * that is in [@lo, @hi) into @buf, which holds that range, unless
+	 * @buf is null.
+	 */
+	static void header(uint64_t pos, uint32_t remaining, uint64_t lo,
+			   uint64_t hi, char* buf) {
+		if (!buf) return;
+		const char* bytes = reinterpret_cast<const char*>(&remaining);
+		for (uint64_t j = 0; j < kHeaderLen; ++j) {
+			if (pos + j >= lo && pos + j < hi) {
+				buf[pos + j - lo] = bytes[j];
+			}
+		}
+	}
+
+	/* clip(): calls @emit for the part of the @len bytes of record @i
+	 * from @offset, which go at @pos, that is in [@lo, @hi).
+	 */
+	static void clip(uint64_t pos, uint64_t i, uint64_t offset,
+			 uint64_t len, uint64_t lo, uint64_t hi,
+			 const Emit& emit) {
+		uint64_t begin = max(pos, lo);
+		uint64_t end = min(pos + len, hi);
+		if (begin >= end) return;
+		emit(begin, i, offset + begin - pos, end - begin);
+	}
+
+	/* copy_record(): copies @len bytes from @offset of the record of
+	 * @entry, its length and then itself, to @out.
+	 */
+	static void copy_record(const string& entry, uint64_t offset,
+				size_t len, char* out) {
+		uint32_t length = entry.length();
+		const char* bytes = reinterpret_cast<const char*>(&length);
+		while (len && offset < kHeaderLen) {
+			*out++ = bytes[offset++];
+			--len;
+		}
+		if (len) memcpy(out, entry.data() + offset - kHeaderLen, len);
+	}
+
+	/* record_offsets(): returns where each record starts in the spill,
+	 * the sums of the records before it, using @pool for the prefix sum.
+	 */
+	vector<uint64_t> record_offsets(ThreadPool* pool) const {
+		size_t n = _lengths.size();
+		vector<uint64_t> ret(n);
+		size_t parts = min(n, pool->size());
+		if (!parts) return ret;
+		/* each part sums its records, then adds the parts before */
+		vector<uint64_t> sums(parts + 1, 0);
+		pool->parallel_for(0, parts, [&](size_t begin, size_t end) {
+			for (size_t p = begin; p < end; ++p) {
+				uint64_t sum = 0;
+				for (size_t i = n * p / parts;
+				     i < n * (p + 1) / parts; ++i) {
+					ret[i] = sum;
+					sum += kHeaderLen + _lengths[i];
+				}
+				sums[p + 1] = sum;
+			}
+		});
+		for (size_t p = 0; p < parts; ++p) sums[p + 1] += sums[p];
+		pool->parallel_for(0, parts, [&](size_t begin, size_t end) {
+			for (size_t p = begin; p < end; ++p) {
+				for (size_t i = n * p / parts;
+				     i < n * (p + 1) / parts; ++i) {
+					ret[i] += sums[p];
+				}
+			}
+		});
+		return ret;
+	}
+
+	/* write_out(): writes @len bytes from @data at @offset of @fd. */
+	static void write_out(int fd, const string& filename, const char* data,
+			      size_t len, uint64_t offset) {
+		while (len) {
+			ssize_t ret = pwrite(fd, data, len, offset);
+			if (ret < 0 && errno == EINTR) continue;
+			if (ret <= 0) {
+				Logger::error("(btpir) write to % failed",
+					      filename);
+				assert(0);
+				return;
+			}
+			data += ret;
+			len -= ret;
+			offset += ret;
+		}
+	}
+
+	uint64_t _blocksize;
+	const vector<uint32_t>& _lengths;
+
+	/* the file offset of each entry's length */
+	const vector<uint64_t>& _offsets;
+
+	/* the file size */
+	uint64_t _end;
+
+	/* the bytes each thread fills and writes at a time */
+	uint64_t _window;
+};
+
+}  // namespace btpir
+
+#endif  // __BTPIR__BUILD_DATABASE__PARALLEL_ENTRY_WRITER__H__
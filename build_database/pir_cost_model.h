@@ -0,0 +1,86 @@
+/*
+   Copyright 2016, Joel Reardon, UC Berkeley
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef __BTPIR__BUILD_DATABASE__PIR_COST_MODEL__H__
+#define __BTPIR__BUILD_DATABASE__PIR_COST_MODEL__H__
+
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+using namespace std;
+
+namespace btpir {
+
+/* PIRCostModel prices a PIR query against a database of a given geometry.
+ * A query sends one bit per block, the response is one block, and the
+ * server reads the whole database to answer it. Each is weighted by the
+ * cost of a byte of it, in whatever unit the caller chooses; e.g., a scan
+ * weight of 0.001 says a byte read by the server costs a thousandth of a
+ * byte sent over the network.
+ */
+struct PIRCostModel {
+	PIRCostModel(double upload = 1, double download = 1, double scan = 0)
+		: upload(upload), download(download), scan(scan) {}
+
+	/* query_cost(): returns the cost of one query to a database of
+	 * @blocks blocks of @blocksize bytes.
+	 */
+	double query_cost(uint64_t blocks, uint64_t blocksize) const {
+		return upload * blocks / 8.0 + download * blocksize
+			+ scan * (double) blocks * blocksize;
+	}
+
+	/* cost(): returns the cost of a client's lookup that needs
+	 * @blocks_per_lookup blocks on average.
+	 */
+	double cost(double blocks_per_lookup, uint64_t blocks,
+		    uint64_t blocksize) const {
+		return blocks_per_lookup * query_cost(blocks, blocksize);
+	}
+
+	/* candidates(): returns the blocksizes to try around @center, from
+	 * @center / 16 to @center * 16 in steps of sqrt(2), none of which is
+	 * below @min_blocksize.
+	 */
+	static vector<uint64_t> candidates(uint64_t center,
+					   uint64_t min_blocksize) {
+		assert(center);
+		vector<uint64_t> ret;
+		for (int i = -8; i <= 8; ++i) {
+			uint64_t b = (uint64_t) llround(center * pow(2, i / 2.0));
+			if (b < min_blocksize) continue;
+			if (!ret.empty() && ret.back() == b) continue;
+			ret.push_back(b);
+		}
+		if (ret.empty()) ret.push_back(min_blocksize);
+		return ret;
+	}
+
+	/* cost per byte of query sent by the client */
+	double upload;
+
+	/* cost per byte of response sent by the server */
+	double download;
+
+	/* cost per byte of database read by the server */
+	double scan;
+};
+
+}  // namespace btpir
+
+#endif  // __BTPIR__BUILD_DATABASE__PIR_COST_MODEL__H__
@@ -18,6 +18,9 @@
 #define __BTPIR__BUILD_DATABASE__PIR_DATABASE_BASE__H__
 
 #include "build_database/abstract_pir_database.h"
+#include "build_database/block_range.h"
+#include "build_database/block_writer.h"
+#include "build_database/pir_geometry.h"
 
 #include <fstream>
 #include <string>
@@ -41,31 +44,110 @@ public:
 		: _len(0), _blocks(0),
 		  _addr_len(35),
 		  _filename(directory + "/" + filename),
-		  _fmt("base") {
+		  _fmt("base"), _dry_run(false), _shard_blocks(0) {
 	}
 	/* Destructor finishes writing the database. It fills the final block's
 	 * leftover content with zeros and closes the file.
 	 */
 	virtual ~PIRDatabaseBase() {
 
+		if (_fout) _fout->close();
+		if (_dry_run) return;
 		Logger::info("(btpir) Wrote % PIR DB: %", _fmt, _filename);
 		Logger::info("(btpir) Total size (B): %", _total_size);
 		Logger::info("(btpir) PIR Blocks    : %", _blocks);
 		Logger::info("(btpir) Blocksize  (B): %", _pir_blocksize_bytes);
 
+		if (_shard_blocks) {
+			finish_shards();
+			return;
+		}
+
 		/* rename files to have useful data handy */
                 string old_filename = Logger::stringify("%_%.pir",
                                                         _filename,
                                                         _pir_blocksize_bytes);
 
-                string new_filename = Logger::stringify("%_%_%.pir",
-                                                        _filename,
-                                                        _blocks,
-                                                        _pir_blocksize_bytes);
+                string new_filename = final_filename();
                 assert(!rename(old_filename.c_str(), new_filename.c_str()));
 	}
 
+	/* final_filename(): returns the name the database file is given when
+	 * it is finished, which records its blocks and blocksize.
+	 */
+	string final_filename() const {
+		return PIRGeometry::filename(_filename, _blocks,
+					     _pir_blocksize_bytes);
+	}
+
+	/* shard_filename(): returns the name shard @i of the database file is
+	 * given when it is finished.
+	 */
+	string shard_filename(size_t i) const {
+		return PIRGeometry::shard_filename(_filename, _blocks,
+						   _pir_blocksize_bytes, i);
+	}
+
+	/* set_shard_blocks(): makes the database file be written as shards
+	 * of @blocks PIR blocks each, but for the last, which has the rest,
+	 * instead of as one file. The blocks keep their numbers in the whole
+	 * database; shard i starts with block i * @blocks. 0, the default,
+	 * writes one file.
+	 */
+	virtual void set_shard_blocks(uint64_t blocks) {
+		_shard_blocks = blocks;
+	}
+
+	/* Returns the PIR blocksize in bytes. */
+	uint64_t blocksize() const {
+		return _pir_blocksize_bytes;
+	}
+
+	/* file_size(): returns the bytes written to the database file. */
+	virtual uint64_t file_size() const {
+		return _fout ? _fout->written() : 0;
+	}
+
 protected:
+	/* shard_tmp_filename(): returns the name of shard @i while it is
+	 * written.
+	 */
+	string shard_tmp_filename(size_t i) const {
+		return Logger::stringify("%_%_shard_%.pir", _filename,
+					 _pir_blocksize_bytes, i);
+	}
+
+	/* finish_shards(): gives each shard file its final name and writes
+	 * the shard map, a file with the name of the database file and
+	 * ".shards" attached. Its first line has the number of shards and the
+	 * blocksize, and each following line describes a shard: its first
+	 * block, its blocks, its bytes and its file name.
+	 */
+	void finish_shards() const {
+		const ShardedBlockWriter* shards =
+			dynamic_cast<const ShardedBlockWriter*>(_fout.get());
+		assert(shards);
+		string name = final_filename() + ".shards";
+		ofstream fout(name);
+		assert(fout.good());
+		fout << shards->shards() << " " << _pir_blocksize_bytes << endl;
+		for (size_t i = 0; i < shards->shards(); ++i) {
+			string old_filename = shard_tmp_filename(i);
+			string new_filename = shard_filename(i);
+			assert(!rename(old_filename.c_str(),
+				       new_filename.c_str()));
+			uint64_t size = shards->shard_size(i);
+			fout << i * _shard_blocks << " "
+			     << (size + _pir_blocksize_bytes - 1)
+				/ _pir_blocksize_bytes << " " << size << " "
+			     << new_filename.substr(new_filename.rfind('/') + 1)
+			     << endl;
+		}
+		assert(fout.good());
+		Logger::info("(btpir) Wrote % shards of % blocks: %",
+			     shards->shards(), _shard_blocks, name);
+	}
+
 	/* called when writing the first PIR block's header */
 	virtual void write_opening_header() {
 	}
@@ -78,10 +160,7 @@ protected:
 
 	/* open the PIR database files for writing data. */
 	virtual void open_for_write() {
-		_fout.reset(new ofstream(
-			Logger::stringify("%_%.pir",
-					  _filename,
-					  _pir_blocksize_bytes)));
+		_fout.reset(new_writer());
 		assert(_fout->good());
 
 		_cur_distance = header_len();
@@ -91,6 +170,24 @@ protected:
 		write_opening_header();
 	}
 
+	/* new_writer(): makes the output for the database file, or one that
+	 * discards everything for a dry run.
+	 */
+	virtual BlockWriter* new_writer() const {
+		if (_dry_run) return new BlockWriter();
+		if (_shard_blocks) {
+			return new ShardedBlockWriter(
+				[this](size_t i) {
+					return shard_tmp_filename(i);
+				}, _pir_blocksize_bytes,
+				_shard_blocks * _pir_blocksize_bytes);
+		}
+		return new BlockWriter(Logger::stringify("%_%.pir",
+							 _filename,
+							 _pir_blocksize_bytes),
+				       _pir_blocksize_bytes);
+	}
+
 	/* Called whenever a new transaction is being added to the database.
          * @address is address it is linked to, length is the length of
          * the data corresponding to the transaction.
@@ -110,12 +207,6 @@ protected:
          */
 	virtual void end_tx(const string& address, uint32_t length) {}
 
-	/* Called before each atomic write to the database. */
-	virtual void pre_write() {}
-
-	/* Called after each atomic write to the database. */
-        virtual void post_write() {}
-
 	/* Returns the size of the footer. */
         virtual size_t footer_len() const {
                 return 0;
@@ -196,7 +287,10 @@ protected:
 		write(data.c_str(), data.length());
 	}
 
-	/* write(): writes @len bytes from @data to the PIR database. */
+	/* write(): writes @len bytes from @data to the PIR database. If @data
+	 * is null, @len zeros take its place, for dry runs where only the
+	 * layout matters.
+	 */
 	virtual void write(const char* data, size_t len) {
 		size_t written = 0;
 
@@ -206,12 +300,13 @@ protected:
 			size_t pivot = get_safe_len();
 			assert(pivot <= _pir_blocksize_bytes);
                         if (len <= pivot) {
-                                safe_write(data + written, len);
-				_blocks_used.insert(_cur_block);
+                                safe_write(data ? data + written : nullptr,
+					   len);
+				_blocks_used.add(_cur_block);
                                 return;
                         }
-                        safe_write(data + written, pivot);
-			_blocks_used.insert(_cur_block);
+                        safe_write(data ? data + written : nullptr, pivot);
+			_blocks_used.add(_cur_block);
                         written += pivot;
                         len -= pivot;
                         new_block(len);
@@ -220,26 +315,26 @@ protected:
 
 	/* write_zeros(): writes @len bytes of zeros to the database */
 	virtual void write_zeros(size_t len) {
-		string zeros;
-		zeros.resize(len);
-		_fout->write(zeros.c_str(), zeros.length());
+		_fout->write_zeros(len);
 	}
 
-	/* Writes @len bytes of the the string @data to the current output file
-	 * _fout. All writes shall go through this function.
+	/* Writes @len bytes of the the string @data, or zeros if it is null,
+	 * to the current output file _fout. All writes of entry data shall go
+	 * through this function.
 	 */
-	virtual void safe_write(const char* data, size_t len) {
-		pre_write();
+	void safe_write(const char* data, size_t len) {
 		if (!len) return;
-		_fout->write(data, len);
-		assert(_fout->good());
+		if (data) {
+			_fout->write(data, len);
+		} else {
+			_fout->write_zeros(len);
+		}
 		_cur_distance += len;
 		_total_size += len;
 		assert(_cur_distance <= _pir_blocksize_bytes);
-		post_write();
 	}
 
-	unique_ptr<ofstream> _fout;
+	unique_ptr<BlockWriter> _fout;
 	string _cur_addr;
 	uint64_t _pir_blocksize_bytes;
 	uint64_t _cur_distance;
@@ -251,7 +346,15 @@ protected:
 	uint32_t _cur_block;
 	string _filename;
 	string _fmt;
-	set<uint32_t> _blocks_used;
+
+	/* if set, nothing is written and the files are left alone */
+	bool _dry_run;
+
+	/* PIR blocks per shard file, or 0 to write one file */
+	uint64_t _shard_blocks;
+
+	/* the PIR blocks used by the current transaction */
+	BlockRange _blocks_used;
 };
 
 }  // namespace btpir
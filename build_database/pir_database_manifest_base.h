@@ -20,10 +20,12 @@
 #include "build_database/pir_database_base.h"
 
 #include <fstream>
+#include <memory>
 #include <string>
 #include <unistd.h>
 #include <vector>
 
+#include "build_database/binary_manifest.h"
 #include "ib/logger.h"
 
 using namespace std;
@@ -40,7 +42,8 @@ public:
 				const string& filename)
 			: PIRDatabaseBase(directory, filename) {
 		_fmanifest.reset(new ofstream(_filename + ".pir.manifest"));
-
+		_bmanifest.reset(new BinaryManifestWriter(
+			_filename + ".pir.manifest.bin"));
 	}
 	/* Destructor finishes writing the database. It fills the final block's
 	 * leftover content with zeros and closes the file.
@@ -48,25 +51,32 @@ public:
 	virtual ~PIRDatabaseManifestBase() {
 		/* rename files to have useful data handy */
 		_fmanifest->close();
+		_bmanifest->close();
                 string old_filename = Logger::stringify("%.pir.manifest",
                                                         _filename);
-                string new_filename = Logger::stringify("%_%_%.pir.manifest",
-                                                        _filename,
-                                                        _blocks,
-                                                        _pir_blocksize_bytes);
+                string new_filename = final_filename() + ".manifest";
                 assert(!rename(old_filename.c_str(),
                                new_filename.c_str()));
+		assert(!rename((old_filename + ".bin").c_str(),
+			       (new_filename + ".bin").c_str()));
 	}
 
 protected:
-	/* new_block(): called whenever a new PIR block is created. */
+	/* new_block(): called whenever a new PIR block is created. The
+	 * manifests are written through their buffers and not flushed per
+	 * line.
+	 */
 	virtual void new_block(size_t remaining) {
-		*_fmanifest << _cur_addr << endl;
+		*_fmanifest << _cur_addr << '\n';
 		assert(_fmanifest->good());
+		_bmanifest->add(_cur_addr);
 		PIRDatabaseBase::new_block(remaining);
 	}
 
 	unique_ptr<ofstream> _fmanifest;
+
+	/* the same manifest in binary (see binary_manifest.h) */
+	unique_ptr<BinaryManifestWriter> _bmanifest;
 };
 
 }  // namespace btpir
@@ -0,0 +1,337 @@
+/*
+   Copyright 2016, Joel Reardon, UC Berkeley
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef __BTPIR__BUILD_DATABASE__PIR_DELTA__H__
+#define __BTPIR__BUILD_DATABASE__PIR_DELTA__H__
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <string>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <vector>
+
+#include "ib/logger.h"
+
+using namespace std;
+using namespace ib;
+
+namespace btpir {
+
+/* A delta file turns one version of a PIR database file into the next, so
+ * that a server can update its copy in place instead of fetching the whole
+ * file. It is a PIRDeltaHeader, the name of the file it applies to and the
+ * name that file has afterwards (each a uint32_t length and the bytes), and
+ * then each changed block as a uint64_t block index followed by the block.
+ * Every block is blocksize bytes except the last block of the file, which
+ * runs to new_size. A delta with no new name removes the file.
+ */
+struct PIRDeltaHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t reserved;
+	uint64_t blocksize;
+	uint64_t old_size;
+	uint64_t new_size;
+	uint64_t changed;
+};
+
+static const char kDeltaMagic[8] = {'B', 'T', 'P', 'I', 'R', 'D', 'L', '1'};
+static const uint32_t kDeltaVersion = 1;
+
+/* PIRDeltaSpec describes the delta between two versions of a database. */
+struct PIRDeltaSpec {
+	/* name of the file the server has, or empty if it has none */
+	string old_name;
+
+	/* name of the file after the delta is applied, or empty if it is
+	   removed */
+	string new_name;
+
+	/* path of the old version to compare against, or empty to take every
+	   block from from_block on */
+	string old_path;
+
+	/* path of the new version */
+	string new_path;
+
+	/* blocksize of the new version */
+	uint64_t blocksize;
+
+	/* bytes in the old version */
+	uint64_t old_size;
+
+	/* blocks before this one are known to be the same in both */
+	uint64_t from_block;
+};
+
+/* PIRDelta writes and applies delta files. */
+class PIRDelta {
+public:
+	/* write(): writes the delta described by @spec to @delta_file and
+	 * returns the number of changed blocks in it.
+	 */
+	static uint64_t write(const PIRDeltaSpec& spec,
+			      const string& delta_file) {
+		if (spec.new_name.empty()) {
+			return write_removal(spec, delta_file);
+		}
+		assert(spec.blocksize);
+		FILE* fnew = fopen(spec.new_path.c_str(), "rb");
+		assert(fnew);
+		FILE* fold = nullptr;
+		if (!spec.old_path.empty()) {
+			fold = fopen(spec.old_path.c_str(), "rb");
+			assert(fold);
+		}
+		FILE* fout = fopen(delta_file.c_str(), "wb");
+		assert(fout);
+
+		PIRDeltaHeader header;
+		memset(&header, 0, sizeof(header));
+		memcpy(header.magic, kDeltaMagic, sizeof(header.magic));
+		header.version = kDeltaVersion;
+		header.blocksize = spec.blocksize;
+		header.old_size = spec.old_size;
+		header.new_size = file_size(fnew);
+		put(fout, &header, sizeof(header));
+		put_name(fout, spec.old_name);
+		put_name(fout, spec.new_name);
+
+		uint64_t blocks = (header.new_size + spec.blocksize - 1)
+			/ spec.blocksize;
+		vector<char> block(spec.blocksize), old_block(spec.blocksize);
+		for (uint64_t i = spec.from_block; i < blocks; ++i) {
+			uint64_t offset = i * spec.blocksize;
+			size_t len = min(spec.blocksize,
+					 header.new_size - offset);
+			get(fnew, offset, &block[0], len);
+			/* the last old block may have grown, so only
+			 * blocks of the same length can match */
+			if (fold && offset < spec.old_size &&
+			    len == min(spec.blocksize,
+				       spec.old_size - offset)) {
+				get(fold, offset, &old_block[0], len);
+				if (!memcmp(&block[0], &old_block[0], len))
+					continue;
+			}
+			put(fout, &i, sizeof(i));
+			put(fout, &block[0], len);
+			++header.changed;
+		}
+
+		int ret = fseek(fout, 0, SEEK_SET);
+		assert(!ret);
+		put(fout, &header, sizeof(header));
+		ret = fclose(fout);
+		assert(!ret);
+		fclose(fnew);
+		if (fold) fclose(fold);
+		Logger::info("(delta) % of % blocks of % changed: %",
+			     header.changed, blocks, spec.new_name,
+			     delta_file);
+		return header.changed;
+	}
+
+	/* apply(): patches the database in @directory named in @delta_file
+	 * in place with positioned writes and renames it to its new name, or
+	 * removes it if the delta gives none. Returns false if the delta is
+	 * not for the database as it is, in which case it is left alone, or if
+	 * writing it failed.
+	 */
+	static bool apply(const string& delta_file, const string& directory) {
+		FILE* fin = fopen(delta_file.c_str(), "rb");
+		if (!fin) {
+			Logger::error("(delta) cannot read %", delta_file);
+			return false;
+		}
+		PIRDeltaHeader header;
+		string old_name, new_name;
+		if (fread(&header, sizeof(header), 1, fin) != 1 ||
+		    memcmp(header.magic, kDeltaMagic,
+			   sizeof(kDeltaMagic)) ||
+		    header.version != kDeltaVersion ||
+		    !get_name(fin, &old_name) || !get_name(fin, &new_name)) {
+			Logger::error("(delta) % is not a delta file",
+				      delta_file);
+			fclose(fin);
+			return false;
+		}
+
+		string old_path = directory + "/" + old_name;
+		string new_path = directory + "/" + new_name;
+		if (new_name.empty()) {
+			fclose(fin);
+			return remove_file(old_path, header.old_size);
+		}
+		int fd;
+		if (old_name.empty()) {
+			fd = open(new_path.c_str(),
+				  O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		} else {
+			fd = open(old_path.c_str(), O_WRONLY);
+		}
+		if (fd < 0) {
+			Logger::error("(delta) cannot open %", old_name.empty()
+				      ? new_path : old_path);
+			fclose(fin);
+			return false;
+		}
+		struct stat st;
+		if (fstat(fd, &st) ||
+		    (!old_name.empty() &&
+		     (uint64_t) st.st_size != header.old_size)) {
+			Logger::error("(delta) % has % bytes, the delta is "
+				      "for %", old_path, st.st_size,
+				      header.old_size);
+			::close(fd);
+			fclose(fin);
+			return false;
+		}
+
+		vector<char> block(header.blocksize);
+		bool good = true;
+		for (uint64_t i = 0; good && i < header.changed; ++i) {
+			uint64_t index;
+			good = fread(&index, sizeof(index), 1, fin) == 1;
+			uint64_t offset = index * header.blocksize;
+			good = good && offset < header.new_size;
+			if (!good) break;
+			size_t len = min(header.blocksize,
+					 header.new_size - offset);
+			good = fread(&block[0], 1, len, fin) == len
+				&& pwrite_all(fd, &block[0], len, offset);
+		}
+		good = good && !ftruncate(fd, header.new_size)
+			&& !fsync(fd);
+		good = !::close(fd) && good;
+		fclose(fin);
+		if (!good) {
+			Logger::error("(delta) applying % failed",
+				      delta_file);
+			return false;
+		}
+		if (!old_name.empty() && old_name != new_name &&
+		    rename(old_path.c_str(), new_path.c_str())) {
+			Logger::error("(delta) cannot rename % to %", old_path,
+				      new_path);
+			return false;
+		}
+		Logger::info("(delta) applied % blocks to %", header.changed,
+			     new_path);
+		return true;
+	}
+
+protected:
+	/* write_removal(): writes the delta that removes the database
+	 * @spec.old_name to @delta_file.
+	 */
+	static uint64_t write_removal(const PIRDeltaSpec& spec,
+				      const string& delta_file) {
+		assert(!spec.old_name.empty());
+		FILE* fout = fopen(delta_file.c_str(), "wb");
+		assert(fout);
+		PIRDeltaHeader header;
+		memset(&header, 0, sizeof(header));
+		memcpy(header.magic, kDeltaMagic, sizeof(header.magic));
+		header.version = kDeltaVersion;
+		header.old_size = spec.old_size;
+		put(fout, &header, sizeof(header));
+		put_name(fout, spec.old_name);
+		put_name(fout, spec.new_name);
+		int ret = fclose(fout);
+		assert(!ret);
+		Logger::info("(delta) % is removed: %", spec.old_name,
+			     delta_file);
+		return 0;
+	}
+
+	/* remove_file(): removes @path if it has @size bytes. Returns false
+	 * if it does not or cannot be removed.
+	 */
+	static bool remove_file(const string& path, uint64_t size) {
+		struct stat st;
+		if (stat(path.c_str(), &st) || (uint64_t) st.st_size != size) {
+			Logger::error("(delta) % is not the % bytes the delta "
+				      "removes", path, size);
+			return false;
+		}
+		if (unlink(path.c_str())) {
+			Logger::error("(delta) cannot remove %", path);
+			return false;
+		}
+		Logger::info("(delta) removed %", path);
+		return true;
+	}
+
+	static uint64_t file_size(FILE* f) {
+		struct stat st;
+		int ret = fstat(fileno(f), &st);
+		assert(!ret);
+		return st.st_size;
+	}
+
+	static void put(FILE* f, const void* data, size_t len) {
+		size_t ret = fwrite(data, 1, len, f);
+		assert(ret == len);
+	}
+
+	static void put_name(FILE* f, const string& name) {
+		uint32_t len = name.length();
+		put(f, &len, sizeof(len));
+		put(f, name.data(), len);
+	}
+
+	static bool get_name(FILE* f, string* name) {
+		uint32_t len;
+		if (fread(&len, sizeof(len), 1, f) != 1 || len > 4096)
+			return false;
+		name->resize(len);
+		return !len || fread(&(*name)[0], 1, len, f) == len;
+	}
+
+	/* get(): reads @len bytes at @offset of @f into @data. */
+	static void get(FILE* f, uint64_t offset, char* data, size_t len) {
+		int ret = fseeko(f, offset, SEEK_SET);
+		assert(!ret);
+		size_t got = fread(data, 1, len, f);
+		assert(got == len);
+	}
+
+	/* pwrite_all(): writes @len bytes of @data at @offset of @fd. */
+	static bool pwrite_all(int fd, const char* data, size_t len,
+			       uint64_t offset) {
+		while (len) {
+			ssize_t ret = pwrite(fd, data, len, offset);
+			if (ret < 0 && errno == EINTR) continue;
+			if (ret <= 0) return false;
+			data += ret;
+			len -= ret;
+			offset += ret;
+		}
+		return true;
+	}
+};
+
+}  // namespace btpir
+
+#endif  // __BTPIR__BUILD_DATABASE__PIR_DELTA__H__
@@ -0,0 +1,120 @@
+/*
+   Copyright 2016, Joel Reardon, UC Berkeley
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef __BTPIR__BUILD_DATABASE__PIR_GEOMETRY__H__
+#define __BTPIR__BUILD_DATABASE__PIR_GEOMETRY__H__
+
+#include <cassert>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+
+#include "build_database/address_bitmap.h"
+#include "ib/logger.h"
+
+using namespace std;
+using namespace ib;
+
+namespace btpir {
+
+/* PIRGeometry is the shape of a PIR database file as the server sees it: a
+ * sequence of blocks of blocksize bytes, the last of which may be short, as
+ * it is in the main database. A query selects blocks with a bitmap laid out
+ * like the format 1 address bitmap: block b is bit (7 - b % 8) of byte b / 8.
+ *
+ * It also holds the naming of the finished files, so that the databases and
+ * the code that serves them agree on it.
+ */
+struct PIRGeometry {
+	PIRGeometry() : blocks(0), blocksize(0), size(0) {}
+
+	/* for_size(): returns the geometry of a file of @size bytes in blocks
+	 * of @blocksize bytes.
+	 */
+	static PIRGeometry for_size(uint64_t size, uint64_t blocksize) {
+		assert(blocksize);
+		PIRGeometry ret;
+		ret.blocks = (size + blocksize - 1) / blocksize;
+		ret.blocksize = blocksize;
+		ret.size = size;
+		return ret;
+	}
+
+	/* query_bytes(): returns the bytes in a query bitmap. */
+	uint64_t query_bytes() const {
+		return block_bitmap_len(blocks);
+	}
+
+	/* block_len(): returns the bytes in block @i. */
+	uint64_t block_len(uint64_t i) const {
+		assert(i < blocks);
+		uint64_t offset = i * blocksize;
+		return size - offset < blocksize ? size - offset : blocksize;
+	}
+
+	/* filename(): returns the name of the finished database with the
+	 * path prefix @prefix, @blocks as counted by the writer, and
+	 * @blocksize.
+	 */
+	static string filename(const string& prefix, uint64_t blocks,
+			       uint64_t blocksize) {
+		return Logger::stringify("%_%_%.pir", prefix, blocks,
+					 blocksize);
+	}
+
+	/* shard_filename(): returns the name of shard @shard of the database
+	 * filename() names.
+	 */
+	static string shard_filename(const string& prefix, uint64_t blocks,
+				     uint64_t blocksize, uint64_t shard) {
+		return Logger::stringify("%_%_%_shard_%.pir", prefix, blocks,
+					 blocksize, shard);
+	}
+
+	/* parse_blocksize(): returns the blocksize in a name made by
+	 * filename() or shard_filename(), or 0 if @filename is neither.
+	 */
+	static uint64_t parse_blocksize(const string& filename) {
+		const string kSuffix = ".pir";
+		if (filename.length() <= kSuffix.length() ||
+		    filename.compare(filename.length() - kSuffix.length(),
+				     kSuffix.length(), kSuffix)) {
+			return 0;
+		}
+		string stem = filename.substr(0, filename.length()
+					      - kSuffix.length());
+		size_t shard = stem.rfind("_shard_");
+		if (shard != string::npos) stem.resize(shard);
+		size_t pos = stem.rfind('_');
+		if (pos == string::npos || pos + 1 == stem.length()) return 0;
+		char* end;
+		uint64_t ret = strtoull(stem.c_str() + pos + 1, &end, 10);
+		return *end ? 0 : ret;
+	}
+
+	/* number of blocks, counting a short last one */
+	uint64_t blocks;
+
+	/* bytes in each block */
+	uint64_t blocksize;
+
+	/* bytes in the file */
+	uint64_t size;
+};
+
+}  // namespace btpir
+
+#endif  // __BTPIR__BUILD_DATABASE__PIR_GEOMETRY__H__
@@ -0,0 +1,297 @@
+/*
+   Copyright 2016, Joel Reardon, UC Berkeley
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef __BTPIR__BUILD_DATABASE__PIR_HINTS__H__
+#define __BTPIR__BUILD_DATABASE__PIR_HINTS__H__
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <sys/random.h>
+#include <thread>
+#include <vector>
+
+#include "build_database/pir_geometry.h"
+#include "build_database/thread_pool.h"
+#include "ib/logger.h"
+
+using namespace std;
+using namespace ib;
+
+namespace btpir {
+
+/* Offline/online PIR hints, after Piano. The blocks of a database are cut
+ * into chunks of about sqrt(blocks) consecutive blocks. A hint set has one
+ * block from every chunk, at a random offset within it, and its hint is the
+ * XOR of those blocks. A client holding hints fetches block b of chunk c
+ * with one it has not used whose set contains b: it sends the server the
+ * set's offsets with the one for chunk c replaced by a fresh random one, and
+ * the server returns, for every chunk, the XOR of the set's blocks in the
+ * other chunks. The entry for chunk c is the same as for the hint's own set,
+ * so XORing it with the hint gives block b. The server reads one block per
+ * chunk instead of the whole database, and the offsets it sees are uniform
+ * whichever block was wanted.
+ *
+ * The hints must be made by someone who does not collude with the server
+ * answering the online queries, as the sets are what hides the blocks. A
+ * used hint is spent; a client out of hints that cover a block falls back
+ * on a linear-scan query.
+ *
+ * Each client gets a hint file of its own, with its own sets. A query shows
+ * the server all of its set but the one chunk, so if the same hint were used
+ * twice, by two clients or by one after a restart, for blocks in different
+ * chunks, each query would show the other's real offset there, and with it
+ * both blocks. So a hint file must never be shared between clients, and a
+ * client keeps the hints it has spent on disk (see hint_pir.h).
+ */
+
+/* random_bytes(): fills the @len bytes at @out from the kernel's random
+ * source.
+ */
+static void random_bytes(void* out, size_t len) {
+	uint8_t* p = reinterpret_cast<uint8_t*>(out);
+	while (len) {
+		ssize_t ret = getrandom(p, len, 0);
+		assert(ret > 0);
+		p += ret;
+		len -= ret;
+	}
+}
+
+/* PIRHintLayout is how a database's blocks are cut into chunks. */
+struct PIRHintLayout {
+	PIRHintLayout() : blocks(0), chunk_blocks(0), chunks(0) {}
+
+	/* for_blocks(): returns the layout for @blocks blocks. */
+	static PIRHintLayout for_blocks(uint64_t blocks) {
+		PIRHintLayout ret;
+		ret.blocks = blocks;
+		ret.chunk_blocks = (uint64_t) ceil(sqrt((long double) blocks));
+		if (!ret.chunk_blocks) ret.chunk_blocks = 1;
+		ret.chunks = (blocks + ret.chunk_blocks - 1) / ret.chunk_blocks;
+		return ret;
+	}
+
+	/* chunk_len(): returns the blocks in chunk @c; the last may be
+	 * short.
+	 */
+	uint64_t chunk_len(uint64_t c) const {
+		assert(c < chunks);
+		return min(chunk_blocks, blocks - c * chunk_blocks);
+	}
+
+	/* random_offsets(): sets the @chunks offsets at @out to a random
+	 * offset in each chunk.
+	 */
+	void random_offsets(uint32_t* out) const {
+		vector<uint64_t> bits(chunks);
+		random_bytes(bits.data(), bits.size() * sizeof(uint64_t));
+		for (uint64_t c = 0; c < chunks; ++c) {
+			out[c] = (uint32_t) (bits[c] % chunk_len(c));
+		}
+	}
+
+	uint64_t blocks;
+	uint64_t chunk_blocks;
+	uint64_t chunks;
+};
+
+/* The hint file is a PIRHintHeader, then the sets, hints rows of chunks
+ * uint32_t offsets, then the hints, blocksize bytes each.
+ */
+struct PIRHintHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t reserved;
+	uint64_t blocks;
+	uint64_t blocksize;
+	uint64_t hints;
+
+	/* random for each file, so that the hints spent from one file are
+	   never taken for those of another */
+	uint8_t id[16];
+};
+
+static const char kPIRHintMagic[8] = {'B', 'T', 'P', 'I', 'R', 'H', 'N', '1'};
+static const uint32_t kPIRHintVersion = 2;
+
+/* PIRHintBuilder makes the hint files of the clients of a database file.
+ * The file is read once, a window of whole chunks at a time, while the
+ * worker threads XOR the previous window into the hints of every client,
+ * each worker a range of them.
+ */
+class PIRHintBuilder {
+public:
+	/* For @hints hint sets for each of @clients clients over @pir_file
+	 * in blocks of @blocksize bytes, using @threads threads, or one per
+	 * hardware thread if 0.
+	 */
+	PIRHintBuilder(const string& pir_file, uint64_t blocksize,
+		       uint64_t hints, uint64_t clients, size_t threads)
+		: _pir_file(pir_file), _hints(hints), _clients(clients),
+		  _threads(threads) {
+		assert(clients);
+		FILE* f = fopen(pir_file.c_str(), "rb");
+		if (!f) {
+			Logger::error("(hints) cannot read %", pir_file);
+			assert(0);
+		}
+		fseeko(f, 0, SEEK_END);
+		_geometry = PIRGeometry::for_size(ftello(f), blocksize);
+		fclose(f);
+		_layout = PIRHintLayout::for_blocks(_geometry.blocks);
+	}
+
+	/* Returns how the blocks are cut into chunks. */
+	const PIRHintLayout& layout() const {
+		return _layout;
+	}
+
+	/* client_file(): returns the name of the hint file of client
+	 * @client of those built to @hint_file.
+	 */
+	static string client_file(const string& hint_file, uint64_t client) {
+		return Logger::stringify("%.%", hint_file, client);
+	}
+
+	/* build(): picks the sets of every client, makes their hints and
+	 * writes both to each client's file (see client_file()).
+	 */
+	void build(const string& hint_file) {
+		uint64_t bs = _geometry.blocksize;
+		uint64_t chunks = _layout.chunks;
+		uint64_t total = _hints * _clients;
+		_sets.resize(total * chunks);
+		for (uint64_t h = 0; h < total; ++h) {
+			_layout.random_offsets(&_sets[h * chunks]);
+		}
+		_parities.assign(total * bs, 0);
+
+		uint64_t chunk_bytes = _layout.chunk_blocks * bs;
+		uint64_t window = max((uint64_t) 1, kWindowBytes / chunk_bytes);
+		vector<uint8_t> current(window * chunk_bytes);
+		vector<uint8_t> next(window * chunk_bytes);
+		FILE* fin = fopen(_pir_file.c_str(), "rb");
+		assert(fin);
+		ThreadPool pool(_threads);
+		uint64_t got = fread(current.data(), 1, current.size(), fin);
+		for (uint64_t c = 0; c < chunks; c += window) {
+			uint64_t stop = min(chunks, c + window);
+			uint64_t next_got = 0;
+			thread reader([&]() {
+				if (stop < chunks) {
+					next_got = fread(next.data(), 1,
+							 next.size(), fin);
+				}
+			});
+			pool.parallel_for(0, total, [&](size_t lo, size_t hi) {
+				add_window(current.data(), got, c, stop, lo, hi);
+			});
+			reader.join();
+			current.swap(next);
+			got = next_got;
+		}
+		fclose(fin);
+		for (uint64_t c = 0; c < _clients; ++c) {
+			write(c, client_file(hint_file, c));
+		}
+		Logger::info("(hints) % hints for each of % clients over % "
+			     "chunks of % blocks: %", _hints, _clients, chunks,
+			     _layout.chunk_blocks, hint_file);
+	}
+
+protected:
+	/* The most bytes of the database read at once. */
+	static const uint64_t kWindowBytes = 64 << 20;
+
+	/* add_window(): XORs into hints [@lo, @hi), those of all the clients
+	 * one after another, their blocks in chunks
+	 * [@first, @stop), whose @len bytes are at @data. Bytes past the end
+	 * of the file count as zeros.
+	 */
+	void add_window(const uint8_t* data, uint64_t len, uint64_t first,
+			uint64_t stop, size_t lo, size_t hi) {
+		uint64_t bs = _geometry.blocksize;
+		for (size_t h = lo; h < hi; ++h) {
+			uint8_t* parity = &_parities[h * bs];
+			const uint32_t* set = &_sets[h * _layout.chunks];
+			for (uint64_t c = first; c < stop; ++c) {
+				uint64_t at = ((c - first) * _layout.chunk_blocks
+					       + set[c]) * bs;
+				if (at >= len) continue;
+				uint64_t n = min(bs, len - at);
+				for (uint64_t i = 0; i < n; ++i) {
+					parity[i] ^= data[at + i];
+				}
+			}
+		}
+	}
+
+	/* write(): writes the header, sets and hints of client @client to
+	 * @hint_file.
+	 */
+	void write(uint64_t client, const string& hint_file) const {
+		PIRHintHeader header;
+		memset(&header, 0, sizeof(header));
+		memcpy(header.magic, kPIRHintMagic, sizeof(header.magic));
+		header.version = kPIRHintVersion;
+		header.blocks = _geometry.blocks;
+		header.blocksize = _geometry.blocksize;
+		header.hints = _hints;
+		random_bytes(header.id, sizeof(header.id));
+		FILE* fout = fopen(hint_file.c_str(), "wb");
+		if (!fout) {
+			Logger::error("(hints) cannot write %", hint_file);
+			assert(0);
+		}
+		size_t ret = fwrite(&header, sizeof(header), 1, fout);
+		assert(ret == 1);
+		size_t sets = _hints * _layout.chunks;
+		ret = fwrite(_sets.data() + client * sets, sizeof(uint32_t),
+			     sets, fout);
+		assert(ret == sets);
+		size_t bytes = _hints * _geometry.blocksize;
+		ret = fwrite(_parities.data() + client * bytes, 1, bytes,
+			     fout);
+		assert(ret == bytes);
+		ret = fclose(fout);
+		assert(!ret);
+	}
+
+	// Prohibit copy
+	PIRHintBuilder(const PIRHintBuilder& copy) {}
+
+	string _pir_file;
+	PIRGeometry _geometry;
+	PIRHintLayout _layout;
+	uint64_t _hints;
+	uint64_t _clients;
+	size_t _threads;
+
+	/* the offset in each chunk of each set, client by client */
+	vector<uint32_t> _sets;
+
+	/* the hint of each set, client by client */
+	vector<uint8_t> _parities;
+};
+
+}  // namespace btpir
+
+#endif  // __BTPIR__BUILD_DATABASE__PIR_HINTS__H__
@@ -0,0 +1,67 @@
+/*
+ * =====================================================================================
+   Copyright 2016
+   Joel Reardon, UC Berkeley
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ * =====================================================================================
+*/
+
+#include "build_database/address_bitmap.h"
+
+#include <cassert>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "ib/logger.h"
+
+using namespace btpir;
+using namespace ib;
+using namespace std;
+
+/* Returns the bitmap of @blocks out of @nblocks, after the prefix "addr". */
+string bitmap(const vector<uint32_t>& blocks, uint64_t nblocks) {
+	string out = "addr";
+	append_block_bitmap(blocks.data(), blocks.size(), nblocks, &out);
+	assert(out.substr(0, 4) == "addr");
+	return out.substr(4);
+}
+
+int main(int argc, char** argv) {
+	/* the length is rounded up to whole bytes */
+	assert(bitmap({}, 0) == "");
+	assert(bitmap({}, 1) == string(1, '\0'));
+	assert(bitmap({}, 8) == string(1, '\0'));
+	assert(bitmap({}, 9) == string(2, '\0'));
+
+	/* block b is bit 7 - b % 8 of byte b / 8 */
+	assert(bitmap({0}, 8) == "\x80");
+	assert(bitmap({1}, 8) == "\x40");
+	assert(bitmap({7}, 8) == "\x01");
+	assert(bitmap({0, 1, 2, 3, 4, 5, 6, 7}, 8) == "\xff");
+	assert(bitmap({8}, 9) == string("\x00\x80", 2));
+	assert(bitmap({3, 10, 17}, 24) == "\x10\x20\x40");
+	assert(bitmap({0, 15, 16, 31}, 32) == "\x80\x01\x80\x01");
+
+	/* every single block lands in its own bit */
+	for (uint32_t b = 0; b < 100; ++b) {
+		string out = bitmap({b}, 100);
+		assert(out.length() == 13);
+		for (uint32_t i = 0; i < 100; ++i) {
+			bool set = (uint8_t) out[i / 8] & (0x80 >> (i % 8));
+			assert(set == (i == b));
+		}
+	}
+	Logger::info("test_address_bitmap passed");
+}
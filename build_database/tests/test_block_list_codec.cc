@@ -0,0 +1,97 @@
+/*
+ * =====================================================================================
+   Copyright 2016
+   Joel Reardon, UC Berkeley
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ * =====================================================================================
+*/
+
+#include "build_database/block_list_codec.h"
+
+#include <cassert>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "ib/logger.h"
+
+using namespace btpir;
+using namespace ib;
+using namespace std;
+
+/* Encodes @blocks after a prefix, checks that it decodes back to @blocks
+ * and returns the encoding.
+ */
+string round_trip(const vector<uint32_t>& blocks) {
+	string out = "addr";
+	append_block_list(blocks.data(), blocks.size(), &out);
+	assert(out.substr(0, 4) == "addr");
+	string code = out.substr(4);
+
+	vector<uint32_t> decoded(3, 7);
+	size_t used = decode_block_list(
+		reinterpret_cast<const uint8_t*>(code.data()), code.length(),
+		&decoded);
+	assert(used == code.length());
+	assert(decoded == blocks);
+
+	/* trailing bytes are not consumed */
+	string more = code + "\x01\x02\x03\x04\x05\x06\x07\x08";
+	used = decode_block_list(
+		reinterpret_cast<const uint8_t*>(more.data()), more.length(),
+		&decoded);
+	assert(used == code.length());
+	assert(decoded == blocks);
+
+	/* any truncation is rejected */
+	for (size_t i = 0; i < code.length(); ++i) {
+		assert(!decode_block_list(
+			reinterpret_cast<const uint8_t*>(code.data()), i,
+			&decoded));
+	}
+	return code;
+}
+
+int main(int argc, char** argv) {
+	assert(round_trip({}) == string(1, '\0'));
+	assert(round_trip({0}) == string("\x01\x00", 2));
+	assert(round_trip({5, 6, 10}) == "\x03\x05\x01\x04");
+	assert(round_trip({300}) == "\x01\xac\x02");
+	assert(round_trip({UINT32_MAX - 1}) == "\x01\xfe\xff\xff\xff\x0f");
+	round_trip({0, UINT32_MAX - 1});
+
+	/* runs long enough for the eight gap path, with and without a long
+	 * gap in the middle of a word.
+	 */
+	vector<uint32_t> blocks;
+	for (uint32_t i = 0; i < 100; ++i) blocks.push_back(3 * i + 1);
+	assert(round_trip(blocks).length() == 101);
+	blocks[50] = 3 * 49 + 1 + 127;
+	for (uint32_t i = 51; i < 100; ++i) blocks[i] = blocks[50] + 200 * i;
+	round_trip(blocks);
+
+	srand(1);
+	for (int t = 0; t < 1000; ++t) {
+		blocks.clear();
+		uint32_t block = rand() % 1000;
+		size_t count = rand() % 64;
+		for (size_t i = 0; i < count; ++i) {
+			blocks.push_back(block);
+			block += 1 + (rand() % 4 ? rand() % 100 : rand() % 1000000);
+		}
+		round_trip(blocks);
+	}
+	Logger::info("test_block_list_codec passed");
+}
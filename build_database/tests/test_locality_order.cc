@@ -0,0 +1,126 @@
+/*
+ * =====================================================================================
+   Copyright 2016
+   Joel Reardon, UC Berkeley
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ * =====================================================================================
+*/
+
+#include "build_database/locality_order.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "build_database/transaction_spill.h"
+#include "ib/logger.h"
+
+using namespace btpir;
+using namespace ib;
+using namespace std;
+
+/* Transactions added round robin over the addresses come out grouped by
+ * address.
+ */
+void test_grouped() {
+	const uint32_t kAddresses = 50;
+	const uint64_t kPerAddress = 20;
+	LocalityOrder locality(kAddresses * kPerAddress, kAddresses);
+	for (uint64_t tx = 0; tx < kAddresses * kPerAddress; ++tx) {
+		locality.add(tx, tx % kAddresses);
+	}
+	vector<uint32_t> order = locality.order();
+	assert(order.size() == kAddresses * kPerAddress);
+	for (uint64_t i = 0; i < order.size(); ++i) {
+		assert(order[i] % kAddresses
+		       == order[i - i % kPerAddress] % kAddresses);
+	}
+	/* the first transaction stays first */
+	assert(order[0] == 0);
+}
+
+/* Every transaction is placed once, those without addresses too, and a
+ * transaction shared with a large address goes with the small one.
+ */
+void test_permutation() {
+	const uint64_t kTxs = 5000;
+	const uint32_t kAddresses = 400;
+	LocalityOrder locality(kTxs, kAddresses);
+	for (uint64_t tx = 0; tx < kTxs; ++tx) {
+		if (tx % 97 == 0) continue;
+		vector<uint32_t> in;
+		size_t n = 1 + rand() % 3;
+		while (in.size() < n) {
+			/* address 0 is in a third of them */
+			uint32_t a = rand() % 3 ? 1 + rand() % (kAddresses - 1)
+				: 0;
+			if (find(in.begin(), in.end(), a) == in.end()) {
+				in.push_back(a);
+			}
+		}
+		for (auto &x : in) locality.add(tx, x);
+	}
+	vector<uint32_t> order = locality.order();
+	vector<uint32_t> sorted = order;
+	sort(sorted.begin(), sorted.end());
+	for (uint64_t i = 0; i < kTxs; ++i) assert(sorted[i] == i);
+
+	/* address 0 has transactions 0, 1, 3 and 4, and address 1 has 0
+	 * and 2, so address 1 is visited first and keeps its two together
+	 */
+	LocalityOrder shared(5, 2);
+	shared.add(0, 0);
+	shared.add(0, 1);
+	shared.add(1, 0);
+	shared.add(2, 1);
+	shared.add(3, 0);
+	shared.add(4, 0);
+	order = shared.order();
+	assert(order == vector<uint32_t>({0, 2, 1, 3, 4}));
+}
+
+/* A spill file read back after reorder() has its records in the new order.
+ */
+void test_spill() {
+	vector<string> records;
+	TransactionSpill spill("test_locality_order_spill");
+	for (int i = 0; i < 300; ++i) {
+		string record(rand() % 200, 0);
+		for (auto &x : record) x = (char) rand();
+		records.push_back(record);
+		spill.append(record);
+	}
+	vector<uint32_t> order(records.size());
+	for (size_t i = 0; i < order.size(); ++i) order[i] = i;
+	shuffle(order.begin(), order.end(), mt19937(1));
+	spill.reorder(order);
+	string record;
+	size_t i = 0;
+	while (spill.next(&record)) {
+		assert(record == records[order[i]]);
+		++i;
+	}
+	assert(i == records.size());
+}
+
+int main(int argc, char** argv) {
+	test_grouped();
+	test_permutation();
+	test_spill();
+	Logger::info("test_locality_order passed");
+}
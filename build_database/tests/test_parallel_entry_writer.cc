@@ -0,0 +1,148 @@
+/*
+ * =====================================================================================
+   Copyright 2016
+   Joel Reardon, UC Berkeley
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ * =====================================================================================
+*/
+
+#include "build_database/parallel_entry_writer.h"
+
+#include <cassert>
+#include <cstdio>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "build_database/transaction_pir_database.h"
+#include "build_database/transaction_spill.h"
+#include "ib/logger.h"
+
+using namespace btpir;
+using namespace ib;
+using namespace std;
+
+/* build(): builds the main database of @entries in blocks of @blocksize
+ * bytes with @threads threads, from a spill if @spill is set, and returns the
+ * file, setting @ranges and @layout.
+ */
+string build(const vector<string>& entries, uint64_t blocksize,
+	     size_t threads, bool spill, vector<BlockRange>* ranges,
+	     PIRLayout* layout) {
+	string filename;
+	{
+		TransactionPIRDatabase db(blocksize, ".",
+					  "test_parallel_entry_writer");
+		db.set_threads(threads);
+		if (spill) {
+			TransactionSpill txs("test_parallel_spill");
+			vector<uint32_t> lengths;
+			for (auto &x : entries) {
+				txs.append(x);
+				lengths.push_back(x.length());
+			}
+			db.build(&txs, lengths, ranges);
+		} else {
+			db.build(entries, ranges);
+		}
+		*layout = db.layout();
+		filename = db.final_filename();
+	}
+	ifstream fin(filename, ios::binary);
+	assert(fin.good());
+	stringstream ss;
+	ss << fin.rdbuf();
+	remove(filename.c_str());
+	return ss.str();
+}
+
+/* check(): the parallel builds of @entries match the serial one byte for
+ * byte, and lay them out the same.
+ */
+void check(const vector<string>& entries, uint64_t blocksize) {
+	vector<BlockRange> ranges;
+	PIRLayout layout;
+	string serial = build(entries, blocksize, 1, false, &ranges, &layout);
+	assert(serial.length() == layout.cur_block * blocksize
+	       + layout.cur_distance);
+	for (size_t threads : {2, 3}) {
+		for (bool spill : {false, true}) {
+			vector<BlockRange> parallel_ranges;
+			PIRLayout parallel_layout;
+			string parallel = build(entries, blocksize, threads,
+						spill, &parallel_ranges,
+						&parallel_layout);
+			assert(parallel == serial);
+			assert(parallel_ranges.size() == ranges.size());
+			for (size_t i = 0; i < ranges.size(); ++i) {
+				assert(parallel_ranges[i].first
+				       == ranges[i].first);
+				assert(parallel_ranges[i].last
+				       == ranges[i].last);
+			}
+			assert(parallel_layout.cur_block
+			       == layout.cur_block);
+			assert(parallel_layout.cur_distance
+			       == layout.cur_distance);
+			assert(parallel_layout.total_size
+			       == layout.total_size);
+			assert(parallel_layout.blocks == layout.blocks);
+		}
+	}
+}
+
+/* random_entries(): returns about @bytes bytes of entries of up to
+ * @max_len bytes, a third of them empty or shorter than a length, so that
+ * every way an entry can meet a block boundary comes up.
+ */
+vector<string> random_entries(mt19937* rng, uint64_t bytes,
+			      uint32_t max_len) {
+	vector<string> ret;
+	uint64_t total = 0;
+	while (total < bytes) {
+		uint32_t length = (*rng)() % 3 ? (*rng)() % (max_len + 1)
+			: (*rng)() % 4;
+		string entry(length, 0);
+		for (auto &x : entry) x = (*rng)();
+		total += length + 4;
+		ret.push_back(entry);
+	}
+	return ret;
+}
+
+int main(int argc, char** argv) {
+	mt19937 rng(25);
+	/* no entries */
+	check(vector<string>(), 64);
+	/* in blocks of 12 bytes: an empty entry whose length fills block 0,
+	 * an entry that fills block 1, one that runs from block 2 into 3, and
+	 * one whose length fills block 3 and whose bytes start block 4 */
+	check({string(), string(), string(4, 'a'), string(8, 'b'),
+	       string(3, 'c')}, 12);
+	/* several windows, with blocks from too small for anything but a
+	 * length and the block header to larger than most entries */
+	for (uint64_t blocksize : {8, 12, 13, 97, 4096}) {
+		Logger::info("blocksize %", blocksize);
+		check(random_entries(&rng, 3 << 20, 3 * blocksize),
+		      blocksize);
+	}
+	/* an entry that spans several windows among small ones */
+	vector<string> entries = random_entries(&rng, 1 << 20, 300);
+	entries.insert(entries.begin() + entries.size() / 2,
+		       string(5 << 20, 'w'));
+	check(entries, 1000);
+	Logger::info("test_parallel_entry_writer passed");
+}
@@ -19,16 +19,60 @@
 
 #include "build_database/transaction_processor.h"
 
+#include <algorithm>
+#include <cassert>
 #include <cstdint>
+#include <glob.h>
 #include <iostream>
 #include <fstream>
 #include <string>
+#include <vector>
 
 using namespace btpir;
 using namespace std;
 
-int main(int argc, char** argv) {
+/* read_lines(): returns the lines of @filename. */
+vector<string> read_lines(const string& filename) {
+	ifstream fin(filename);
+	vector<string> ret;
+	string line;
+	while (getline(fin, line)) ret.push_back(line);
+	return ret;
+}
+
+/* has_database(): returns whether a database matching @pattern has a
+ * manifest of only the addresses in @listed. test_pir_database_big leaves
+ * its own address databases in the same directory.
+ */
+bool has_database(const string& pattern, const vector<string>& listed) {
+	glob_t g;
+	bool ret = false;
+	if (!glob(pattern.c_str(), 0, nullptr, &g)) {
+		for (size_t i = 0; i < g.gl_pathc; ++i) {
+			vector<string> manifest = read_lines(
+				string(g.gl_pathv[i]) + ".manifest");
+			bool ours = !manifest.empty();
+			for (auto &x : manifest) {
+				ours = ours && find(listed.begin(),
+						    listed.end(), x)
+					!= listed.end();
+			}
+			ret = ret || ours;
+		}
+	}
+	globfree(&g);
+	return ret;
+}
+
+/* write_sample(): builds the sample databases and writes their
+ * transactions to test_tx_list.
+ */
+void write_sample() {
 	TransactionProcessor db(".", "test_out.pirdb");
+	/* each address is in a seventh or more of the transactions, so all
+	 * of them need more than the square root of the blocks and the
+	 * default would skip every one */
+	db.set_skip_threshold(100000);
 	vector<set<string>> sets;
 	sets.resize(7);
 	sets[0].insert("nwetweryertyer11342ffwerwerf32rdfsd");
@@ -70,3 +114,14 @@ int main(int argc, char** argv) {
 	}
 	}
 }
+
+int main(int argc, char** argv) {
+	write_sample();
+
+	/* every address is in the address databases */
+	vector<string> listed = read_lines("test_out.pirdb_address_listing");
+	assert(listed.size() == 15);
+	assert(has_database("addr_db.fmt1_*.pir", listed));
+	assert(has_database("addr_db.fmt2_*.pir", listed));
+	assert(has_database("addr_db.fmt3_*.pir", listed));
+}
@@ -0,0 +1,104 @@
+/*
+ * =====================================================================================
+   Copyright 2016
+   Joel Reardon, UC Berkeley
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ * =====================================================================================
+*/
+
+#include "build_database/pir_delta.h"
+
+#include <cassert>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#include "ib/logger.h"
+
+using namespace btpir;
+using namespace ib;
+using namespace std;
+
+void put_file(const string& name, const string& data) {
+	ofstream fout(name, ios::binary | ios::trunc);
+	fout << data;
+	assert(fout.good());
+}
+
+string get_file(const string& name) {
+	ifstream fin(name, ios::binary);
+	stringstream ss;
+	ss << fin.rdbuf();
+	return ss.str();
+}
+
+/* Makes a delta from @old_data to @new_data, applies it to a copy of the
+ * old file and checks that the result is @new_data. Returns the number of
+ * changed blocks.
+ */
+uint64_t round_trip(const string& old_data, const string& new_data,
+		    uint64_t blocksize, bool compare) {
+	put_file("test_delta_new.pir", new_data);
+	put_file("test_delta_old.pir.prev", old_data);
+	put_file("test_delta_old.pir", old_data);
+
+	PIRDeltaSpec spec;
+	spec.old_name = "test_delta_old.pir";
+	spec.new_name = "test_delta_moved.pir";
+	spec.old_path = compare ? "./test_delta_old.pir.prev" : "";
+	spec.new_path = "./test_delta_new.pir";
+	spec.blocksize = blocksize;
+	spec.old_size = old_data.length();
+	spec.from_block = 0;
+	uint64_t changed = PIRDelta::write(spec, "test_delta.delta");
+
+	assert(PIRDelta::apply("test_delta.delta", "."));
+	assert(get_file("test_delta_moved.pir") == new_data);
+	assert(!ifstream("test_delta_old.pir").good());
+
+	/* the delta no longer applies */
+	put_file("test_delta_old.pir", old_data + "x");
+	assert(!PIRDelta::apply("test_delta.delta", "."));
+	assert(get_file("test_delta_old.pir") == old_data + "x");
+	return changed;
+}
+
+int main(int argc, char** argv) {
+	string old_data;
+	for (int i = 0; i < 1000; ++i) old_data += (char) (i * 7);
+
+	/* unchanged, and unchanged but for a byte */
+	assert(round_trip(old_data, old_data, 100, true) == 0);
+	string new_data = old_data;
+	new_data[450] ^= 1;
+	assert(round_trip(old_data, new_data, 100, true) == 1);
+
+	/* appended to: the partial last block and the new ones change */
+	new_data = old_data.substr(0, 950) + string(300, 'a');
+	assert(round_trip(old_data.substr(0, 950), new_data, 100, true) == 4);
+
+	/* shrunk */
+	assert(round_trip(old_data, old_data.substr(0, 420), 100, true) == 1);
+
+	/* without comparing, every block is sent */
+	assert(round_trip(old_data, old_data, 64, false) == 16);
+
+	remove("test_delta_new.pir");
+	remove("test_delta_old.pir");
+	remove("test_delta_old.pir.prev");
+	remove("test_delta_moved.pir");
+	remove("test_delta.delta");
+	Logger::info("test_pir_delta passed");
+}
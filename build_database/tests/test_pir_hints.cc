@@ -0,0 +1,157 @@
+/*
+ * =====================================================================================
+   Copyright 2016
+   Joel Reardon, UC Berkeley
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ * =====================================================================================
+*/
+
+#include "build_database/pir_hints.h"
+
+#include <cassert>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "ib/logger.h"
+
+using namespace btpir;
+using namespace ib;
+using namespace std;
+
+string get_file(const string& name) {
+	ifstream fin(name, ios::binary);
+	stringstream ss;
+	ss << fin.rdbuf();
+	return ss.str();
+}
+
+void test_layout() {
+	PIRHintLayout layout = PIRHintLayout::for_blocks(100);
+	assert(layout.chunk_blocks == 10 && layout.chunks == 10);
+	layout = PIRHintLayout::for_blocks(101);
+	assert(layout.chunk_blocks == 11 && layout.chunks == 10);
+	assert(layout.chunk_len(9) == 2);
+	layout = PIRHintLayout::for_blocks(1);
+	assert(layout.chunk_blocks == 1 && layout.chunks == 1);
+
+	/* every offset turns up, and none past a short chunk */
+	layout = PIRHintLayout::for_blocks(23);
+	vector<int> seen(layout.chunk_blocks);
+	vector<uint32_t> offsets(layout.chunks);
+	for (int i = 0; i < 200; ++i) {
+		layout.random_offsets(offsets.data());
+		assert(offsets.back() < layout.chunk_len(layout.chunks - 1));
+		++seen[offsets[0]];
+	}
+	for (auto &x : seen) assert(x);
+}
+
+/* check_file(): the hint @file of @hints hints over @db, in blocks of
+ * @blocksize laid out as @layout, has each hint the XOR of the blocks of
+ * its set.
+ */
+void check_file(const string& db, uint64_t blocksize, uint64_t hints,
+		const PIRHintLayout& layout, const string& file) {
+	uint64_t size = db.length();
+	PIRHintHeader header;
+	memcpy(&header, file.data(), sizeof(header));
+	assert(!memcmp(header.magic, kPIRHintMagic, sizeof(header.magic)));
+	assert(header.blocks == layout.blocks);
+	assert(header.blocksize == blocksize);
+	assert(header.hints == hints);
+	uint64_t sets_bytes = hints * layout.chunks * sizeof(uint32_t);
+	assert(file.length() == sizeof(header) + sets_bytes
+	       + hints * blocksize);
+	const uint32_t* sets = reinterpret_cast<const uint32_t*>(
+		file.data() + sizeof(header));
+	const char* parities = file.data() + sizeof(header) + sets_bytes;
+
+	for (uint64_t h = 0; h < hints; ++h) {
+		string expected(blocksize, 0);
+		for (uint64_t c = 0; c < layout.chunks; ++c) {
+			uint32_t offset = sets[h * layout.chunks + c];
+			assert(offset < layout.chunk_len(c));
+			uint64_t at = (c * layout.chunk_blocks + offset)
+				* blocksize;
+			for (uint64_t i = 0; i < blocksize && at + i < size;
+			     ++i) {
+				expected[i] ^= db[at + i];
+			}
+		}
+		assert(!memcmp(expected.data(), parities + h * blocksize,
+			       blocksize));
+	}
+}
+
+/* id_of(): returns the id in the header of the hint @file. */
+string id_of(const string& file) {
+	return file.substr(offsetof(PIRHintHeader, id),
+			   sizeof(PIRHintHeader::id));
+}
+
+/* Builds @hints hints for each of @clients clients over @size random bytes
+ * in blocks of @blocksize and checks each hint is the XOR of the blocks of
+ * its set, and that each client has sets of its own.
+ */
+void test_build(uint64_t blocksize, uint64_t size, uint64_t hints,
+		uint64_t clients, size_t threads) {
+	string db(size, 0);
+	for (auto &x : db) x = (char) rand();
+	ofstream("test_hints.pir", ios::binary) << db;
+
+	PIRHintBuilder builder("test_hints.pir", blocksize, hints, clients,
+			       threads);
+	builder.build("test_hints.pir.hints");
+	PIRHintLayout layout = builder.layout();
+	assert(layout.blocks == (size + blocksize - 1) / blocksize);
+
+	vector<string> files;
+	for (uint64_t c = 0; c < clients; ++c) {
+		string name = PIRHintBuilder::client_file(
+			"test_hints.pir.hints", c);
+		files.push_back(get_file(name));
+		check_file(db, blocksize, hints, layout, files.back());
+		remove(name.c_str());
+	}
+	/* no two clients share an id or, with enough of them, sets */
+	uint64_t sets_bytes = hints * layout.chunks * sizeof(uint32_t);
+	for (uint64_t a = 0; a < clients; ++a) {
+		for (uint64_t b = a + 1; b < clients; ++b) {
+			assert(id_of(files[a]) != id_of(files[b]));
+			if (layout.chunk_blocks == 1 || hints < 10) continue;
+			uint64_t at = sizeof(PIRHintHeader);
+			assert(files[a].substr(at, sets_bytes)
+			       != files[b].substr(at, sets_bytes));
+		}
+	}
+	remove("test_hints.pir");
+}
+
+int main(int argc, char** argv) {
+	test_layout();
+	test_build(100, 100 * 50 + 37, 30, 1, 1);
+	test_build(100, 100 * 50 + 37, 30, 1, 3);
+	test_build(100, 100 * 50 + 37, 30, 4, 3);
+	test_build(64, 64 * 1000, 200, 3, 2);
+	test_build(1, 1, 5, 2, 2);
+	/* more than one window of the file */
+	test_build(1 << 20, (70 << 20) + 5, 20, 2, 2);
+	Logger::info("test_pir_hints passed");
+}
@@ -0,0 +1,201 @@
+/*
+ * =====================================================================================
+   Copyright 2016
+   Joel Reardon, UC Berkeley
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ * =====================================================================================
+*/
+
+#include "build_database/transaction_processor.h"
+
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <glob.h>
+#include <set>
+#include <sstream>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+#include "build_database/pir_delta.h"
+#include "build_database/pir_hints.h"
+#include "ib/logger.h"
+
+using namespace btpir;
+using namespace ib;
+using namespace std;
+
+/* find_files(): returns the files that match @pattern. */
+vector<string> find_files(const string& pattern) {
+	glob_t g;
+	vector<string> ret;
+	if (!glob(pattern.c_str(), 0, nullptr, &g)) {
+		for (size_t i = 0; i < g.gl_pathc; ++i) {
+			ret.push_back(g.gl_pathv[i]);
+		}
+	}
+	globfree(&g);
+	return ret;
+}
+
+string get_file(const string& name) {
+	ifstream fin(name, ios::binary);
+	assert(fin.good());
+	stringstream ss;
+	ss << fin.rdbuf();
+	return ss.str();
+}
+
+/* served_files(): returns the databases in @directory that the deltas
+ * update, by name.
+ */
+vector<string> served_files(const string& directory) {
+	vector<string> ret;
+	for (auto &x : find_files(directory + "/*.pir")) {
+		string name = x.substr(x.rfind('/') + 1);
+		if (name.find("addr_db.fmt4") == 0) continue;
+		ret.push_back(name);
+	}
+	return ret;
+}
+
+/* apply_deltas(): applies the deltas of @epoch to the server's copy. */
+void apply_deltas(int epoch) {
+	for (auto &x : {"main", "fmt1", "fmt2", "fmt3"}) {
+		string delta = Logger::stringify("test_resume_epoch_%_%.delta",
+						 epoch, x);
+		assert(PIRDelta::apply(delta, "test_resume_server"));
+	}
+}
+
+/* build(): adds @rounds rounds of the sample transactions, from round
+ * @first on, to the databases with the prefix "test_resume", as a new
+ * build with every setting away from its default if @fresh, and
+ * otherwise appending to the last one, with the skip threshold set to
+ * @threshold if it is not 0.
+ */
+void build(int first, int rounds, bool fresh, uint64_t threshold) {
+	vector<set<string>> sets(7);
+	sets[0].insert("nwetweryertyer11342ffwerwerf32rdfsd");
+	sets[1].insert("adfgdfhmnghkjh12kuyi7ujyrJRHSEDTRHD");
+	sets[1].insert("bsgncnnvnxcfgs13HSERWTFJK34rwer346r");
+	sets[2].insert("ddhfkyioktygjf15wqdqasaf3223r23rfas");
+	sets[3].insert("edfgdfGDFGASSD168756754gergdfHDFGH4");
+	sets[4].insert("f456436eryhDFG171234dBdfgWStJUYIffg");
+	sets[5].insert("g54635467355tr18regertgerBREgreafkj");
+	sets[6].insert("hfgdhxxcvdfvwe19mmnhfgnxfNDFHBDasff");
+	sets[6].insert("iOOLOIGHJDFGSFDa5673643643634trgdfg");
+
+	TransactionProcessor db(".", "test_resume");
+	if (fresh) {
+		/* each address is in a seventh or more of the transactions,
+		 * so the default threshold would skip every one */
+		db.set_skip_threshold(100000);
+		db.set_hints(50, "test_resume_hints/h", 2);
+		db.set_hashed(true);
+		db.set_reorder(true);
+	} else {
+		db.resume_build();
+		if (threshold) db.set_skip_threshold(threshold);
+	}
+	for (int j = first; j < first + rounds; ++j) {
+		for (int i = 0; i < sets.size(); ++i) {
+			db.add_tx(sets[i], string(100 * (i + 1) + j % 13,
+						  'a' + (i + j) % 26));
+		}
+	}
+}
+
+int main(int argc, char** argv) {
+	/* a directory of its own, as it checks every address database
+	 * there */
+	mkdir("test_resume_out", 0755);
+	int ret = chdir("test_resume_out");
+	assert(!ret);
+	/* from scratch, without the databases of an earlier run */
+	for (auto &x : {"*", "test_resume_hints/*", "test_resume_server/*"}) {
+		for (auto &y : find_files(x)) remove(y.c_str());
+	}
+	mkdir("test_resume_hints", 0755);
+	mkdir("test_resume_server", 0755);
+	build(0, 200, true, 0);
+	/* the server's copy of the first build */
+	vector<string> old_files = served_files(".");
+	assert(old_files.size() == 4);
+	for (auto &x : old_files) {
+		ofstream("test_resume_server/" + x, ios::binary)
+			<< get_file(x);
+	}
+
+	build(200, 200, false, 0);
+
+	/* the threshold was kept, so every address is in the address
+	 * databases, each of which replaced the earlier one */
+	vector<string> listed;
+	ifstream fin("test_resume_address_listing");
+	string line;
+	while (getline(fin, line)) listed.push_back(line);
+	assert(listed.size() == 9);
+	vector<string> files = served_files(".");
+	assert(files.size() == 4);
+	for (int i = 1; i <= 3; ++i) {
+		assert(find_files(Logger::stringify(
+			"addr_db.fmt%_*.pir", i)).size() == 1);
+	}
+	assert(find_files("addr_db.fmt4_*.pir").size() == 1);
+	/* only the new manifests are left, though the geometry changed */
+	assert(find_files("addr_db.*.manifest").size() == 3);
+	assert(find_files("addr_db.*.manifest.bin").size() == 3);
+	for (auto &x : files) {
+		if (x.find("addr_db.") != 0) continue;
+		assert(find_files(x + ".manifest").size() == 1);
+		assert(find_files(x + ".manifest.bin").size() == 1);
+	}
+	assert(find_files("*.prev").empty());
+
+	/* the deltas bring the server's copy up to date */
+	apply_deltas(1);
+	assert(served_files("test_resume_server") == files);
+	for (auto &x : files) {
+		assert(get_file("test_resume_server/" + x) == get_file(x));
+	}
+
+	/* the hints were made again, for the appended main database */
+	vector<string> mains = find_files("test_resume_default_blocksize_*");
+	assert(mains.size() == 1);
+	for (int c = 0; c < 2; ++c) {
+		string hints = get_file(PIRHintBuilder::client_file(
+			"test_resume_hints/h", c));
+		PIRHintHeader header;
+		memcpy(&header, hints.data(), sizeof(header));
+		uint64_t size = get_file(mains[0]).length();
+		assert(header.blocks
+		       == (size + header.blocksize - 1) / header.blocksize);
+	}
+
+	/* an append that skips every address removes the address databases
+	 * and their manifests, and its deltas remove them from the server */
+	build(400, 10, false, 1);
+	assert(find_files("addr_db.*").empty());
+	apply_deltas(2);
+	files = served_files(".");
+	assert(files.size() == 1);
+	assert(served_files("test_resume_server") == files);
+	assert(get_file("test_resume_server/" + files[0])
+	       == get_file(files[0]));
+	Logger::info("test_resume_build passed");
+}
@@ -0,0 +1,92 @@
+/*
+ * =====================================================================================
+   Copyright 2016
+   Joel Reardon, UC Berkeley
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ * =====================================================================================
+*/
+
+#include "build_database/transaction_processor.h"
+
+#include <cassert>
+#include <fstream>
+#include <set>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+#include "ib/logger.h"
+
+using namespace btpir;
+using namespace ib;
+using namespace std;
+
+/* address(): returns a 35-byte address made from @name. */
+string address(const string& name) {
+	string ret = name;
+	ret.resize(35, 'x');
+	return ret;
+}
+
+/* read_lines(): returns the first word of each line of @filename. */
+vector<string> read_lines(const string& filename) {
+	ifstream fin(filename);
+	assert(fin.good());
+	vector<string> ret;
+	string line;
+	while (getline(fin, line)) ret.push_back(line.substr(0, line.find(' ')));
+	return ret;
+}
+
+int main(int argc, char** argv) {
+	/* a directory of its own, apart from the other tests' address
+	 * databases */
+	mkdir("test_skip_out", 0755);
+	int ret = chdir("test_skip_out");
+	assert(!ret);
+
+	/* one heavy address, with about a quarter of the bytes, among many
+	 * light ones and a busier one, with the threshold left at its
+	 * default */
+	string heavy = address("heavy");
+	string busy = address("busy");
+	{
+		TransactionProcessor db(".", "test_skip");
+		db.set_skip_threshold(0);
+		for (int i = 0; i < 300; ++i) {
+			db.add_tx(set<string>{address(
+				Logger::stringify("light%", i))},
+				  string(100, 'l'));
+			if (i % 30 == 0) {
+				db.add_tx(set<string>{busy}, string(40, 'b'));
+			}
+			if (i % 5 == 0) {
+				db.add_tx(set<string>{heavy}, string(200, 'h'));
+			}
+		}
+	}
+
+	/* the heavy address needs far more than the square root of the
+	 * blocks, though far fewer than all of them, so it is skipped; the
+	 * others are not */
+	vector<string> skipped = read_lines("./test_skip_skip_list");
+	assert(skipped.size() == 1);
+	assert(skipped[0] == heavy);
+	vector<string> listed = read_lines("./test_skip_address_listing");
+	assert(listed.size() == 301);
+	for (auto &x : listed) assert(x != heavy);
+	assert(find(listed.begin(), listed.end(), busy) != listed.end());
+	Logger::info("test_skip_list passed");
+}
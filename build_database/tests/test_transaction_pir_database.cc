@@ -0,0 +1,99 @@
+/*
+ * =====================================================================================
+   Copyright 2016
+   Joel Reardon, UC Berkeley
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ * =====================================================================================
+*/
+
+#include "build_database/transaction_pir_database.h"
+
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "ib/logger.h"
+
+using namespace btpir;
+using namespace ib;
+using namespace std;
+
+/* build(): builds the main database of @entries in blocks of @blocksize
+ * bytes and returns the file, setting @ranges.
+ */
+string build(const vector<string>& entries, uint64_t blocksize,
+	     vector<BlockRange>* ranges) {
+	string filename;
+	{
+		TransactionPIRDatabase db(blocksize, ".",
+					  "test_transaction_pir_database");
+		db.build(entries, ranges);
+		filename = db.final_filename();
+	}
+	ifstream fin(filename, ios::binary);
+	assert(fin.good());
+	stringstream ss;
+	ss << fin.rdbuf();
+	remove(filename.c_str());
+	return ss.str();
+}
+
+/* count(): returns the 4-byte value at @pos of @data. */
+uint32_t count(const string& data, size_t pos) {
+	assert(pos + sizeof(uint32_t) <= data.length());
+	uint32_t ret;
+	memcpy(&ret, data.data() + pos, sizeof(ret));
+	return ret;
+}
+
+int main(int argc, char** argv) {
+	/* In blocks of 12 bytes, each 4 of header and 8 of room:
+	 * block 0: header, empty entry "", the length of "aaa"
+	 * block 1: header 3, "aaa", the length of "bbbbbbb", "b"
+	 * block 2: header 6, "bbbbbb", padding
+	 * block 3: header 0, the length of "", the length of ""
+	 * block 4: header 0
+	 * The length of "aaa" fills block 0, so block 1 must start with the
+	 * 3 bytes of it still to come rather than 0, as if an entry began
+	 * there. The second empty entry's length fills block 3, and as no
+	 * bytes of it follow, block 4 starts with 0.
+	 */
+	vector<BlockRange> ranges;
+	string data = build({"", "aaa", "bbbbbbb", "", ""}, 12, &ranges);
+	assert(data.length() == 4 * 12 + 4);
+	assert(count(data, 0) == 0);
+	assert(count(data, 4) == 0);
+	assert(count(data, 8) == 3);
+	assert(count(data, 12) == 3);
+	assert(data.substr(16, 3) == "aaa");
+	assert(count(data, 19) == 7);
+	assert(data.substr(23, 1) == "b");
+	assert(count(data, 24) == 6);
+	assert(data.substr(28, 6) == "bbbbbb");
+	assert(data.substr(34, 2) == string(2, 0));
+	assert(count(data, 36) == 0);
+	assert(count(data, 40) == 0);
+	assert(count(data, 44) == 0);
+	assert(count(data, 48) == 0);
+
+	assert(ranges.size() == 5);
+	assert(ranges[1].first == 0 && ranges[1].last == 1);
+	assert(ranges[2].first == 1 && ranges[2].last == 2);
+	assert(ranges[4].first == 3 && ranges[4].last == 3);
+	Logger::info("test_transaction_pir_database passed");
+}
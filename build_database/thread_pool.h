@@ -0,0 +1,136 @@
+/*
+   Copyright 2016, Joel Reardon, UC Berkeley
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef __BTPIR__BUILD_DATABASE__THREAD_POOL__H__
+#define __BTPIR__BUILD_DATABASE__THREAD_POOL__H__
+
+#include <algorithm>
+#include <cassert>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+namespace btpir {
+
+/* ThreadPool runs tasks on a fixed set of worker threads. Tasks are started
+ * in the order they are submitted; wait() blocks until every submitted task
+ * has finished. Neither wait() nor parallel_for() may be called from inside
+ * a task.
+ */
+class ThreadPool {
+public:
+	/* Starts @threads workers, or one per hardware thread if 0. */
+	ThreadPool(size_t threads) : _pending(0), _stop(false) {
+		if (!threads) threads = thread::hardware_concurrency();
+		if (!threads) threads = 1;
+		for (size_t i = 0; i < threads; ++i) {
+			_workers.push_back(thread([this]() { work(); }));
+		}
+	}
+
+	/* Destructor finishes the submitted tasks and stops the workers. */
+	virtual ~ThreadPool() {
+		wait();
+		{
+			unique_lock<mutex> lock(_lock);
+			_stop = true;
+		}
+		_task_ready.notify_all();
+		for (auto &x : _workers) x.join();
+	}
+
+	/* Returns the number of workers. */
+	size_t size() const {
+		return _workers.size();
+	}
+
+	/* run(): submits @task to be run by a worker. */
+	void run(function<void()> task) {
+		{
+			unique_lock<mutex> lock(_lock);
+			_tasks.push_back(move(task));
+			++_pending;
+		}
+		_task_ready.notify_one();
+	}
+
+	/* wait(): blocks until all submitted tasks have finished. */
+	void wait() {
+		unique_lock<mutex> lock(_lock);
+		_all_done.wait(lock, [this]() { return !_pending; });
+	}
+
+	/* parallel_for(): splits [@begin, @end) into consecutive ranges, calls
+	 * @f(lo, hi) on each from the workers and waits for them all.
+	 */
+	void parallel_for(size_t begin, size_t end,
+			  function<void(size_t, size_t)> f) {
+		if (begin >= end) return;
+		size_t ranges = min(end - begin, 4 * size());
+		for (size_t i = 0; i < ranges; ++i) {
+			size_t lo = begin + (end - begin) * i / ranges;
+			size_t hi = begin + (end - begin) * (i + 1) / ranges;
+			run([f, lo, hi]() { f(lo, hi); });
+		}
+		wait();
+	}
+
+protected:
+	/* work(): the loop each worker runs. */
+	void work() {
+		while (true) {
+			function<void()> task;
+			{
+				unique_lock<mutex> lock(_lock);
+				_task_ready.wait(lock, [this]() {
+					return _stop || !_tasks.empty();
+				});
+				if (_tasks.empty()) return;
+				task = move(_tasks.front());
+				_tasks.pop_front();
+			}
+			task();
+			{
+				unique_lock<mutex> lock(_lock);
+				--_pending;
+				if (!_pending) _all_done.notify_all();
+			}
+		}
+	}
+
+	// Prohibit copy
+	ThreadPool(const ThreadPool& copy) {}
+
+	vector<thread> _workers;
+	deque<function<void()>> _tasks;
+
+	/* tasks submitted but not yet finished */
+	size_t _pending;
+	bool _stop;
+
+	mutex _lock;
+	condition_variable _task_ready;
+	condition_variable _all_done;
+};
+
+}  // namespace btpir
+
+#endif  // __BTPIR__BUILD_DATABASE__THREAD_POOL__H__
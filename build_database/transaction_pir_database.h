@@ -22,20 +22,34 @@
 #include <vector>
 
 #include "ib/logger.h"
+#include "build_database/parallel_entry_writer.h"
 #include "build_database/pir_database_base.h"
+#include "build_database/transaction_spill.h"
 
 using namespace std;
 using namespace ib;
 
 namespace btpir {
 
+/* PIRLayout is how far a TransactionPIRDatabase got, so that a later build
+ * can append to it.
+ */
+struct PIRLayout {
+	uint64_t blocksize;
+	uint64_t cur_block;
+	uint64_t cur_distance;
+	uint64_t total_size;
+	uint64_t blocks;
+};
+
 class TransactionPIRDatabase : public PIRDatabaseBase {
 public:
 	TransactionPIRDatabase(uint64_t blocksize,
 			       const string& directory,
 			       const string& filename)
 		: PIRDatabaseBase(directory, filename),
-		  _len_len(4) {
+		  _len_len(4), _appending(false), _threads(1),
+		  _offsets(nullptr) {
 		_pir_blocksize_bytes = blocksize;
 		_blocksize_useable = _pir_blocksize_bytes
 			- header_len() - footer_len();
@@ -49,26 +63,201 @@ public:
 		assert(0);
 	}
 
+	/* blocks(): returns the number of PIR blocks written, including the
+	 * last, partly filled, one.
+	 */
+	virtual uint64_t blocks() const {
+		return _cur_block + 1;
+	}
+
+	/* layout(): returns how far the database got. */
+	virtual PIRLayout layout() const {
+		return PIRLayout{_pir_blocksize_bytes, _cur_block,
+				 _cur_distance, _total_size, _blocks};
+	}
+
+	/* append_to(): makes the next build() continue the database that
+	 * ended at @layout instead of starting a new one. Only the last,
+	 * partly filled, block changes and new blocks follow it. The
+	 * @pos_to_blocks given to build() must hold the earlier entries.
+	 */
+	virtual void append_to(const PIRLayout& layout) {
+		assert(layout.blocksize == _pir_blocksize_bytes);
+		_cur_block = layout.cur_block;
+		_cur_distance = layout.cur_distance;
+		_total_size = layout.total_size;
+		_blocks = layout.blocks;
+		_appending = true;
+	}
+
+	/* set_threads(): makes build() lay out a new database that is not
+	 * sharded first, and then write it with ParallelEntryWriter using
+	 * @threads threads, or one per hardware thread if 0. The file is the
+	 * same. 1, the default, writes each entry as it is laid out.
+	 */
+	virtual void set_threads(size_t threads) {
+		_threads = threads;
+	}
+
 	virtual void build(const vector<string>& entries,
-			   map<uint64_t, set<uint32_t>> *pos_to_blocks) {
-		string tmp_file = Logger::stringify("%_%.pir",
- 	                                            _filename,
-					            _pir_blocksize_bytes);
-		_fout.reset(new ofstream(tmp_file));
+			   vector<BlockRange> *pos_to_blocks) {
+		if (parallel()) {
+			vector<uint32_t> lengths;
+			lengths.reserve(entries.size());
+			for (auto &x : entries) lengths.push_back(x.length());
+			vector<uint64_t> offsets = lay_out(lengths,
+							   pos_to_blocks);
+			ParallelEntryWriter writer(_pir_blocksize_bytes,
+						   lengths, offsets, end());
+			writer.write(tmp_filename(), entries, _threads);
+			return;
+		}
+		open_for_write();
+		process_entries(entries, pos_to_blocks);
+	}
+
+	/* build(): as above, but reads the entries sequentially from @spill
+	 * so that they never need to be held in memory together.
+	 */
+	virtual void build(TransactionSpill* spill,
+			   vector<BlockRange> *pos_to_blocks) {
+		assert(spill);
+		open_for_write();
+
+		string entry;
+		uint64_t pos = pos_to_blocks->size();
+		spill->rewind();
+		while (spill->next(&entry)) {
+			process_entry(entry, pos, pos_to_blocks);
+			++pos;
+		}
+		assert(pos == pos_to_blocks->size());
+		assert(_fout->good());
+	}
+
+	/* build(): as above, with the @lengths of all the entries, the earlier
+	 * ones held by @pos_to_blocks first, so that it can write in parallel
+	 * (see set_threads()).
+	 */
+	virtual void build(TransactionSpill* spill,
+			   const vector<uint32_t>& lengths,
+			   vector<BlockRange> *pos_to_blocks) {
+		if (!parallel()) {
+			build(spill, pos_to_blocks);
+			return;
+		}
+		assert(spill);
+		assert(lengths.size() == spill->records());
+		vector<uint64_t> offsets = lay_out(lengths, pos_to_blocks);
+		ParallelEntryWriter writer(_pir_blocksize_bytes, lengths,
+					   offsets, end());
+		writer.write(tmp_filename(), spill, _threads);
+	}
+
+	/* simulate(): a dry run of build() for entries of the given
+	 * @lengths. It fills @pos_to_blocks exactly as build() would, and
+	 * blocks() is then the block count, but nothing is written.
+	 */
+	virtual void simulate(const vector<uint32_t>& lengths,
+			      vector<BlockRange> *pos_to_blocks) {
+		start_simulation();
+		simulate(lengths, 0, lengths.size(), pos_to_blocks);
+	}
+
+	/* start_simulation(): begins a dry run that is fed in pieces. */
+	virtual void start_simulation() {
+		_dry_run = true;
+		open_for_write();
+	}
+
+	/* simulate(): continues a dry run with the entries at positions
+	 * [@begin, @end) of @lengths. Each call must begin where the last
+	 * ended.
+	 */
+	virtual void simulate(const vector<uint32_t>& lengths, uint64_t begin,
+			      uint64_t end, vector<BlockRange> *pos_to_blocks) {
+		assert(_dry_run);
+		assert(end <= lengths.size());
+		for (uint64_t pos = begin; pos < end; ++pos) {
+			process_length(lengths[pos], pos, pos_to_blocks);
+		}
+	}
+
+protected:
+	/* parallel(): returns true if build() lays out the database first and
+	 * then writes it in parallel.
+	 */
+	virtual bool parallel() const {
+		return _threads != 1 && !_appending && !_shard_blocks
+			&& !_dry_run;
+	}
+
+	/* lay_out(): lays out entries of @lengths as build() would, filling
+	 * @pos_to_blocks, without writing them, and returns the file offset of
+	 * each one's length. The database is then as if they were written, so
+	 * the destructor names the file ParallelEntryWriter writes.
+	 */
+	vector<uint64_t> lay_out(const vector<uint32_t>& lengths,
+				 vector<BlockRange> *pos_to_blocks) {
+		assert(pos_to_blocks->empty());
+		vector<uint64_t> offsets;
+		offsets.reserve(lengths.size());
+		_dry_run = true;
+		open_for_write();
+		_dry_run = false;
+		_offsets = &offsets;
+		for (uint64_t pos = 0; pos < lengths.size(); ++pos) {
+			process_length(lengths[pos], pos, pos_to_blocks);
+		}
+		_offsets = nullptr;
+		return offsets;
+	}
+
+	/* end(): returns the bytes in the file as laid out so far. */
+	uint64_t end() const {
+		return (uint64_t) _cur_block * _pir_blocksize_bytes
+			+ _cur_distance;
+	}
+
+	/* tmp_filename(): returns the name of the file while it is written. */
+	string tmp_filename() const {
+		return Logger::stringify("%_%.pir", _filename,
+					 _pir_blocksize_bytes);
+	}
+
+	virtual void open_for_write() {
+		if (_appending) {
+			reopen();
+			return;
+		}
+		_fout.reset(new_writer());
 
 		write_zeros(header_len());
 		_cur_distance = header_len();
 		_total_size = header_len();
 		_cur_block = 0;
-
-		process_entries(entries, pos_to_blocks);
 	}
 
-protected:
+	/* reopen(): opens the file of the database being appended to at its
+	 * end. It is renamed back to the name used while writing, and the
+	 * destructor names it for its new block count.
+	 */
+	virtual void reopen() {
+		string old_filename = final_filename();
+		if (rename(old_filename.c_str(), tmp_filename().c_str())) {
+			Logger::error("(btpir) cannot append to %",
+				      old_filename);
+			assert(0);
+		}
+		/* _total_size leaves out the padding before entries, so the end
+		 * comes from the position in the last block */
+		_fout.reset(new BlockWriter(tmp_filename(),
+					    _pir_blocksize_bytes, end()));
+	}
 
 	/* process entries for this database needs only the data chunks
-	 * themselves (entries). It also takes a map from the position in the
-	 * entries to the set of blocks corresponding to the range in the PIR
+	 * themselves (entries). It also fills a vector, indexed by the
+	 * position in the entries, with the range of blocks in the PIR
 	 * database where that entry is stored. This is used to build a database
 	 * to look this up.
 	 */
@@ -76,27 +265,62 @@ protected:
 #pragma clang diagnostic ignored "-Woverloaded-virtual"
 	virtual void process_entries(
 			const vector<string>& entries,
-			map<uint64_t, set<uint32_t>> *pos_to_blocks) {
-		size_t pos = 0;
+			vector<BlockRange> *pos_to_blocks) {
+		size_t pos = pos_to_blocks->size();
 		for (const auto &x : entries) {
-			start_tx(x, x.length());
-			uint32_t length = x.length();
-			write(reinterpret_cast<const char*>(
-				&length), sizeof(uint32_t));
-			write(x);
-			(*pos_to_blocks)[pos] = _blocks_used;
-			end_tx(x, x.length());
+			process_entry(x, pos, pos_to_blocks);
 			++pos;
 		}
 		assert(_fout->good());
 	}
 #pragma clang diagnostic pop
 
+	/* process_entry(): writes the entry @x, which is at position @pos
+	 * in the sequence of entries, prefixed by its length.
+	 */
+	virtual void process_entry(const string& x, uint64_t pos,
+				   vector<BlockRange> *pos_to_blocks) {
+		start_tx(x, x.length());
+		uint32_t length = x.length();
+		write(reinterpret_cast<const char*>(
+			&length), sizeof(uint32_t));
+		continue_entry(length);
+		write(x);
+		assert(pos == pos_to_blocks->size());
+		pos_to_blocks->push_back(_blocks_used);
+		end_tx(x, x.length());
+	}
+
+	/* process_length(): lays out an entry of @length bytes at position
+	 * @pos like process_entry(), but without its contents.
+	 */
+	virtual void process_length(uint32_t length, uint64_t pos,
+				    vector<BlockRange> *pos_to_blocks) {
+		start_tx(_cur_addr, length);
+		write(reinterpret_cast<const char*>(
+			&length), sizeof(uint32_t));
+		continue_entry(length);
+		write(nullptr, length);
+		assert(pos == pos_to_blocks->size());
+		pos_to_blocks->push_back(_blocks_used);
+		end_tx(_cur_addr, length);
+	}
+
+	/* continue_entry(): if the length of an entry has just filled the
+	 * block, starts the next one with the @length bytes of the entry
+	 * still to come as its count. Otherwise writing the entry would
+	 * start it with a count of 0, as if an entry began there.
+	 */
+	void continue_entry(uint32_t length) {
+		if (length && !get_safe_len()) new_block(length);
+	}
+
 	virtual void start_tx(const string& address, uint32_t length) {
 		if (get_safe_len() < header_len()) {
 			write_zeros(get_safe_len());
 			new_block(0);
 		}
+		if (_offsets) _offsets->push_back(end());
 
 		_blocks_used.clear();
 	}
@@ -111,6 +335,16 @@ protected:
 	}
 
 	int _len_len;
+
+	/* if set, open_for_write() continues an existing database */
+	bool _appending;
+
+	/* threads to write a new database with; see set_threads() */
+	size_t _threads;
+
+	/* if set, lay_out() is running and the offset of each entry's length
+	 * is added to it */
+	vector<uint64_t>* _offsets;
 };
 
 }  // namespace bitcoin_pir
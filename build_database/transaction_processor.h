@@ -18,22 +18,41 @@
 #ifndef __BTPIR__BUILD_DATABASE__TRANSACTION_PROCESSOR__H__
 #define __BTPIR__BUILD_DATABASE__TRANSACTION_PROCESSOR__H__
 
+#include <algorithm>
 #include <cassert>
+#include <climits>
 #include <cmath>
 #include <cstdint>
 #include <cstdio>
+#include <cstdlib>
 #include <cstring>
 #include <iostream>
 #include <fstream>
+#include <glob.h>
 #include <map>
 #include <set>
 #include <string>
+#include <string_view>
+#include <unistd.h>
+#include <utility>
 #include <vector>
 
 #include "ib/logger.h"
+#include "build_database/address_bitmap.h"
+#include "build_database/address_table.h"
 #include "build_database/auto_deliminated_pir_database.h"
+#include "build_database/block_list_codec.h"
+#include "build_database/build_state.h"
 #include "build_database/deliminated_pir_database.h"
+#include "build_database/delta_deliminated_pir_database.h"
+#include "build_database/hashed_pir_database.h"
+#include "build_database/locality_order.h"
+#include "build_database/pir_cost_model.h"
+#include "build_database/pir_delta.h"
+#include "build_database/pir_hints.h"
+#include "build_database/thread_pool.h"
 #include "build_database/transaction_pir_database.h"
+#include "build_database/transaction_spill.h"
 
 using namespace ib;
 using namespace std;
@@ -50,7 +69,12 @@ public:
 		: _directory(directory), _filename(filename),
 		  _db_size(0), _pos(0), _pir_blocks(0), _pir_blocksize(0),
 		  _tx_data_sum(0), _shortaddr_len(20),
-		  _longaddr_len(35), _len_len(4), _pirdb_pos(0) {}
+		  _longaddr_len(35), _len_len(4), _pirdb_pos(0),
+		  _addresses(_shortaddr_len), _threads(0),
+		  _skip_threshold(0), _tune(false), _appending(false),
+		  _resumed_pos(0), _resumed_tx_data_sum(0), _epoch(0),
+		  _db_files(kDatabases), _shards(0), _hints(0),
+		  _hint_clients(0), _hashed(false), _reorder(false) {}
 
 	TransactionProcessor() : TransactionProcessor("", "") {}
 
@@ -59,11 +83,18 @@ public:
 	 * nothing is written.
 	 */
 	virtual ~TransactionProcessor() {
-		if (!_filename.empty()) {
+		if (!_filename.empty() && !_geometry.empty()) {
+			output_geometry();
+		} else if (!_filename.empty()) {
 			Logger::info("(txproc) Sum of TX data %", _tx_data_sum);
 			output_db();
 
 			// create an empty file that stores raw transaction size
+			if (_appending) {
+				remove(Logger::stringify(
+					"%/%_raw_tx_size_%", _directory,
+					_filename, _resumed_tx_data_sum).c_str());
+			}
 			ofstream(Logger::stringify("%/%_raw_tx_size_%",
 						   _directory, _filename,
 						   _tx_data_sum));
@@ -81,28 +112,15 @@ public:
 	 */
 	void add_tx(const set<string>& addresses,
 		    const string& transaction_data) {
-		static int max_addr_len = 0;
-		_tx_data_sum += transaction_data.length();
-		_txs.push_back(transaction_data);
-		/* For each address that will read this transaction,
-		   add the transaction length to its counter and the current
-		   position in the sequence of data to build the blocks-to-get
-		   database.
-		 */
-		for (auto &x : addresses) {
-			add_address(x);
-			_addr_to_tx_len[x] += transaction_data.length();
-			_addr_to_positions[get_short_address(x)].insert(_pirdb_pos);
+		store_tx(addresses, transaction_data);
+	}
 
-			/* if max_addr_len is unset, set it to the first
-			 * address. Otherwise check that they are equal.
-			 */
-			if (max_addr_len == 0) max_addr_len = x.length();
-			assert(max_addr_len == x.length());
-			assert(x.length());
-		}
-		_pos += _len_len + transaction_data.length();
-		++_pirdb_pos;
+	/* add_tx(): as above, but takes views of the addresses and data, e.g.,
+	 * into a memory-mapped input file. The addresses must be distinct.
+	 */
+	void add_tx(const vector<string_view>& addresses,
+		    string_view transaction_data) {
+		store_tx(addresses, transaction_data);
 	}
 
 	/* output_addr_len outputs data we can use in analysis of PIR
@@ -116,9 +134,9 @@ public:
 			      _directory, _filename);
 		ofstream fout(filename);
 		assert(fout.good());
-		for (auto &x : _addr_to_tx_len) {
-			fout << x.first << " " << x.second
-			     << " " << _addr_to_blocks[x.first].size()
+		for (auto &x : _sorted) {
+			fout << _addresses.long_address(x) << " "
+			     << _addr_to_tx_len[x] << " " << blocks_to_get(x)
 			     << endl;
 			assert(fout.good());
 		}
@@ -128,6 +146,197 @@ public:
 		_pir_blocksize = pir_blocksize;
 	}
 
+	/* set_threads(): sets the number of threads used to output the
+	 * databases. 0, the default, uses one per hardware thread.
+	 */
+	virtual void set_threads(size_t threads) {
+		_threads = threads;
+	}
+
+	/* set_skip_threshold(): addresses with more than @threshold blocks
+	 * to get are left out of the address databases. 0, the default, uses
+	 * the square root of the main database's blocks (see
+	 * make_skip_list()).
+	 */
+	virtual void set_skip_threshold(uint64_t threshold) {
+		_skip_threshold = threshold;
+	}
+
+	/* set_shards(): writes the main database as @shards files, split on
+	 * block boundaries, so that each server can hold and scan a part of
+	 * it. The blocks keep their numbers in the whole database, so the
+	 * address databases are the same as for one file. The shards are
+	 * listed in a file with the main database's name and ".shards"
+	 * attached. 0 or 1 writes one file. A sharded build cannot be
+	 * appended to.
+	 */
+	virtual void set_shards(size_t shards) {
+		assert(!_appending);
+		_shards = shards;
+	}
+
+	/* set_hints(): after the main database is written, makes @hints
+	 * offline/online PIR hints for it (see pir_hints.h) for each of
+	 * @clients clients, each in its own file named from @hint_file (see
+	 * PIRHintBuilder::client_file()). Each hint answers one query, and
+	 * about 4 sqrt(blocks) of them cover all but 2% of the blocks. 0, the
+	 * default, makes none. Hints are not made for a sharded database.
+	 *
+	 * A hint file holds the sets in the clear, and a server that has it
+	 * can tell from a hinted query which block was fetched. It is for
+	 * its client only and must never reach a server that answers them, so
+	 * @hint_file may not be in the output directory, whose files are
+	 * served. Nor may it be shared between clients: two clients using the
+	 * same hint give away both the blocks they fetch with it.
+	 */
+	virtual void set_hints(uint64_t hints, const string& hint_file,
+			       uint64_t clients) {
+		assert(!hints || !hint_file.empty());
+		assert(!hints || clients);
+		_hints = hints;
+		_hint_file = hint_file;
+		_hint_clients = clients;
+	}
+
+	/* set_hashed(): also writes the hashed address database
+	 * (hashed_pir_database.h), "addr_db.fmt4", from the format 3 entries,
+	 * if @hashed. It is rebuilt whole each time and is not in the deltas.
+	 */
+	virtual void set_hashed(bool hashed) {
+		_hashed = hashed;
+	}
+
+	/* set_reorder(): if @reorder, the transactions are put in the order
+	 * of LocalityOrder (locality_order.h) before the main database is
+	 * built, rather than the order they were added in, so that each
+	 * address's transactions take fewer blocks. When appending, only the
+	 * new transactions are reordered, among themselves.
+	 */
+	virtual void set_reorder(bool reorder) {
+		_reorder = reorder;
+	}
+
+	/* tune_blocksizes(): picks the blocksize of the main database and of
+	 * the format 2 and 3 address databases as the one, among candidates
+	 * around the default, with the least cost per lookup under @model for
+	 * the actual transactions and addresses. A main blocksize set with
+	 * set_main_pir_blocksize() is kept. Every candidate's cost is written
+	 * to a file with the prefix and "_blocksize_costs".
+	 */
+	virtual void tune_blocksizes(const PIRCostModel& model) {
+		_tune = true;
+		_cost_model = model;
+	}
+
+	/* simulate_blocksizes(): makes this a dry run. Instead of writing the
+	 * databases, the main database is laid out with each of @blocksizes
+	 * and the geometry of each is written to a file with the prefix and
+	 * "_geometry". The transaction data is not kept. Must be called before
+	 * the first add_tx().
+	 */
+	virtual void simulate_blocksizes(const vector<uint64_t>& blocksizes) {
+		assert(!_pirdb_pos);
+		for (auto &x : blocksizes) assert(x > 2 * _len_len);
+		_geometry = blocksizes;
+	}
+
+	/* resume_build(): makes this build append to the one that wrote the
+	 * databases with the same directory and filename prefix, using the
+	 * state it left in the file with the prefix and "_state". The new
+	 * transactions follow the old ones in the main database, of which
+	 * only the last block is rewritten, and the address databases are
+	 * made again for all the addresses. Must be called before the first
+	 * add_tx().
+	 *
+	 * The settings of the earlier build are kept: the skip threshold,
+	 * the hints, the hashed database and reordering. Setting them after
+	 * this call changes them for this build and the ones after it.
+	 *
+	 * Each append is an epoch, and for every database a delta file that
+	 * updates the previous version in place is written (see
+	 * output_deltas()).
+	 */
+	virtual void resume_build() {
+		assert(!_pirdb_pos);
+		assert(_geometry.empty());
+		string name = Logger::stringify("%/%_state", _directory,
+						_filename);
+		Logger::info("(txproc) resume from: %", name);
+		assert(_shards <= 1);
+		StateReader state(name);
+		state.read(&_layout);
+		state.read(&_pos);
+		state.read(&_tx_data_sum);
+		state.read(&_pirdb_pos);
+
+		uint64_t addresses;
+		state.read(&addresses);
+		string address;
+		for (uint64_t i = 0; i < addresses; ++i) {
+			state.read(&address);
+			uint32_t id = _addresses.intern(address);
+			assert(id == i);
+		}
+		state.read(&_addr_to_tx_len);
+		assert(_addr_to_tx_len.size() == addresses);
+		state.read(&_addr_positions);
+		state.read(&_pos_to_blocks);
+		state.read(&_tx_lens);
+		state.read(&_epoch);
+		for (auto &x : _db_files) {
+			state.read(&x.name);
+			state.read(&x.blocksize);
+			state.read(&x.size);
+		}
+		state.read(&_skip_threshold);
+		state.read(&_shards);
+		state.read(&_hints);
+		state.read(&_hint_file);
+		state.read(&_hint_clients);
+		state.read(&_hashed);
+		state.read(&_reorder);
+		if (_shards > 1) {
+			Logger::error("(txproc) % is of a database in % shards; "
+				      "sharded databases cannot be appended to",
+				      name, _shards);
+			assert(0);
+		}
+		assert(_pos_to_blocks.size() == _pirdb_pos);
+		assert(_tx_lens.size() == _pirdb_pos);
+		string main_db = _directory + "/"
+			+ _db_files[kMainDatabase].name;
+		if (access(main_db.c_str(), F_OK)) {
+			Logger::error("(txproc) cannot find %; sharded "
+				      "databases cannot be appended to",
+				      main_db);
+			assert(0);
+		}
+
+		_pir_blocksize = _layout.blocksize;
+		_appending = true;
+		_resumed_pos = _pirdb_pos;
+		_resumed_tx_data_sum = _tx_data_sum;
+		++_epoch;
+		Logger::info("(txproc) resumed % transactions, % addresses, "
+			     "% blocks for epoch %", _pirdb_pos, addresses,
+			     _layout.cur_block + 1, _epoch);
+		Logger::info("(txproc) resumed skip threshold % hints % for % "
+			     "clients hashed % reorder %", _skip_threshold,
+			     _hints, _hint_clients, _hashed, _reorder);
+	}
+
+	/* spill_to_disk(): streams the raw transactions to a scratch file in
+	 * the output directory instead of keeping them in memory. Memory use
+	 * then depends on the addresses rather than the transaction bytes.
+	 * Must be called before the first add_tx().
+	 */
+	virtual void spill_to_disk() {
+		assert(!_pirdb_pos);
+		_spill.reset(new TransactionSpill(
+			Logger::stringify("%/%_tx_spill",
+					  _directory, _filename)));
+	}
+
 	/* output_db(): performs the work of outputting the PIR database.
 	 * Assumes that no more transactions will be reported to the class. It
 	 * creates both the main and the address database.
@@ -139,6 +348,11 @@ public:
 		string filename = Logger::stringify("%/%_default_blocksize",
 						    _directory, _filename);
 
+		if (_reorder) reorder_transactions();
+		if (_tune && !_pir_blocksize && !_appending) {
+			_pir_blocksize = tune_main_blocksize();
+		}
+
 		uint64_t db_size_bit = 8 * _pos;
 		_db_size = _pos;
 		_pir_blocks = 0;
@@ -164,76 +378,690 @@ public:
 		Logger::info("PIR block (MiB): %", _pir_blocksize >> 20);
 		Logger::info("PIR blocks     : %", _pir_blocks);
 		assert(_pir_blocksize > 4);
+		if (_reorder) trace_reorder();
 
+		if (!_appending) _pos_to_blocks.clear();
+		vector<DatabaseFile> old_files = _db_files;
+		PIRLayout old_layout = _layout;
+		_pos_to_blocks.reserve(_pirdb_pos);
 		{
 		TransactionPIRDatabase short_db(_pir_blocksize,
 						_directory,
 						Logger::stringify("%_%.pir",
 								  filename,
 								  _pir_blocksize));
-		short_db.build(_txs, &_pos_to_blocks);
+		if (_appending) short_db.append_to(_layout);
+		if (_shards > 1) {
+			short_db.set_shard_blocks(shard_blocks());
+		}
+		short_db.set_threads(_threads);
+		if (_spill) {
+			short_db.build(_spill.get(), _tx_lens, &_pos_to_blocks);
+		} else {
+			short_db.build(_txs, &_pos_to_blocks);
 		}
+		/* the padding between transactions can take a few more
+		 * blocks than estimated */
+		_pir_blocks = short_db.blocks();
+		Logger::info("PIR blocks used: %", _pir_blocks);
+		_layout = short_db.layout();
+		note_file(kMainDatabase, short_db, (uint64_t) _layout.cur_block
+			  * _layout.blocksize + _layout.cur_distance);
+		}
+		_spill.reset(nullptr);
+		if (_hints) output_hints();
 
-		make_skip_list();
 		remap_addresses();
+		_sorted = _addresses.sorted_by_short();
 		trace();
-		output_address_formats();
-		output_address_manifest();
+
+		if (_appending) stash_address_databases(old_files);
+		for (size_t i = kMainDatabase + 1; i < kDatabases; ++i) {
+			_db_files[i] = DatabaseFile();
+		}
+		/* the listing and skip list only read what is built by now, so
+		 * they are queued first and written alongside the formats */
+		ThreadPool pool(_threads);
+		pool.run([this]() { output_address_manifest(); });
+		pool.run([this]() { output_skip_list(); });
+		output_address_formats(&pool);
+		pool.wait();
+		if (_tune) output_cost_curve();
+		if (_appending) {
+			trace_touched();
+			output_deltas(old_files, old_layout);
+		}
+		save_state();
 	}
 
 protected:
-	/* make_skip_list() creates a list of bad addresses for PIR. This means
-	 * that they consume so many blocks that having them in the primary
-	 * database unnessessary because the owner of these addresses will not
-	 * benefit from having PIR---they will need to transmit more information
-	 * than just keeping a block synced and they are unlikely to use small
-	 * clients.
+	/* A database file as the last build left it. */
+	struct DatabaseFile {
+		DatabaseFile() : blocksize(0), size(0) {}
+
+		/* the file name within _directory */
+		string name;
+		uint64_t blocksize;
+		uint64_t size;
+	};
+
+	/* make_skip_list() marks the bad addresses for PIR, given @counts,
+	 * the number of blocks each address id has to get. These consume so
+	 * many blocks that having them in the address databases is
+	 * unnessessary, because the owner of these addresses will not benefit
+	 * from having PIR---they will need to transmit more information than
+	 * just keeping a block synced and they are unlikely to use small
+	 * clients. Leaving them out also keeps their long entries from
+	 * inflating the address databases for everyone else.
+	 *
+	 * Unless a threshold was set, an address is skipped once it has to
+	 * get more than the square root of the main database's blocks. Each
+	 * block fetched costs a query over the whole database, so past that
+	 * an address pays for as many queries as the database has rows in the
+	 * square layout. Only the heaviest addresses, such as exchanges and
+	 * mining pools, go over it.
+	 */
+	virtual void make_skip_list(const vector<uint64_t>& counts) {
+		uint64_t threshold = skip_threshold(_pir_blocks);
+		Logger::info("(txproc) skip addresses with over % blocks",
+			     threshold);
+
+		_skip.assign(counts.size(), false);
+		_skipped.clear();
+		for (uint32_t i = 0; i < counts.size(); ++i) {
+			if (counts[i] <= threshold) continue;
+			_skip[i] = true;
+			_skipped.push_back(make_pair(counts[i], i));
+		}
+		sort(_skipped.rbegin(), _skipped.rend());
+		Logger::info("(txproc) skipped % addresses", _skipped.size());
+	}
+
+	/* reorder_transactions(): puts the transactions added in this build
+	 * in the order LocalityOrder gives. Their positions are renumbered
+	 * everywhere, so the rest of the build sees them as if they had been
+	 * added in that order. The order is kept for trace_reorder().
+	 */
+	void reorder_transactions() {
+		uint64_t first = _resumed_pos;
+		uint64_t n = _pirdb_pos - first;
+		LocalityOrder locality(n, _addresses.size());
+		size_t tail = _addr_positions.size();
+		for (size_t i = 0; i < _addr_positions.size(); ++i) {
+			const AddressPosition& x = _addr_positions[i];
+			if (x.position < first) continue;
+			if (tail == _addr_positions.size()) tail = i;
+			locality.add(x.position - first, x.address);
+		}
+		_reorder_order = locality.order();
+
+		vector<uint32_t> rank(n);
+		for (uint64_t i = 0; i < n; ++i) rank[_reorder_order[i]] = i;
+		for (size_t i = tail; i < _addr_positions.size(); ++i) {
+			uint32_t& pos = _addr_positions[i].position;
+			pos = first + rank[pos - first];
+		}
+		stable_sort(_addr_positions.begin() + tail,
+			    _addr_positions.end(),
+			    [](const AddressPosition& a,
+			       const AddressPosition& b) {
+				    return a.position < b.position;
+			    });
+
+		vector<uint32_t> lens(n);
+		for (uint64_t i = 0; i < n; ++i) {
+			lens[i] = _tx_lens[first + _reorder_order[i]];
+		}
+		copy(lens.begin(), lens.end(), _tx_lens.begin() + first);
+		if (_spill) {
+			_spill->reorder(_reorder_order);
+		} else {
+			assert(_txs.size() == n);
+			vector<string> txs(n);
+			for (uint64_t i = 0; i < n; ++i) {
+				txs[i].swap(_txs[_reorder_order[i]]);
+			}
+			_txs.swap(txs);
+		}
+		Logger::info("(txproc) reordered % transactions for locality",
+			     n);
+	}
+
+	/* trace_reorder(): outputs how many blocks the addresses have to get
+	 * with the transactions in the order they were added and in the order
+	 * reorder_transactions() put them in, for the main blocksize.
+	 */
+	void trace_reorder() {
+		uint64_t first = _resumed_pos;
+		uint64_t n = _reorder_order.size();
+		vector<uint32_t> lens = _tx_lens;
+		vector<uint32_t> rank(n);
+		for (uint64_t i = 0; i < n; ++i) {
+			lens[first + _reorder_order[i]] = _tx_lens[first + i];
+			rank[_reorder_order[i]] = i;
+		}
+		vector<BlockRange> added;
+		TransactionPIRDatabase before(_pir_blocksize, _directory,
+					      _filename);
+		before.simulate(lens, &added);
+
+		/* count_blocks() for the added order: the transactions are
+		 * visited in that order, so that each address meets its
+		 * blocks in order, through the entries of their new positions
+		 */
+		vector<uint64_t> start(_pirdb_pos + 1, 0);
+		for (auto &x : _addr_positions) ++start[x.position + 1];
+		for (uint64_t i = 0; i < _pirdb_pos; ++i) {
+			start[i + 1] += start[i];
+		}
+		vector<uint64_t> counts(_addresses.size(), 0);
+		vector<uint32_t> next(_addresses.size(), 0);
+		auto count = [&](uint64_t pos, const BlockRange& range) {
+			for (uint64_t i = start[pos]; i < start[pos + 1]; ++i) {
+				uint32_t a = _addr_positions[i].address;
+				uint64_t from = max((uint64_t) range.first,
+						    (uint64_t) next[a]);
+				if (range.last < from) continue;
+				counts[a] += range.last - from + 1;
+				next[a] = range.last + 1;
+			}
+		};
+		for (uint64_t i = 0; i < first; ++i) count(i, added[i]);
+		for (uint64_t i = 0; i < n; ++i) {
+			count(first + rank[i], added[first + i]);
+		}
+		trace_block_counts("added order    ", counts);
+
+		vector<BlockRange> ranges;
+		TransactionPIRDatabase after(_pir_blocksize, _directory,
+					     _filename);
+		after.simulate(_tx_lens, &ranges);
+		count_blocks(ranges, &counts);
+		trace_block_counts("locality order ", counts);
+	}
+
+	/* trace_block_counts(): outputs the distribution of @counts, the
+	 * blocks each address has to get, over the addresses with any.
+	 */
+	void trace_block_counts(const string& name,
+				const vector<uint64_t>& counts) const {
+		vector<uint64_t> sorted;
+		uint64_t total = 0;
+		for (auto &x : counts) {
+			if (!x) continue;
+			sorted.push_back(x);
+			total += x;
+		}
+		if (sorted.empty()) return;
+		sort(sorted.begin(), sorted.end());
+		auto at = [&sorted](double q) {
+			return sorted[(size_t) (q * (sorted.size() - 1))];
+		};
+		Logger::info("(txproc) % blocks per address: mean % median % "
+			     "p90 % p99 % max % total %", name,
+			     (double) total / sorted.size(), at(0.5), at(0.9),
+			     at(0.99), sorted.back(), total);
+	}
+
+	/* shard_blocks(): returns the blocks in each shard of the main
+	 * database, found by laying it out without writing it.
+	 */
+	uint64_t shard_blocks() {
+		assert(_shards > 1);
+		assert(_pos_to_blocks.empty());
+		TransactionPIRDatabase sim(_pir_blocksize, _directory,
+					   _filename);
+		sim.simulate(_tx_lens, &_pos_to_blocks);
+		_pos_to_blocks.clear();
+		uint64_t ret = (sim.blocks() + _shards - 1) / _shards;
+		Logger::info("(txproc) % blocks in % shards of %",
+			     sim.blocks(), _shards, ret);
+		return ret;
+	}
+
+	/* skip_threshold(): returns the most blocks an address may have to
+	 * get from a main database of @blocks blocks without being skipped.
+	 */
+	uint64_t skip_threshold(uint64_t blocks) const {
+		if (_skip_threshold) return _skip_threshold;
+		uint64_t ret = ceil(sqrt((long double) blocks));
+		return ret ? ret : 1;
+	}
+
+	/* tune_main_blocksize(): lays out the main database, without writing
+	 * it, for each candidate blocksize and returns the one with the least
+	 * cost. The cost for an address is that of fetching each of its
+	 * blocks, or, if it is skipped, of downloading the whole database;
+	 * the cost of the blocksize is the average over the addresses.
+	 */
+	uint64_t tune_main_blocksize() {
+		assert(_tx_lens.size() == _pirdb_pos);
+		uint64_t blocks = (uint64_t) sqrt((long double) 8 * _pos);
+		assert(blocks);
+		uint64_t center = (_pos + _len_len * blocks) / blocks;
+
+		uint64_t best = 0;
+		double best_cost = 0;
+		vector<BlockRange> ranges;
+		vector<uint64_t> counts;
+		for (auto &blocksize : PIRCostModel::candidates(
+				center, 2 * _len_len)) {
+			ranges.clear();
+			ranges.reserve(_tx_lens.size());
+			TransactionPIRDatabase sim(blocksize, _directory,
+						   _filename);
+			sim.simulate(_tx_lens, &ranges);
+			count_blocks(ranges, &counts);
+
+			uint64_t threshold = skip_threshold(sim.blocks());
+			uint64_t addresses = 0, lookups = 0, fetched = 0;
+			for (auto &x : counts) {
+				if (!x) continue;
+				++addresses;
+				if (x > threshold) continue;
+				++lookups;
+				fetched += x;
+			}
+			double mean = lookups ? (double) fetched / lookups : 0;
+			double download = _cost_model.download * sim.blocks()
+				* blocksize;
+			double cost = (lookups * _cost_model.cost(
+				mean, sim.blocks(), blocksize)
+				+ (addresses - lookups) * download) / addresses;
+			add_cost("main", blocksize, sim.blocks(), mean, cost);
+			if (!best || cost < best_cost) {
+				best = blocksize;
+				best_cost = cost;
+			}
+		}
+		Logger::info("(txproc) tuned main blocksize: % (default %)",
+			     best, center);
+		return best;
+	}
+
+	/* tune_address_blocksize(): returns the blocksize with the least cost
+	 * for the address database @name, which is made of @entries in a
+	 * DeliminatedPIRDatabase. The manifest tells a client the block its
+	 * entry starts in, so a lookup reads from there to the end of its
+	 * entry: on average 1 + (length - 1) / usable bytes per block.
+	 */
+	uint64_t tune_address_blocksize(const string& name,
+					const vector<string>& entries) {
+		assert(entries.size());
+		uint64_t len = 0;
+		for (auto &x : entries) len += x.length();
+		uint64_t center = DeliminatedPIRDatabase::default_blocksize(len);
+
+		uint64_t best = 0;
+		double best_cost = 0;
+		for (auto &blocksize : PIRCostModel::candidates(
+				center, 2 * (_len_len + _longaddr_len))) {
+			uint64_t usable = blocksize - _len_len;
+			uint64_t blocks = (len + usable - 1) / usable;
+			double fetched = 0;
+			for (auto &x : entries) {
+				fetched += 1 + (x.length() - 1) / (double) usable;
+			}
+			double mean = fetched / entries.size();
+			double cost = _cost_model.cost(mean, blocks, blocksize);
+			add_cost(name, blocksize, blocks, mean, cost);
+			if (!best || cost < best_cost) {
+				best = blocksize;
+				best_cost = cost;
+			}
+		}
+		Logger::info("(txproc) tuned % blocksize: % (default %)",
+			     name, best, center);
+		return best;
+	}
+
+	/* add_cost(): notes a point of the cost curve of database @name. */
+	void add_cost(const string& name, uint64_t blocksize, uint64_t blocks,
+		      double mean, double cost) {
+		Logger::info("(txproc) % blocksize % blocks % "
+			     "blocks/lookup % cost %",
+			     name, blocksize, blocks, mean, cost);
+		_cost_curve.push_back(Logger::stringify(
+			"% % % % %", name, blocksize, blocks, mean, cost));
+	}
+
+	/* Outputs every point of the cost curves, one per line with the
+	   database, blocksize, block count, blocks per lookup and cost. The
+	   file uses the same directory and filename prefix and attaches
+	   "_blocksize_costs".
+	 */
+	void output_cost_curve() {
+		string name = Logger::stringify("%/%_blocksize_costs",
+			      _directory, _filename);
+		ofstream fout(name);
+		assert(fout.good());
+		Logger::info("(txproc) write cost curve: %", name);
+		for (auto &x : _cost_curve) {
+			fout << x << endl;
+			assert(fout.good());
+		}
+	}
+
+	/* output_geometry(): lays out the main database with every blocksize
+	 * of the dry run and writes, for each, the number of blocks, the
+	 * bytes of padding (counting the unused end of the last block), and a
+	 * histogram of the blocks each address has to get. Bucket i of the
+	 * histogram counts the addresses with [2^(i-1), 2^i) blocks, so bucket
+	 * 0 is those with none.
+	 *
+	 * The transaction lengths are read once, a piece at a time: every
+	 * blocksize's layout advances over a piece, concurrently, before the
+	 * next one is read. Each layout keeps its block ranges, 8 bytes per
+	 * transaction, until its histogram is made.
+	 */
+	void output_geometry() {
+		size_t n = _geometry.size();
+		vector<unique_ptr<TransactionPIRDatabase>> sims;
+		vector<vector<BlockRange>> ranges(n);
+		for (size_t i = 0; i < n; ++i) {
+			sims.emplace_back(new TransactionPIRDatabase(
+				_geometry[i], _directory, _filename));
+			sims[i]->start_simulation();
+			ranges[i].reserve(_tx_lens.size());
+		}
+
+		ThreadPool pool(_threads);
+		for (uint64_t lo = 0; lo < _tx_lens.size(); lo += kSimulateStep) {
+			uint64_t hi = min((uint64_t) _tx_lens.size(),
+					  lo + kSimulateStep);
+			pool.parallel_for(0, n, [&](size_t a, size_t b) {
+				for (size_t i = a; i < b; ++i) {
+					sims[i]->simulate(_tx_lens, lo, hi,
+							  &ranges[i]);
+				}
+			});
+		}
+
+		vector<vector<uint64_t>> histograms(n);
+		pool.parallel_for(0, n, [&](size_t a, size_t b) {
+			vector<uint64_t> counts;
+			for (size_t i = a; i < b; ++i) {
+				count_blocks(ranges[i], &counts);
+				vector<BlockRange>().swap(ranges[i]);
+				for (auto &x : counts) {
+					size_t bucket = 0;
+					while (bucket < 64 && x >> bucket) ++bucket;
+					if (histograms[i].size() <= bucket)
+						histograms[i].resize(bucket + 1);
+					++histograms[i][bucket];
+				}
+			}
+		});
+
+		string name = Logger::stringify("%/%_geometry",
+			      _directory, _filename);
+		ofstream fout(name);
+		assert(fout.good());
+		Logger::info("(txproc) write geometry: %", name);
+		fout << "# blocksize blocks padding_bytes "
+		     << "addresses_by_blocks_to_get(0 1 2-3 4-7 ...)" << endl;
+		for (size_t i = 0; i < n; ++i) {
+			uint64_t blocks = sims[i]->blocks();
+			uint64_t padding = blocks * _geometry[i]
+				- _len_len * blocks - _pos;
+			Logger::info("(txproc) blocksize % blocks % padding % "
+				     "(fraction %)", _geometry[i], blocks,
+				     padding,
+				     (double) padding / (blocks * _geometry[i]));
+			fout << _geometry[i] << " " << blocks << " " << padding;
+			for (auto &x : histograms[i]) fout << " " << x;
+			fout << endl;
+			assert(fout.good());
+		}
+	}
+
+	/* save_state(): writes what resume_build() needs to the file with
+	 * the prefix and "_state".
+	 */
+	void save_state() const {
+		string name = Logger::stringify("%/%_state", _directory,
+						_filename);
+		Logger::info("(txproc) write state: %", name);
+		StateWriter state(name);
+		state.write(_layout);
+		state.write(_pos);
+		state.write(_tx_data_sum);
+		state.write(_pirdb_pos);
+		state.write((uint64_t) _addresses.size());
+		for (uint32_t i = 0; i < _addresses.size(); ++i) {
+			state.write(_addresses.long_address(i));
+		}
+		state.write(_addr_to_tx_len);
+		state.write(_addr_positions);
+		state.write(_pos_to_blocks);
+		state.write(_tx_lens);
+		state.write(_epoch);
+		for (auto &x : _db_files) {
+			state.write(x.name);
+			state.write(x.blocksize);
+			state.write(x.size);
+		}
+		state.write(_skip_threshold);
+		state.write(_shards);
+		state.write(_hints);
+		state.write(_hint_file);
+		state.write(_hint_clients);
+		state.write(_hashed);
+		state.write(_reorder);
+	}
+
+	/* note_file(): records that database @i was written by @db, with
+	 * @size bytes.
+	 */
+	void note_file(size_t i, const PIRDatabaseBase& db, uint64_t size) {
+		string path = db.final_filename();
+		_db_files[i].name = path.substr(path.rfind('/') + 1);
+		_db_files[i].blocksize = db.blocksize();
+		_db_files[i].size = size;
+	}
+
+	/* output_hints(): makes the hints for the main database, unless
+	 * the hint file would be among the served files.
+	 */
+	void output_hints() const {
+		if (_shards > 1) {
+			Logger::error("(txproc) no hints for a sharded database");
+			return;
+		}
+		size_t slash = _hint_file.rfind('/');
+		string hint_dir = slash == string::npos ? "."
+			: _hint_file.substr(0, slash + 1);
+		if (real_path(hint_dir) == real_path(_directory)) {
+			Logger::error("(txproc) not writing hints to %: the "
+				      "output directory is served, and a server "
+				      "with the hints learns the blocks fetched",
+				      _hint_file);
+			return;
+		}
+		const DatabaseFile& main = _db_files[kMainDatabase];
+		string path = _directory + "/" + main.name;
+		PIRHintBuilder builder(path, main.blocksize, _hints,
+				       _hint_clients, _threads);
+		builder.build(_hint_file);
+	}
+
+	/* real_path(): returns @path with links and dots resolved, or itself
+	 * if it does not exist.
+	 */
+	static string real_path(const string& path) {
+		char buf[PATH_MAX];
+		if (!realpath(path.c_str(), buf)) return path;
+		return buf;
+	}
+
+	/* manifests(): returns the manifests written next to the address
+	 * database at @path.
+	 */
+	static vector<string> manifests(const string& path) {
+		return {path + ".manifest", path + ".manifest.bin"};
+	}
+
+	/* stash_address_databases(): renames the address databases in
+	 * @old_files and their manifests aside, with ".prev" attached, so
+	 * that building the new ones cannot overwrite them before the deltas
+	 * are made, and so that the old manifests do not outlive them.
+	 */
+	void stash_address_databases(const vector<DatabaseFile>& old_files) {
+		for (size_t i = kMainDatabase + 1; i < kDatabases; ++i) {
+			if (old_files[i].name.empty()) continue;
+			string path = _directory + "/" + old_files[i].name;
+			if (rename(path.c_str(), (path + ".prev").c_str())) {
+				Logger::error("(txproc) cannot find %", path);
+				assert(0);
+			}
+			for (auto &x : manifests(path)) {
+				rename(x.c_str(), (x + ".prev").c_str());
+			}
+		}
+	}
+
+	/* output_deltas(): writes a delta file for each database that turns
+	 * its version in @old_files into the new one. The file uses the same
+	 * directory and filename prefix and attaches "_epoch_", the epoch,
+	 * and the database: "main", "fmt1", "fmt2" or "fmt3".
 	 *
-	 * Currently this was generated by inspection.
-	 * TODO: a two pass approach that does this automatically for any
-	 * address that uses more then sqrt. database size blocks.
-	 */
-	virtual void make_skip_list() {
-		_skip_list.insert("001VayNert3x1KzbpzMGt2qdqrAThiRovi8");
-		_skip_list.insert("015ArtCgi3wmpQAAfYx4riaFmo4prJA4VsK");
-		_skip_list.insert("001dice97ECuByXAvqXpaYzSaQuPVvrtmz6");
-		_skip_list.insert("001dice9wVtrKZTBbAZqz1XiTmboYyvpD3t");
-		_skip_list.insert("001dice9wcMu5hLF4g81u8nioL5mmSHTApw");
-		_skip_list.insert("001dice2zdoxQHpGRNaAWiqbK82FQhr4fb5");
-		_skip_list.insert("001dice1Qf4Br5EYjj9rnHWqgMVYnQWehYG");
-		_skip_list.insert("01DFYJ3i6UcWTg3pCxkeJu6ZC7RJHBD5NNn");
-		_skip_list.insert("001dice8EMZmqKvrGE4Qc9bUFf9PX3xaYDp");
-		_skip_list.insert("001dice7W2AicHosf5EL3GFDUVga7TgtPFn");
-		_skip_list.insert("001dice7fUkz5h4z2wPc1wLMPWgB5mDwKDx");
+	 * Only the main database blocks from the last one of @old_layout on
+	 * can have changed. The address databases are compared block by block
+	 * with their stashed old versions, unless the blocksize changed, in
+	 * which case the delta has every block. An address database that is
+	 * no longer written, as every address is skipped, gets a delta that
+	 * removes it. The stashed versions and their manifests are removed.
+	 */
+	void output_deltas(const vector<DatabaseFile>& old_files,
+			   const PIRLayout& old_layout) {
+		static const char* kNames[] = {"main", "fmt1", "fmt2", "fmt3"};
+		for (size_t i = 0; i < kDatabases; ++i) {
+			const DatabaseFile& old_file = old_files[i];
+			const DatabaseFile& new_file = _db_files[i];
+			string old_path = _directory + "/" + old_file.name;
+			if (new_file.name.empty() && old_file.name.empty())
+				continue;
+
+			PIRDeltaSpec spec;
+			spec.old_name = old_file.name;
+			spec.new_name = new_file.name;
+			spec.new_path = _directory + "/" + new_file.name;
+			spec.blocksize = new_file.blocksize;
+			spec.old_size = old_file.size;
+			spec.from_block = 0;
+			if (i == kMainDatabase) {
+				spec.from_block = old_layout.cur_block;
+			} else if (!old_file.name.empty() &&
+				   old_file.blocksize == new_file.blocksize) {
+				spec.old_path = old_path + ".prev";
+			}
+			PIRDelta::write(spec, Logger::stringify(
+				"%/%_epoch_%_%.delta", _directory, _filename,
+				_epoch, kNames[i]));
+		}
+		for (size_t i = kMainDatabase + 1; i < kDatabases; ++i) {
+			if (old_files[i].name.empty()) continue;
+			string path = _directory + "/" + old_files[i].name;
+			remove((path + ".prev").c_str());
+			for (auto &x : manifests(path)) {
+				remove((x + ".prev").c_str());
+			}
+		}
+	}
+
+	/* trace_touched(): outputs how many addresses the appended
+	 * transactions changed.
+	 */
+	void trace_touched() const {
+		vector<bool> touched(_addresses.size(), false);
+		uint64_t count = 0;
+		for (auto &x : _addr_positions) {
+			if (x.position < _resumed_pos || touched[x.address])
+				continue;
+			touched[x.address] = true;
+			++count;
+		}
+		Logger::info("(txproc) appended % transactions touching % of % "
+			     "addresses", _pirdb_pos - _resumed_pos, count,
+			     _addresses.size());
+	}
+
+	/* Outputs the addresses left out by make_skip_list(), heaviest
+	   first, each with the number of blocks it would need. The file uses
+	   the same directory and filename prefix and attaches "_skip_list".
+	 */
+	void output_skip_list() {
+		string name = Logger::stringify("%/%_skip_list",
+			      _directory, _filename);
+		ofstream fout(name);
+		assert(fout.good());
+		Logger::info("(txproc) write skip list: %", name);
+
+		for (auto &x : _skipped) {
+			fout << _addresses.long_address(x.second) << " "
+			     << x.first << endl;
+			assert(fout.good());
+		}
+	}
+
+	/* store_tx(): the work of add_tx() for any container of addresses. */
+	template <typename T>
+	void store_tx(const T& addresses, string_view transaction_data) {
+		static int max_addr_len = 0;
+		_tx_data_sum += transaction_data.length();
+		if (!_geometry.empty()) {
+			/* a dry run only needs the lengths */
+		} else if (_spill) {
+			_spill->append(transaction_data.data(),
+				       transaction_data.length());
+		} else {
+			_txs.push_back(string(transaction_data));
+		}
+		/* For each address that will read this transaction,
+		   add the transaction length to its counter and the current
+		   position in the sequence of data to build the blocks-to-get
+		   database.
+		 */
+		assert(_pirdb_pos < UINT32_MAX);
+		for (auto &x : addresses) {
+			uint32_t id = add_address(x);
+			_addr_to_tx_len[id] += transaction_data.length();
+			_addr_positions.push_back(AddressPosition{
+				id, (uint32_t) _pirdb_pos});
+
+			/* if max_addr_len is unset, set it to the first
+			 * address. Otherwise check that they are equal.
+			 */
+			if (max_addr_len == 0) max_addr_len = x.length();
+			assert(max_addr_len == x.length());
+			assert(x.length());
+		}
+		_tx_lens.push_back(transaction_data.length());
+		_pos += _len_len + transaction_data.length();
+		++_pirdb_pos;
 	}
 
 	/* add_address() notes that new address has been seen by our transaction
-	 * processor. We use the last 20 bytes of an address as its 'short
-	 * address' since it still has the properties of a 160-bit random value
-	 * without the less-high-entropy stuff at the start of the address (and
-	 * therefore works better for interpolative search).
-	 * It adds the address to the maps _shortaddr and _longaddr,
-	 * which are mutually inverse.
+	 * processor and returns its id. We use the last 20 bytes of an address
+	 * as its 'short address' since it still has the properties of a 160-bit
+	 * random value without the less-high-entropy stuff at the start of the
+	 * address (and therefore works better for interpolative search).
 	 */
-	void add_address(const string& address) {
-		assert(address.length() > _shortaddr_len);
-		_shortaddr[address] = address.substr(
-			address.length() - _shortaddr_len, address.length());
-		_longaddr[_shortaddr[address]] = address;
+	uint32_t add_address(string_view address) {
+		uint32_t id = _addresses.intern(address.data(), address.length());
+		if (id == _addr_to_tx_len.size()) _addr_to_tx_len.push_back(0);
+		return id;
 	}
 
-	/* Returns the short form address for a bitcoin address */
-	string get_short_address(const string& address) const {
-		assert(address.length() > _shortaddr_len);
-		assert(_shortaddr.count(address));
-		return _shortaddr.at(address);
+	/* Returns the number of main database blocks to get for @address */
+	uint64_t blocks_to_get(uint32_t address) const {
+		return _addr_block_offsets[address + 1]
+			- _addr_block_offsets[address];
 	}
 
-	/* Returns the full bitcoin address for our shortform */
-	string get_long_address(const string& address) const {
-		assert(address.length() == _shortaddr_len);
-		assert(_longaddr.count(address));
-		return _longaddr.at(address);
+	/* Returns the sorted main database blocks to get for @address */
+	const uint32_t* blocks_of(uint32_t address) const {
+		return _addr_blocks.data() + _addr_block_offsets[address];
 	}
 
 	/* Outputs a file that contains a list of all the addresses.
@@ -248,107 +1076,250 @@ protected:
 		assert(fout.good());
 		Logger::info("(txproc) write address list: %", name);
 
-		for (auto &x : _addr_to_blocks) {
-			fout << get_long_address(x.first) << endl;
+		for (auto &x : _sorted) {
+			if (!blocks_to_get(x)) continue;
+			fout << _addresses.long_address(x) << endl;
 			assert(fout.good());
 		}
 	}
 
-	/* build_address_map(): represents the set @blocks as a binary string of
-	 * length @_pir_blocks (in bits) with 1 if that position is in @blocks
-	 * and 0 otherwise. It adds this string (prefixed by address) to the
-	 * vector @out
+	/* build_address_map(): represents the blocks of @address as a binary
+	 * string of length @_pir_blocks (in bits) with 1 if that position is
+	 * one of its blocks and 0 otherwise. It stores this string (prefixed
+	 * by address) in @out. See append_block_bitmap() for the bit order.
 	 */
-	virtual void build_address_map(const string& address,
-				       const set<uint32_t>& blocks,
-				       vector<string>* out) const {
+	virtual void build_address_map(uint32_t address, string* out) const {
 		assert(out);
-		stringstream ss;
-		ss << get_long_address(address);
-		int i = 0;
-		while (i < _pir_blocks) {
-			uint8_t val = 0;
-			for (int j = 0; j < 8; ++j, ++i) {
-				if (blocks.count(i)) {
-					val += 1;
-				}
-				val <<= 1;
-			}
-			ss << val;
-		}
-		out->push_back(ss.str());
+		out->reserve(_longaddr_len + block_bitmap_len(_pir_blocks));
+		*out = _addresses.long_address(address);
+		append_block_bitmap(blocks_of(address), blocks_to_get(address),
+				    _pir_blocks, out);
 	}
 
-	/* build_address_list(): represents the set @blocks as a list of
-	 * numbers. It adds this string (prefixed by address) to the
-	 * vector @out
+	/* build_address_list(): represents the blocks of @address as a list of
+	 * numbers. It stores this string (prefixed by address) in @out
 	 */
-	virtual void build_address_list(const string& address,
-				        const set<uint32_t>& blocks,
-				        vector<string>* out) const {
+	virtual void build_address_list(uint32_t address, string* out) const {
 		assert(out);
 		stringstream ss;
-		ss << get_long_address(address);
-		uint32_t len = blocks.size();
+		ss << _addresses.long_address(address);
+		uint32_t len = blocks_to_get(address);
 		ss.write(reinterpret_cast<const char*>(&len),
 			 sizeof(len));
-		for (auto &x: blocks) {
-			ss.write(reinterpret_cast<const char*>(
-				 &x), sizeof(x));
-		}
-		out->push_back(ss.str());
+		ss.write(reinterpret_cast<const char*>(blocks_of(address)),
+			 len * sizeof(uint32_t));
+		*out = ss.str();
+	}
+
+	/* build_address_deltas(): represents the blocks of @address as a
+	 * delta and varint coded list (see block_list_codec.h). It stores this
+	 * string (prefixed by address) in @out
+	 */
+	virtual void build_address_deltas(uint32_t address, string* out) const {
+		assert(out);
+		*out = _addresses.long_address(address);
+		append_block_list(blocks_of(address), blocks_to_get(address),
+				  out);
 	}
 
 	/* Outputs the first pir database consisting of address-sorted list of
 	 * blocks in the main database to be retrieved.
+	 *
+	 * Every address's entries are serialized independently into its own
+	 * slot by @pool, and then the three formats are built at the same time.
+	 * The entries keep their order, so the output is the same as when run
+	 * serially.
 	 */
-	void output_address_formats() {
-		vector<string> format1, format2;
-		vector<string> address_list;
+	void output_address_formats(ThreadPool* pool) {
+		assert(pool);
+		vector<uint32_t> listed;
+		for (const auto &x : _sorted) {
+			if (blocks_to_get(x)) listed.push_back(x);
+		}
+		if (listed.empty()) {
+			Logger::error("(txproc) every address is skipped, "
+				      "no address databases written");
+			/* nor is an earlier hashed one left for the old
+			 * main database */
+			remove_hashed();
+			return;
+		}
 
-		for (const auto &x : _addr_to_blocks) {
-			address_list.push_back(get_long_address(x.first));
-			build_address_map(x.first, x.second, &format1);
-			build_address_list(x.first, x.second, &format2);
+		vector<string> format1(listed.size());
+		vector<string> format2(listed.size());
+		vector<string> format3(listed.size());
+		vector<string> address_list(listed.size());
+		pool->parallel_for(0, listed.size(), [&](size_t lo, size_t hi) {
+			for (size_t i = lo; i < hi; ++i) {
+				address_list[i] =
+					_addresses.long_address(listed[i]);
+				build_address_map(listed[i], &format1[i]);
+				build_address_list(listed[i], &format2[i]);
+				build_address_deltas(listed[i], &format3[i]);
+			}
+		});
+
+		uint64_t blocksize2 = 0, blocksize3 = 0;
+		if (_tune) {
+			blocksize2 = tune_address_blocksize("fmt2", format2);
+			blocksize3 = tune_address_blocksize("fmt3", format3);
 		}
-		assert(address_list.size());
-		assert(format1.size());
-		assert(format2.size());
-		assert(address_list.size() == format1.size());
-		assert(address_list.size() == format2.size());
-		{
+
+		uint64_t file1, file2, file3;
+		pool->run([this, &address_list, &format1, &file1]() {
 			AutoDeliminatedPIRDatabase deliminated_pir_database1(
 				_directory, "addr_db.fmt1");
 			deliminated_pir_database1.build(address_list, format1);
-		}
-		{
+			file1 = deliminated_pir_database1.file_size();
+			note_file(1, deliminated_pir_database1, file1);
+		});
+		pool->run([this, &address_list, &format2, &file2,
+			   blocksize2]() {
 			DeliminatedPIRDatabase deliminated_pir_database2(
 				_directory, "addr_db.fmt2");
+			if (blocksize2) {
+				deliminated_pir_database2.set_pir_blocksize(
+					blocksize2);
+			}
 			deliminated_pir_database2.build(address_list, format2);
+			file2 = deliminated_pir_database2.file_size();
+			note_file(2, deliminated_pir_database2, file2);
+		});
+		pool->run([this, &address_list, &format3, &file3,
+			   blocksize3]() {
+			DeltaDeliminatedPIRDatabase deliminated_pir_database3(
+				_directory, "addr_db.fmt3");
+			if (blocksize3) {
+				deliminated_pir_database3.set_pir_blocksize(
+					blocksize3);
+			}
+			deliminated_pir_database3.build(address_list, format3);
+			file3 = deliminated_pir_database3.file_size();
+			note_file(3, deliminated_pir_database3, file3);
+		});
+		if (_hashed) {
+			pool->run([this, &address_list, &format3]() {
+				output_hashed(address_list, format3);
+			});
 		}
+		pool->wait();
+
+		trace_format("fmt1", format1, file1);
+		trace_format("fmt2", format2, file2);
+		trace_format("fmt3", format3, file3);
 	}
 
-	/* remap_addresses(): this function takes a map from addresses to
-	 * positions and produces a map of addresses to the set of PIR blocks
-	 * where that transaction is located. Effectively converts byte
-	 * positions to block positions for each address's transaction.
+	/* output_hashed(): writes the hashed address database of the format 3
+	 * @entries of @addresses, in place of any earlier one.
+	 */
+	void output_hashed(const vector<string>& addresses,
+			   const vector<string>& entries) const {
+		remove_hashed();
+		HashedPIRDatabase hashed(_directory, "addr_db.fmt4");
+		hashed.build(addresses, entries);
+	}
+
+	/* remove_hashed(): removes any hashed address database and its
+	 * parameters.
+	 */
+	void remove_hashed() const {
+		glob_t g;
+		string pattern = _directory + "/addr_db.fmt4_*.pir*";
+		if (!glob(pattern.c_str(), 0, nullptr, &g)) {
+			for (size_t i = 0; i < g.gl_pathc; ++i) {
+				Logger::info("(txproc) remove %",
+					     g.gl_pathv[i]);
+				remove(g.gl_pathv[i]);
+			}
+		}
+		globfree(&g);
+	}
+
+	/* trace_format(): outputs the size of the address database @name
+	 * built from @entries, whose file took @file_size bytes.
+	 */
+	void trace_format(const string& name, const vector<string>& entries,
+			  uint64_t file_size) const {
+		uint64_t entry_size = 0;
+		for (auto &x : entries) entry_size += x.length();
+		uint64_t list_size = entry_size - entries.size() * _longaddr_len;
+		Logger::info("(txproc) % entries  (B): %", name, entry_size);
+		Logger::info("(txproc) % lists    (B): %", name, list_size);
+		Logger::info("(txproc) % per addr (B): %", name,
+			     (double) list_size / entries.size());
+		Logger::info("(txproc) % file     (B): %", name, file_size);
+	}
+
+	/* remap_addresses(): this function takes the positions of each
+	 * address's transactions and produces, for each address, the sorted
+	 * list of PIR blocks where those transactions are located. Effectively
+	 * converts transaction positions to block positions for each address.
+	 *
+	 * Positions are recorded in increasing order, so each address meets
+	 * its blocks in nondecreasing order and a block is new exactly when it
+	 * follows the last one recorded. The first pass counts the blocks of
+	 * each address, from which the skip list is made, and the second fills
+	 * them in for the addresses that are kept.
 	 */
 	virtual void remap_addresses() {
-		for (auto &x : _addr_to_positions) {
-			if (_skip_list.count(x.first)) continue;
-			for (auto &y : x.second) {
-				for (auto &z : _pos_to_blocks[y]) {
-					_addr_to_blocks[x.first].insert(z);
-				}
+		uint32_t n = _addresses.size();
+		vector<uint64_t> counts;
+		count_blocks(_pos_to_blocks, &counts);
+
+		make_skip_list(counts);
+		_addr_block_offsets.assign(n + 1, 0);
+		for (uint32_t i = 0; i < n; ++i) {
+			_addr_block_offsets[i + 1] = _addr_block_offsets[i]
+				+ (_skip[i] ? 0 : counts[i]);
+		}
+
+		_addr_blocks.resize(_addr_block_offsets[n]);
+		vector<uint64_t> fill(_addr_block_offsets.begin(),
+				      _addr_block_offsets.end() - 1);
+
+		/* one past the last block recorded, or 0 for none */
+		vector<uint32_t> next(n, 0);
+		for (auto &x : _addr_positions) {
+			if (_skip[x.address]) continue;
+			const BlockRange& range = _pos_to_blocks[x.position];
+			uint64_t from = max((uint64_t) range.first,
+					    (uint64_t) next[x.address]);
+			for (uint64_t z = from; z <= range.last; ++z) {
+				_addr_blocks[fill[x.address]++] = z;
 			}
+			if (range.last >= from) next[x.address] = range.last + 1;
+		}
+	}
+
+	/* count_blocks(): sets @counts, indexed by address id, to the number
+	 * of blocks each address has to get when the transactions are laid
+	 * out in the blocks given by @ranges.
+	 */
+	void count_blocks(const vector<BlockRange>& ranges,
+			  vector<uint64_t>* counts) const {
+		assert(counts);
+		uint32_t n = _addresses.size();
+		counts->assign(n, 0);
+
+		/* one past the last block recorded, or 0 for none */
+		vector<uint32_t> next(n, 0);
+		for (auto &x : _addr_positions) {
+			const BlockRange& range = ranges[x.position];
+			uint64_t from = max((uint64_t) range.first,
+					    (uint64_t) next[x.address]);
+			if (range.last < from) continue;
+			(*counts)[x.address] += range.last - from + 1;
+			next[x.address] = range.last + 1;
 		}
 	}
 
 	/* trace(): for each address, tell how many blocks to get. */
 	virtual void trace() {
-		for (auto &x: _addr_to_blocks) {
+		for (auto &x: _sorted) {
+			if (!blocks_to_get(x)) continue;
 			Logger::info("(btpir) addr % \t has % blocks to get.",
-				     x.first, x.second.size());
+				     _addresses.short_address(x),
+				     blocks_to_get(x));
 		}
 	}
 
@@ -374,22 +1345,41 @@ protected:
 
 	vector<string> _txs;
 
-	map<string, uint64_t> _addr_to_tx_len;
-	map<string, set<uint32_t>> _addr_to_blocks;
-	map<string, set<uint32_t>> _addr_to_positions;
+	/* if set, transactions are stored here instead of in _txs */
+	unique_ptr<TransactionSpill> _spill;
+
+	/* An address id and the position of one of its transactions. */
+	struct AddressPosition {
+		uint32_t address;
+		uint32_t position;
+	};
+
+	/* Indexed by address id, the bytes of all its transactions */
+	vector<uint64_t> _addr_to_tx_len;
 
-	/* Maps a transaction position to the set of PIR blocks
-	   where it is stored. Generally the set is going to have one entry, or
-	   two if it crosses a PIR block boundary.
+	/* Every (address, transaction position) pair, in position order */
+	vector<AddressPosition> _addr_positions;
+
+	/* The main database blocks to get for address id i are
+	   _addr_blocks[_addr_block_offsets[i] .. _addr_block_offsets[i + 1]),
+	   in increasing order.
 	 */
-	map<uint64_t, set<uint32_t>> _pos_to_blocks;
+	vector<uint64_t> _addr_block_offsets;
+	vector<uint32_t> _addr_blocks;
 
-	/* a set of addresses whose owners achieve better performance
-	   by downloading the whole block chain. */
-	set<string> _skip_list;
+	/* Indexed by transaction position, the range of PIR blocks
+	   where it is stored. Generally the range is going to have one block,
+	   or two if it crosses a PIR block boundary.
+	 */
+	vector<BlockRange> _pos_to_blocks;
 
-	map<string, string> _longaddr;  // short to full addr
-	map<string, string> _shortaddr; // full to short addr
+	/* Indexed by address id, true for the addresses whose owners achieve
+	   better performance by downloading the whole block chain. */
+	vector<bool> _skip;
+
+	/* (blocks to get, address id) of the skipped addresses, heaviest
+	   first */
+	vector<pair<uint64_t, uint32_t>> _skipped;
 
 	/* total bytes used in main transaction database */
 	uint64_t _tx_data_sum;
@@ -405,6 +1395,74 @@ protected:
 
 	/* current transaction offset in the PIR database */
 	uint64_t _pirdb_pos;
+
+	/* interns every address seen as a dense id */
+	AddressTable _addresses;
+
+	/* the address ids ordered by short address */
+	vector<uint32_t> _sorted;
+
+	/* threads used for output, or 0 for one per hardware thread */
+	size_t _threads;
+
+	/* skip addresses with more blocks than this, or 0 for the default */
+	uint64_t _skip_threshold;
+
+	/* Indexed by transaction position, the length of its data */
+	vector<uint32_t> _tx_lens;
+
+	/* if set, blocksizes are picked by tune_blocksizes() */
+	bool _tune;
+	PIRCostModel _cost_model;
+
+	/* the points of the cost curves, as lines of text */
+	vector<string> _cost_curve;
+
+	/* how far the main database got, for appending to it */
+	PIRLayout _layout;
+
+	/* if set, the main database is appended to instead of written */
+	bool _appending;
+
+	/* the transactions and bytes of data before appending */
+	uint64_t _resumed_pos;
+	uint64_t _resumed_tx_data_sum;
+
+	/* the number of appends since the first build */
+	uint64_t _epoch;
+
+	/* the main database and then the format 1, 2 and 3 address
+	   databases */
+	vector<DatabaseFile> _db_files;
+	static const size_t kMainDatabase = 0;
+	static const size_t kDatabases = 4;
+
+	/* files the main database is split into, or 0 or 1 for one */
+	size_t _shards;
+
+	/* hint sets to make for the main database, or 0 for none */
+	uint64_t _hints;
+
+	/* where to write the hints, outside the output directory, and for
+	   how many clients, each with a file of its own */
+	string _hint_file;
+	uint64_t _hint_clients;
+
+	/* whether to write the hashed address database */
+	bool _hashed;
+
+	/* whether to reorder the transactions for locality, and the order,
+	 * by the position they were added at, once they are
+	 */
+	bool _reorder;
+	vector<uint32_t> _reorder_order;
+
+	/* the blocksizes of a dry run, or empty to write the databases */
+	vector<uint64_t> _geometry;
+
+	/* transactions laid out by each blocksize before the next ones are
+	   read in a dry run */
+	static const uint64_t kSimulateStep = 1 << 16;
 };
 
 }  // namespace bitcoin_pir
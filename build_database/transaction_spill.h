@@ -0,0 +1,203 @@
+/*
+   Copyright 2016, Joel Reardon, UC Berkeley
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef __BTPIR__BUILD_DATABASE__TRANSACTION_SPILL__H__
+#define __BTPIR__BUILD_DATABASE__TRANSACTION_SPILL__H__
+
+#include <cassert>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <fcntl.h>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+#include "ib/logger.h"
+
+using namespace std;
+using namespace ib;
+
+namespace btpir {
+
+/* TransactionSpill is an append-only file of raw transactions. It lets the
+ * TransactionProcessor keep only per-address state in memory while the
+ * transaction bytes wait on disk until the main database is built.
+ *
+ * Each record is a 4-byte length followed by the transaction bytes, i.e., the
+ * same framing that the main PIR database uses for its entries. Records are
+ * read back sequentially in the order they were appended.
+ */
+class TransactionSpill {
+public:
+	TransactionSpill(const string& filename)
+		: _filename(filename), _records(0), _bytes(0) {
+		_fout.reset(new ofstream(_filename, ios::binary | ios::trunc));
+		assert(_fout->good());
+	}
+
+	/* Destructor removes the spill file, since it is only scratch space
+	 * for a single build.
+	 */
+	virtual ~TransactionSpill() {
+		_fout.reset(nullptr);
+		_fin.reset(nullptr);
+		remove(_filename.c_str());
+	}
+
+	/* append(): adds @data as the next record in the spill file. */
+	virtual void append(const string& data) {
+		append(data.c_str(), data.length());
+	}
+
+	/* append(): adds @len bytes from @data as the next record. */
+	virtual void append(const char* data, size_t len) {
+		assert(_fout);
+		assert(len <= UINT32_MAX);
+		uint32_t length = len;
+		_fout->write(reinterpret_cast<const char*>(&length),
+			     sizeof(length));
+		_fout->write(data, len);
+		assert(_fout->good());
+		++_records;
+		_bytes += sizeof(length) + len;
+	}
+
+	/* rewind(): finishes any appending and positions the reader at the
+	 * first record.
+	 */
+	virtual void rewind() {
+		if (_fout) {
+			_fout->close();
+			_fout.reset(nullptr);
+			Logger::info("(spill) % transactions, % bytes in %",
+				     _records, _bytes, _filename);
+		}
+		_fin.reset(new ifstream(_filename, ios::binary));
+		assert(_fin->good());
+	}
+
+	/* next(): reads the next record into @data, reusing its storage.
+	 * Returns false once all records have been read.
+	 */
+	virtual bool next(string* data) {
+		assert(data);
+		assert(_fin);
+		uint32_t length;
+		_fin->read(reinterpret_cast<char*>(&length), sizeof(length));
+		if (_fin->eof()) return false;
+		assert(_fin->good());
+		data->resize(length);
+		if (length) _fin->read(&(*data)[0], length);
+		assert(_fin->good());
+		return true;
+	}
+
+	/* reorder(): rewrites the spill file with its records in the order
+	 * @order, whose ith entry is the record to put ith, and rewinds it.
+	 * The records are found by one pass over the lengths and then copied
+	 * one by one from there, so only one is in memory at a time.
+	 */
+	virtual void reorder(const vector<uint32_t>& order) {
+		assert(order.size() == _records);
+		rewind();
+		vector<uint64_t> offsets;
+		offsets.reserve(_records);
+		uint64_t offset = 0;
+		uint32_t length;
+		while (_fin->read(reinterpret_cast<char*>(&length),
+				  sizeof(length))) {
+			offsets.push_back(offset);
+			offset += sizeof(length) + length;
+			_fin->seekg(offset);
+		}
+		assert(offsets.size() == _records);
+		_fin->clear();
+
+		string tmp_filename = _filename + ".reordered";
+		ofstream fout(tmp_filename, ios::binary | ios::trunc);
+		assert(fout.good());
+		string data;
+		for (auto &x : order) {
+			_fin->seekg(offsets[x]);
+			_fin->read(reinterpret_cast<char*>(&length),
+				   sizeof(length));
+			data.resize(length);
+			if (length) _fin->read(&data[0], length);
+			assert(_fin->good());
+			fout.write(reinterpret_cast<const char*>(&length),
+				   sizeof(length));
+			fout.write(data.data(), length);
+		}
+		fout.close();
+		assert(fout.good());
+		_fin.reset(nullptr);
+		int ret = rename(tmp_filename.c_str(), _filename.c_str());
+		assert(!ret);
+		rewind();
+	}
+
+	/* read_at(): reads @len bytes at @offset of the spill file, counting
+	 * the record lengths, into @data. Appending must be finished by
+	 * rewind(). It has its own descriptor, so threads may call it at once.
+	 */
+	virtual void read_at(uint64_t offset, char* data, size_t len) const {
+		assert(!_fout);
+		int fd = open(_filename.c_str(), O_RDONLY);
+		assert(fd >= 0);
+		while (len) {
+			ssize_t ret = pread(fd, data, len, offset);
+			if (ret < 0 && errno == EINTR) continue;
+			if (ret <= 0) {
+				Logger::error("(spill) read of % failed",
+					      _filename);
+				assert(0);
+				break;
+			}
+			data += ret;
+			len -= ret;
+			offset += ret;
+		}
+		close(fd);
+	}
+
+	/* Returns the number of records appended. */
+	virtual uint64_t records() const {
+		return _records;
+	}
+
+protected:
+	// Prohibit copy
+	TransactionSpill(const TransactionSpill& copy) {}
+
+	/* the scratch file holding the records */
+	string _filename;
+
+	unique_ptr<ofstream> _fout;
+	unique_ptr<ifstream> _fin;
+
+	/* number of records appended */
+	uint64_t _records;
+
+	/* bytes appended, including the length prefixes */
+	uint64_t _bytes;
+};
+
+}  // namespace btpir
+
+#endif  // __BTPIR__BUILD_DATABASE__TRANSACTION_SPILL__H__
@@ -0,0 +1,66 @@
+/*
+   Copyright 2016, Joel Reardon, UC Berkeley
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef __BTPIR__BUILD_DATABASE__TX_FILE_FORMAT__H__
+#define __BTPIR__BUILD_DATABASE__TX_FILE_FORMAT__H__
+
+#include <cstdint>
+#include <cstring>
+
+namespace btpir {
+
+/* The binary TX_FILE format. All integers are little endian, as in the PIR
+ * databases themselves.
+ *
+ * The file starts with a TxFileHeader. Each record is then:
+ *
+ *	uint32	length of the rest of the record
+ *	uint16	number of addresses
+ *	uint8	length of address 1, then its bytes
+ *	...
+ *	uint32	length of the transaction, then its bytes
+ *
+ * so a reader can skip or validate any record from its first field alone.
+ *
+ * The optional index "<file>.idx" starts with a TxIndexHeader, followed by
+ * the uint64 byte offset of every stride-th record (0, stride, 2 * stride,
+ * ...). With it, a reader can split the file across threads or resume at any
+ * record without reading what comes before.
+ */
+struct TxFileHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t flags;
+	uint64_t records;
+};
+
+struct TxIndexHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t stride;
+	uint64_t records;
+};
+
+static_assert(sizeof(TxFileHeader) == 24, "TxFileHeader is packed");
+static_assert(sizeof(TxIndexHeader) == 24, "TxIndexHeader is packed");
+
+static const char kTxFileMagic[8] = {'B', 'T', 'P', 'I', 'R', 'T', 'X', '1'};
+static const char kTxIndexMagic[8] = {'B', 'T', 'P', 'I', 'R', 'I', 'X', '1'};
+static const uint32_t kTxFileVersion = 1;
+
+}  // namespace btpir
+
+#endif  // __BTPIR__BUILD_DATABASE__TX_FILE_FORMAT__H__
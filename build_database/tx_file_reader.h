@@ -0,0 +1,522 @@
+/*
+   Copyright 2016, Joel Reardon, UC Berkeley
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef __BTPIR__BUILD_DATABASE__TX_FILE_READER__H__
+#define __BTPIR__BUILD_DATABASE__TX_FILE_READER__H__
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "ib/logger.h"
+#include "build_database/tx_file_format.h"
+
+using namespace std;
+using namespace ib;
+
+namespace btpir {
+
+/* A transaction parsed from a TX_FILE. The views point into the mapped file
+ * and stay valid for the lifetime of the reader.
+ */
+struct TxRecord {
+	vector<string_view> addresses;
+	string_view data;
+};
+
+/* A run of whole records in a TX_FILE: bytes [begin, end) hold @records
+ * records.
+ */
+struct TxChunk {
+	size_t begin;
+	size_t end;
+	uint64_t records;
+};
+
+/* TxFileReader memory-maps a TX_FILE and walks it in place. It reads both
+ * the binary format of tx_file_format.h, recognized by its magic, and the
+ * original text format:
+ *
+ *	<number of addresses>
+ *	addr1
+ *	...
+ *	<length of transaction>
+ *	<binary string of transaction length>
+ *
+ * Records are returned as views into the mapping, so nothing is copied until
+ * the consumer decides to.
+ *
+ * A binary file is split using its index if there is one, or else by
+ * hopping over the record length fields. In the text format, since the
+ * payloads are binary, a record boundary cannot be recognized from
+ * an arbitrary offset with certainty. split() therefore guesses a boundary
+ * near each chunk's nominal start in parallel, parses forward from it, and
+ * then stitches the guesses together in order: a guess is accepted only once
+ * the parse coming from the previous, already verified chunk reaches one of
+ * its record starts, after which both parses agree. A bad guess only costs
+ * re-parsing that region sequentially.
+ */
+class TxFileReader {
+public:
+	TxFileReader(const string& filename)
+		: _filename(filename), _binary(false), _begin(0),
+		  _records(0), _stride(0) {
+		_fd = open(_filename.c_str(), O_RDONLY);
+		assert(_fd >= 0);
+		struct stat st;
+		int ret = fstat(_fd, &st);
+		assert(!ret);
+		_size = st.st_size;
+		_data = nullptr;
+		if (_size) {
+			void* map = mmap(nullptr, _size, PROT_READ,
+					 MAP_PRIVATE, _fd, 0);
+			assert(map != MAP_FAILED);
+			_data = static_cast<const char*>(map);
+			madvise(map, _size, MADV_SEQUENTIAL);
+		}
+
+		TxFileHeader header;
+		if (_size >= sizeof(header)) {
+			memcpy(&header, _data, sizeof(header));
+			_binary = !memcmp(header.magic, kTxFileMagic,
+					  sizeof(header.magic));
+		}
+		if (_binary) {
+			assert(header.version == kTxFileVersion);
+			_begin = sizeof(header);
+			_records = header.records;
+			load_index();
+		}
+	}
+
+	virtual ~TxFileReader() {
+		if (_data) munmap(const_cast<char*>(_data), _size);
+		close(_fd);
+	}
+
+	/* Returns the size of the file in bytes. */
+	size_t size() const {
+		return _size;
+	}
+
+	/* Returns true if the file is in the binary format. */
+	bool binary() const {
+		return _binary;
+	}
+
+	/* Returns the number of records of a binary file. */
+	uint64_t records() const {
+		assert(_binary);
+		return _records;
+	}
+
+	/* seek(): returns the offset of record number @record of a binary
+	 * file, from which parse() or a chunk can resume.
+	 */
+	size_t seek(uint64_t record) const {
+		assert(_binary);
+		assert(record <= _records);
+		size_t pos = _begin;
+		uint64_t cur = 0;
+		if (_stride) {
+			size_t i = min((size_t) (record / _stride),
+				       _index.size() - 1);
+			cur = (uint64_t) i * _stride;
+			pos = _index[i];
+		}
+		for (; cur < record; ++cur) {
+			bool ok = skip_binary(&pos);
+			assert(ok);
+		}
+		return pos;
+	}
+
+	/* chunk_from(): returns the chunk holding record number @record and
+	 * all that follow it in a binary file.
+	 */
+	TxChunk chunk_from(uint64_t record) const {
+		TxChunk chunk;
+		chunk.begin = seek(record);
+		chunk.end = _size;
+		chunk.records = _records - record;
+		return chunk;
+	}
+
+	/* parse(): parses the record starting at *@pos into @record and
+	 * advances *@pos past it. Returns false, leaving *@pos alone, at the
+	 * end of the file or if the bytes there are not a well-formed record.
+	 */
+	bool parse(size_t* pos, TxRecord* record) const {
+		if (_binary) return parse_binary(pos, record);
+		return parse_text(pos, record);
+	}
+
+	/* at_end(): returns true if no record follows @pos. */
+	bool at_end(size_t pos) const {
+		if (_binary) return pos == _size;
+		return skip_space(pos) == _size;
+	}
+
+	/* split(): pre-scans the file with @threads threads and returns
+	 * consecutive record-aligned chunks that cover it, one per thread
+	 * (fewer for small files). Asserts that the file is well formed.
+	 */
+	vector<TxChunk> split(size_t threads) const {
+		if (!threads) threads = 1;
+		threads = min(threads, max((size_t) 1, _size / kMinChunk));
+		if (_binary && _stride) return split_indexed(threads);
+		if (_binary) return split_binary(threads);
+		return split_text(threads);
+	}
+
+	/* for_each(): calls @f on every record of @chunk in order and returns
+	 * the number of records.
+	 */
+	template <typename F>
+	uint64_t for_each(const TxChunk& chunk, F f) const {
+		TxRecord record;
+		size_t pos = chunk.begin;
+		uint64_t records = 0;
+		while (records < chunk.records) {
+			bool ok = parse(&pos, &record);
+			assert(ok);
+			f(record);
+			++records;
+		}
+		return records;
+	}
+
+	/* prefetch(): asks the kernel to start reading @chunk in. */
+	void prefetch(const TxChunk& chunk) const {
+		size_t page = sysconf(_SC_PAGESIZE);
+		size_t begin = chunk.begin - chunk.begin % page;
+		if (chunk.end <= begin) return;
+		madvise(const_cast<char*>(_data) + begin, chunk.end - begin,
+			MADV_WILLNEED);
+	}
+
+protected:
+	/* Chunks are not split below this many bytes. */
+	static const size_t kMinChunk = 1 << 20;
+
+	/* Record starts kept from a guessed chain to resynchronize with. */
+	static const size_t kMaxSync = 1 << 12;
+
+	/* The result of parsing forward from a guessed record start. */
+	struct Scan {
+		Scan() : end(0), records(0) {}
+
+		/* the first few record starts of the chain */
+		vector<size_t> starts;
+
+		/* the first record start at or after the chunk end */
+		size_t end;
+
+		/* records in the chain */
+		uint64_t records;
+	};
+
+	/* load_index(): reads "<file>.idx" if it exists and matches. */
+	void load_index() {
+		ifstream fin(_filename + ".idx", ios::binary);
+		if (!fin.good()) return;
+		TxIndexHeader header;
+		fin.read(reinterpret_cast<char*>(&header), sizeof(header));
+		if (!fin.good() || memcmp(header.magic, kTxIndexMagic,
+					  sizeof(header.magic))
+		    || header.records != _records || !header.stride) {
+			Logger::error("(txfile) ignoring bad index for %",
+				      _filename);
+			return;
+		}
+		_index.resize((_records + header.stride - 1) / header.stride);
+		fin.read(reinterpret_cast<char*>(_index.data()),
+			 _index.size() * sizeof(uint64_t));
+		assert(fin.good());
+		/* an index of no records has no offsets, so seek() and
+		 * split() go without one */
+		if (!_index.empty()) _stride = header.stride;
+	}
+
+	/* parse_binary(): parse() for the binary format. */
+	bool parse_binary(size_t* pos, TxRecord* record) const {
+		assert(pos);
+		assert(record);
+		size_t p = *pos;
+		uint32_t len;
+		if (!get(&p, _size, &len)) return false;
+		if (len > _size - p) return false;
+		size_t end = p + len;
+
+		uint16_t count;
+		if (!get(&p, end, &count)) return false;
+		record->addresses.clear();
+		for (uint16_t i = 0; i < count; ++i) {
+			uint8_t addr_len;
+			if (!get(&p, end, &addr_len)) return false;
+			if (addr_len > end - p) return false;
+			record->addresses.push_back(
+				string_view(_data + p, addr_len));
+			p += addr_len;
+		}
+		uint32_t length;
+		if (!get(&p, end, &length)) return false;
+		if (length != end - p) return false;
+		record->data = string_view(_data + p, length);
+		*pos = end;
+		return true;
+	}
+
+	/* skip_binary(): advances *@pos over one binary record using only
+	 * its length field.
+	 */
+	bool skip_binary(size_t* pos) const {
+		size_t p = *pos;
+		uint32_t len;
+		if (!get(&p, _size, &len)) return false;
+		if (len > _size - p) return false;
+		*pos = p + len;
+		return true;
+	}
+
+	/* get(): reads a @T at *@pos if it fits before @end. */
+	template <typename T>
+	bool get(size_t* pos, size_t end, T* out) const {
+		if (*pos > end || end - *pos < sizeof(T)) return false;
+		memcpy(out, _data + *pos, sizeof(T));
+		*pos += sizeof(T);
+		return true;
+	}
+
+	/* split_indexed(): split() for a binary file with an index, which
+	 * needs no scanning at all.
+	 */
+	vector<TxChunk> split_indexed(size_t threads) const {
+		vector<TxChunk> chunks;
+		uint64_t prev = 0;
+		for (size_t t = 1; t <= threads; ++t) {
+			uint64_t next = _records * t / threads;
+			next -= next % _stride;
+			if (t == threads) next = _records;
+			if (next == prev) continue;
+			TxChunk chunk;
+			chunk.begin = prev ? _index[prev / _stride] : _begin;
+			chunk.end = next == _records ? _size
+				: _index[next / _stride];
+			chunk.records = next - prev;
+			chunks.push_back(chunk);
+			prev = next;
+		}
+		return chunks;
+	}
+
+	/* split_binary(): split() for a binary file without an index. It
+	 * hops from record to record reading only the length fields.
+	 */
+	vector<TxChunk> split_binary(size_t threads) const {
+		vector<TxChunk> chunks;
+		size_t pos = _begin;
+		uint64_t records = 0;
+		for (size_t t = 1; t <= threads; ++t) {
+			size_t nominal = (uint64_t) _size * t / threads;
+			TxChunk chunk;
+			chunk.begin = pos;
+			chunk.records = 0;
+			while (pos < nominal) {
+				bool ok = skip_binary(&pos);
+				assert(ok);
+				++chunk.records;
+			}
+			chunk.end = pos;
+			records += chunk.records;
+			if (chunk.records) chunks.push_back(chunk);
+		}
+		assert(records == _records);
+		return chunks;
+	}
+
+	/* parse_text(): parse() for the text format. */
+	bool parse_text(size_t* pos, TxRecord* record) const {
+		assert(pos);
+		assert(record);
+		size_t p = skip_space(*pos);
+		uint64_t count;
+		if (!parse_number(&p, &count)) return false;
+
+		record->addresses.clear();
+		for (uint64_t i = 0; i < count; ++i) {
+			p = skip_space(p);
+			size_t start = p;
+			while (p < _size && !is_space(_data[p])) ++p;
+			if (p == start) return false;
+			record->addresses.push_back(
+				string_view(_data + start, p - start));
+		}
+
+		uint64_t length;
+		p = skip_space(p);
+		if (!parse_number(&p, &length)) return false;
+		if (p >= _size || _data[p] != '\n') return false;
+		++p;
+		if (length >= _size - p) return false;
+		record->data = string_view(_data + p, length);
+		p += length;
+		if (_data[p] != '\n') return false;
+		*pos = p + 1;
+		return true;
+	}
+
+	/* split_text(): split() for the text format, see above. */
+	vector<TxChunk> split_text(size_t threads) const {
+		vector<size_t> nominal(threads + 1);
+		for (size_t t = 0; t <= threads; ++t) {
+			nominal[t] = (uint64_t) _size * t / threads;
+		}
+
+		vector<Scan> scans(threads);
+		vector<thread> workers;
+		for (size_t t = 0; t < threads; ++t) {
+			workers.push_back(thread([this, t, &nominal, &scans]() {
+				scan(nominal[t], nominal[t + 1], t == 0,
+				     &scans[t]);
+			}));
+		}
+		for (auto &x : workers) x.join();
+
+		vector<TxChunk> chunks;
+		size_t pos = 0;
+		for (size_t t = 0; t < threads; ++t) {
+			TxChunk chunk;
+			chunk.begin = pos;
+			chunk.records = 0;
+			const Scan& guess = scans[t];
+
+			/* parse from the verified position until it meets one
+			 * of the guessed record starts or leaves the chunk */
+			size_t i = 0;
+			while (pos < nominal[t + 1]) {
+				while (i < guess.starts.size()
+				       && guess.starts[i] < pos) ++i;
+				if (i < guess.starts.size()
+				    && guess.starts[i] == pos) {
+					chunk.records += guess.records - i;
+					pos = guess.end;
+					break;
+				}
+				TxRecord record;
+				if (!parse(&pos, &record)) {
+					assert(at_end(pos));
+					pos = _size;
+					break;
+				}
+				++chunk.records;
+			}
+			chunk.end = pos;
+			if (chunk.records) chunks.push_back(chunk);
+		}
+		assert(at_end(pos));
+		if (!chunks.empty()) chunks.back().end = _size;
+		return chunks;
+	}
+
+	/* scan(): finds a plausible record start in [@begin, @end) and parses
+	 * records from it until reaching @end. If @exact, @begin is known to
+	 * be a record start.
+	 */
+	void scan(size_t begin, size_t end, bool exact, Scan* out) const {
+		size_t pos = begin;
+		TxRecord record;
+		while (!exact && pos < end) {
+			/* a record starts after a newline and is followed by
+			 * another record or the end of the file */
+			while (pos < end && pos && _data[pos - 1] != '\n') ++pos;
+			size_t p = pos;
+			if (pos < end && parse(&p, &record) &&
+			    (at_end(p) || parse(&p, &record))) break;
+			++pos;
+		}
+		while (pos < end) {
+			size_t start = pos;
+			if (!parse(&pos, &record)) break;
+			if (out->starts.size() < kMaxSync) {
+				out->starts.push_back(start);
+			}
+			++out->records;
+		}
+		out->end = pos;
+	}
+
+	static bool is_space(char c) {
+		return c == ' ' || c == '\n' || c == '\t' || c == '\r'
+			|| c == '\v' || c == '\f';
+	}
+
+	size_t skip_space(size_t pos) const {
+		while (pos < _size && is_space(_data[pos])) ++pos;
+		return pos;
+	}
+
+	/* parse_number(): parses a decimal number at *@pos. */
+	bool parse_number(size_t* pos, uint64_t* out) const {
+		size_t p = *pos;
+		uint64_t val = 0;
+		while (p < _size && _data[p] >= '0' && _data[p] <= '9') {
+			if (p - *pos >= 19) return false;
+			val = 10 * val + (_data[p] - '0');
+			++p;
+		}
+		if (p == *pos) return false;
+		*out = val;
+		*pos = p;
+		return true;
+	}
+
+	// Prohibit copy
+	TxFileReader(const TxFileReader& copy) {}
+
+	string _filename;
+	int _fd;
+	size_t _size;
+	const char* _data;
+
+	/* true for the binary format */
+	bool _binary;
+
+	/* offset of the first record */
+	size_t _begin;
+
+	/* number of records in a binary file */
+	uint64_t _records;
+
+	/* every how many records _index has an offset, or 0 if no index */
+	uint32_t _stride;
+	vector<uint64_t> _index;
+};
+
+}  // namespace btpir
+
+#endif  // __BTPIR__BUILD_DATABASE__TX_FILE_READER__H__
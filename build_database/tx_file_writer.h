@@ -0,0 +1,169 @@
+/*
+   Copyright 2016, Joel Reardon, UC Berkeley
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef __BTPIR__BUILD_DATABASE__TX_FILE_WRITER__H__
+#define __BTPIR__BUILD_DATABASE__TX_FILE_WRITER__H__
+
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "ib/logger.h"
+#include "build_database/tx_file_format.h"
+
+using namespace std;
+using namespace ib;
+
+namespace btpir {
+
+/* TxFileWriter writes transactions in the binary TX_FILE format described in
+ * tx_file_format.h, and optionally the record-offset index next to it.
+ */
+class TxFileWriter {
+public:
+	/* Creates the binary TX_FILE @filename.
+	 * @index_stride: if nonzero, the offset of every @index_stride-th
+	 * record is written to "@filename.idx" when the file is closed.
+	 */
+	TxFileWriter(const string& filename, uint32_t index_stride)
+		: _filename(filename), _index_stride(index_stride),
+		  _records(0), _offset(0) {
+		_fout.reset(new ofstream(_filename, ios::binary | ios::trunc));
+		assert(_fout->good());
+		TxFileHeader header = make_header();
+		_fout->write(reinterpret_cast<const char*>(&header),
+			     sizeof(header));
+		_offset = sizeof(header);
+	}
+
+	virtual ~TxFileWriter() {
+		close();
+	}
+
+	/* write(): appends the transaction @data, which involves the
+	 * addresses @addresses, as the next record.
+	 */
+	virtual void write(const vector<string_view>& addresses,
+			   string_view data) {
+		assert(_fout);
+		assert(addresses.size() <= UINT16_MAX);
+		assert(data.length() <= UINT32_MAX);
+		uint64_t len = sizeof(uint16_t) + sizeof(uint32_t)
+			+ data.length();
+		for (auto &x : addresses) {
+			assert(x.length() <= UINT8_MAX);
+			len += 1 + x.length();
+		}
+		assert(len <= UINT32_MAX);
+
+		if (_index_stride && !(_records % _index_stride)) {
+			_index.push_back(_offset);
+		}
+		put<uint32_t>(len);
+		put<uint16_t>(addresses.size());
+		for (auto &x : addresses) {
+			put<uint8_t>(x.length());
+			_fout->write(x.data(), x.length());
+		}
+		put<uint32_t>(data.length());
+		_fout->write(data.data(), data.length());
+		assert(_fout->good());
+
+		_offset += sizeof(uint32_t) + len;
+		++_records;
+	}
+
+	/* close(): records the number of records in the header and writes
+	 * the index.
+	 */
+	virtual void close() {
+		if (!_fout) return;
+		TxFileHeader header = make_header();
+		_fout->seekp(0);
+		_fout->write(reinterpret_cast<const char*>(&header),
+			     sizeof(header));
+		_fout->close();
+		assert(_fout->good());
+		_fout.reset(nullptr);
+		if (_index_stride) write_index();
+		Logger::info("(txfile) wrote % records (% B) to %",
+			     _records, _offset, _filename);
+	}
+
+	/* Returns the number of records written. */
+	virtual uint64_t records() const {
+		return _records;
+	}
+
+protected:
+	TxFileHeader make_header() const {
+		TxFileHeader header;
+		memcpy(header.magic, kTxFileMagic, sizeof(header.magic));
+		header.version = kTxFileVersion;
+		header.flags = 0;
+		header.records = _records;
+		return header;
+	}
+
+	/* write_index(): writes the offsets of every _index_stride-th
+	 * record to the index file.
+	 */
+	void write_index() {
+		ofstream fout(_filename + ".idx", ios::binary | ios::trunc);
+		assert(fout.good());
+		TxIndexHeader header;
+		memcpy(header.magic, kTxIndexMagic, sizeof(header.magic));
+		header.version = kTxFileVersion;
+		header.stride = _index_stride;
+		header.records = _records;
+		fout.write(reinterpret_cast<const char*>(&header),
+			   sizeof(header));
+		fout.write(reinterpret_cast<const char*>(_index.data()),
+			   _index.size() * sizeof(uint64_t));
+		assert(fout.good());
+	}
+
+	template <typename T>
+	void put(T val) {
+		_fout->write(reinterpret_cast<const char*>(&val), sizeof(val));
+	}
+
+	// Prohibit copy
+	TxFileWriter(const TxFileWriter& copy) {}
+
+	string _filename;
+	unique_ptr<ofstream> _fout;
+
+	/* every how many records an offset is indexed, or 0 for none */
+	uint32_t _index_stride;
+
+	/* offsets of every _index_stride-th record */
+	vector<uint64_t> _index;
+
+	uint64_t _records;
+
+	/* the offset of the next record */
+	uint64_t _offset;
+};
+
+}  // namespace btpir
+
+#endif  // __BTPIR__BUILD_DATABASE__TX_FILE_WRITER__H__
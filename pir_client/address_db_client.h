@@ -0,0 +1,313 @@
+/*
+   Copyright 2016, Joel Reardon, UC Berkeley
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef __BTPIR__PIR_CLIENT__ADDRESS_DB_CLIENT__H__
+#define __BTPIR__PIR_CLIENT__ADDRESS_DB_CLIENT__H__
+
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "build_database/block_list_codec.h"
+#include "build_database/pir_geometry.h"
+#include "ib/logger.h"
+#include "pir_client/address_manifest.h"
+
+using namespace std;
+using namespace ib;
+
+namespace btpir {
+
+/* BlockFetcher returns block @i of a database, e.g., by PIR. The last block
+ * may be short.
+ */
+typedef function<string(uint64_t)> BlockFetcher;
+
+/* AddressDBClient finds the main database blocks of an address in one of
+ * the address databases, given its manifest. The manifest says which block
+ * to start from, and the blocks are fetched from there on until the
+ * address's entry is read or passed, which is usually one block.
+ *
+ * Every entry starts with the 35-byte address, and the entries are in the
+ * order of the manifest. In format 1 (auto_deliminated_pir_database.h) each
+ * block is one entry, the address and a bitmap of the main database blocks.
+ * In formats 2 and 3 (deliminated_pir_database.h) the entries run on across
+ * blocks. Each block starts with a 4-byte count of the bytes left of the
+ * entry that runs into it. If that leaves no room for another address in
+ * the block, the running entry's address is repeated after the count. A
+ * format 2 entry goes on with a 4-byte count and then the 4-byte blocks,
+ * and a format 3 entry with a varint list (block_list_codec.h).
+ */
+class AddressDBClient {
+public:
+	/* bytes in an address, as the databases are built */
+	static const size_t kAddressLen = 35;
+
+	/* Loads the manifest @manifest_file, text or binary, whose name, like
+	 * the database file's, gives the format and blocksize.
+	 */
+	AddressDBClient(const string& manifest_file)
+		: _format(0), _blocksize(0), _manifest(manifest_file) {
+		size_t at = manifest_file.rfind(".fmt");
+		if (at != string::npos && at + 4 < manifest_file.length()) {
+			_format = manifest_file[at + 4] - '0';
+		}
+		at = manifest_file.rfind(".manifest");
+		if (at != string::npos) {
+			_blocksize = PIRGeometry::parse_blocksize(
+				manifest_file.substr(0, at));
+		}
+		if (_format < 1 || _format > 3 || !_blocksize) {
+			Logger::error("(client) % is not an address database "
+				      "manifest", manifest_file);
+			assert(0);
+		}
+	}
+
+	/* Returns the address database format: 1, 2 or 3. */
+	int format() const {
+		return _format;
+	}
+
+	/* Returns the bytes in a block. */
+	uint64_t blocksize() const {
+		return _blocksize;
+	}
+
+	/* Returns the blocks in the database. Format 1 has a manifest line
+	 * for every block; the others have one for every boundary.
+	 */
+	uint64_t blocks() const {
+		return _format == 1 ? _manifest.size() : _manifest.size() + 1;
+	}
+
+	/* Returns the manifest. */
+	const AddressManifest& manifest() const {
+		return _manifest;
+	}
+
+	/* first_block(): returns the block to start looking for @address
+	 * from. Every boundary the manifest puts before it is one its entry
+	 * comes after.
+	 */
+	uint64_t first_block(const string& address) const {
+		return _manifest.lower_bound(address);
+	}
+
+	/* lookup(): sets @blocks to the main database blocks of @address,
+	 * fetching the address database's blocks with @fetch, and returns
+	 * true, or returns false if the address is not listed.
+	 */
+	bool lookup(const string& address, const BlockFetcher& fetch,
+		    vector<uint32_t>* blocks) const {
+		assert(address.length() == kAddressLen);
+		assert(blocks);
+		if (_format == 1) return lookup_bitmap(address, fetch, blocks);
+
+		EntryStream stream(fetch, _blocksize, this->blocks(),
+				   first_block(address));
+		string entry;
+		while (stream.read(kAddressLen, &entry)) {
+			if (entry == string(kAddressLen, 0)) return false;
+			int cmp = compare(entry, address);
+			if (cmp > 0) return false;
+			string list;
+			if (!read_list(&stream, &list)) return false;
+			if (cmp) continue;
+			return decode_list(list, blocks);
+		}
+		return false;
+	}
+
+	/* compare(): compares addresses @a and @b in the order of the
+	 * databases: by short address, then by the whole address.
+	 */
+	static int compare(const string& a, const string& b) {
+		size_t n = AddressManifest::kShortLen;
+		assert(a.length() >= n && b.length() >= n);
+		int cmp = memcmp(a.data() + a.length() - n,
+				 b.data() + b.length() - n, n);
+		if (cmp) return cmp;
+		return a.compare(b);
+	}
+
+protected:
+	/* EntryStream reads the entries of a format 2 or 3 database from a
+	 * block on, skipping the counts and repeated addresses at the start
+	 * of each block.
+	 */
+	class EntryStream {
+	public:
+		/* Starts at the first entry that starts in block @block. */
+		EntryStream(const BlockFetcher& fetch, uint64_t blocksize,
+			    uint64_t blocks, uint64_t block)
+			: _fetch(fetch), _blocksize(blocksize),
+			  _blocks(blocks), _block(block), _pos(0) {
+			while (load(_block)) {
+				uint64_t start = _pos + remaining();
+				if (start < _blocksize) {
+					_pos = start;
+					return;
+				}
+				++_block;
+			}
+			/* past the end: every read fails */
+			_pos = _blocksize;
+		}
+
+		/* read(): appends the next @len bytes to @out, which is
+		 * cleared first. Returns false if the database ends first.
+		 */
+		bool read(size_t len, string* out) {
+			out->clear();
+			return append(len, out);
+		}
+
+		/* append(): as read(), without clearing @out. */
+		bool append(size_t len, string* out) {
+			while (len) {
+				if (_pos == _blocksize) {
+					if (!load(_block + 1)) return false;
+				}
+				size_t n = min(len, (size_t) (_blocksize - _pos));
+				out->append(_data, _pos, n);
+				_pos += n;
+				len -= n;
+			}
+			return true;
+		}
+
+	protected:
+		/* load(): fetches block @block and moves past its count and
+		 * any repeated address. Returns false past the last block.
+		 */
+		bool load(uint64_t block) {
+			if (block >= _blocks) return false;
+			_block = block;
+			_data = _fetch(block);
+			_data.resize(_blocksize, 0);
+			_pos = sizeof(uint32_t);
+			if (remaining() > _blocksize - sizeof(uint32_t)
+			    - kAddressLen) {
+				_pos += kAddressLen;
+			}
+			return true;
+		}
+
+		/* remaining(): returns the count at the start of the block. */
+		uint32_t remaining() const {
+			uint32_t ret;
+			memcpy(&ret, _data.data(), sizeof(ret));
+			return ret;
+		}
+
+		const BlockFetcher& _fetch;
+		uint64_t _blocksize;
+		uint64_t _blocks;
+
+		/* the block in _data and the position in it */
+		uint64_t _block;
+		string _data;
+		uint64_t _pos;
+	};
+
+	/* lookup_bitmap(): lookup() for format 1. */
+	bool lookup_bitmap(const string& address, const BlockFetcher& fetch,
+			   vector<uint32_t>* blocks) const {
+		for (uint64_t b = first_block(address); b < this->blocks(); ++b) {
+			string data = fetch(b);
+			data.resize(_blocksize, 0);
+			int cmp = compare(data.substr(0, kAddressLen), address);
+			if (cmp > 0) return false;
+			if (cmp) continue;
+			blocks->clear();
+			const uint8_t* bitmap = reinterpret_cast<const uint8_t*>(
+				data.data()) + kAddressLen;
+			for (uint64_t i = 0; i < _blocksize - kAddressLen; ++i) {
+				for (int j = 0; j < 8; ++j) {
+					if (bitmap[i] & (0x80 >> j)) {
+						blocks->push_back(8 * i + j);
+					}
+				}
+			}
+			return true;
+		}
+		return false;
+	}
+
+	/* read_list(): sets @list to the block list of the entry whose
+	 * address was just read from @stream. Returns false if the database
+	 * ends first.
+	 */
+	bool read_list(EntryStream* stream, string* list) const {
+		if (_format == 2) {
+			if (!stream->read(sizeof(uint32_t), list)) return false;
+			uint32_t count;
+			memcpy(&count, list->data(), sizeof(count));
+			return stream->append(count * sizeof(uint32_t), list);
+		}
+		list->clear();
+		if (!append_varint(stream, list)) return false;
+		uint32_t count = 0;
+		read_varint(reinterpret_cast<const uint8_t*>(list->data()),
+			    list->length(), &count);
+		for (uint32_t i = 0; i < count; ++i) {
+			if (!append_varint(stream, list)) return false;
+		}
+		return true;
+	}
+
+	/* append_varint(): appends the bytes of the next varint in @stream to
+	 * @out. Returns false if the database ends first or the varint is
+	 * too long.
+	 */
+	static bool append_varint(EntryStream* stream, string* out) {
+		for (int i = 0; i < 5; ++i) {
+			if (!stream->append(1, out)) return false;
+			if (!(out->back() & 0x80)) return true;
+		}
+		return false;
+	}
+
+	/* decode_list(): sets @blocks to the blocks in the format 2 or 3
+	 * @list. Returns false if it is malformed.
+	 */
+	bool decode_list(const string& list, vector<uint32_t>* blocks) const {
+		const uint8_t* in = reinterpret_cast<const uint8_t*>(
+			list.data());
+		if (_format == 3) {
+			return decode_block_list(in, list.length(), blocks)
+				== list.length();
+		}
+		uint32_t count;
+		memcpy(&count, in, sizeof(count));
+		blocks->resize(count);
+		memcpy(blocks->data(), in + sizeof(count),
+		       count * sizeof(uint32_t));
+		return true;
+	}
+
+	int _format;
+	uint64_t _blocksize;
+	AddressManifest _manifest;
+};
+
+}  // namespace btpir
+
+#endif  // __BTPIR__PIR_CLIENT__ADDRESS_DB_CLIENT__H__
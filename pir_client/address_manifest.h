@@ -0,0 +1,295 @@
+/*
+   Copyright 2016, Joel Reardon, UC Berkeley
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef __BTPIR__PIR_CLIENT__ADDRESS_MANIFEST__H__
+#define __BTPIR__PIR_CLIENT__ADDRESS_MANIFEST__H__
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "build_database/binary_manifest.h"
+#include "ib/logger.h"
+
+using namespace std;
+using namespace ib;
+
+namespace btpir {
+
+/* AddressManifest holds the manifest of an address database: for each PIR
+ * block boundary, the address whose entry is current there (see
+ * pir_database_manifest_base.h). The addresses are in the order of their
+ * short addresses, the last kShortLen bytes, which is the order the
+ * databases list them in, so searching the manifest for an address gives
+ * the block where its entry is.
+ *
+ * Only the short addresses are kept, back to back. Short addresses are
+ * hashes and so close to uniform, which makes interpolation search on their
+ * first eight bytes take about log log n probes rather than log n. Since
+ * nothing guarantees the spread, it gives way to binary search after a few
+ * steps. A binary manifest (binary_manifest.h) is mapped rather than read,
+ * and its prefix index narrows the search before it starts.
+ */
+class AddressManifest {
+public:
+	/* bytes of an address that form its short address */
+	static const size_t kShortLen = kBinaryManifestShortLen;
+
+	AddressManifest() : _data(nullptr), _size(0), _index(nullptr),
+			    _index_bits(0), _map(nullptr), _map_len(0) {}
+
+	/* Loads the manifest in @filename: a binary manifest, or a text one
+	 * with one address per line.
+	 */
+	AddressManifest(const string& filename) : AddressManifest() {
+		if (map_binary(filename)) return;
+		ifstream fin(filename);
+		if (!fin.good()) {
+			Logger::error("(manifest) cannot read %", filename);
+			assert(0);
+		}
+		string line;
+		while (getline(fin, line)) add(line);
+	}
+
+	virtual ~AddressManifest() {
+		if (_map) munmap(_map, _map_len);
+	}
+
+	/* reserve(): makes room for @count short addresses, so that adding
+	 * them never copies the ones already added.
+	 */
+	void reserve(uint64_t count) {
+		assert(!_map);
+		_shorts.reserve(count * kShortLen);
+	}
+
+	/* add(): appends @address, which must not sort before the last one
+	 * added.
+	 */
+	void add(const string& address) {
+		assert(!_map);
+		assert(address.length() >= kShortLen);
+		const char* s = address.data() + address.length() - kShortLen;
+		assert(!_size || memcmp(short_at(_size - 1), s, kShortLen) <= 0);
+		_shorts.append(s, kShortLen);
+		_data = _shorts.data();
+		++_size;
+	}
+
+	/* Returns whether the manifest is a mapped binary one. */
+	bool mapped() const {
+		return _map != nullptr;
+	}
+
+	/* Returns the number of addresses. */
+	uint64_t size() const {
+		return _size;
+	}
+
+	/* short_address(): returns the short address of entry @i. */
+	string short_address(uint64_t i) const {
+		assert(i < _size);
+		return string(short_at(i), kShortLen);
+	}
+
+	/* lower_bound(): returns the number of entries whose short address
+	 * sorts before that of @address.
+	 */
+	uint64_t lower_bound(const string& address) const {
+		return search(address, nullptr);
+	}
+
+	/* lower_bound(): as above, and adds the entries compared to @probes.
+	 */
+	uint64_t lower_bound(const string& address, uint64_t* probes) const {
+		return search(address, probes);
+	}
+
+	/* binary_lower_bound(): as lower_bound(), by binary search alone, for
+	 * comparison.
+	 */
+	uint64_t binary_lower_bound(const string& address,
+				    uint64_t* probes = nullptr) const {
+		const char* s = short_of(address);
+		return binary(s, 0, _size, probes);
+	}
+
+protected:
+	/* Interpolation steps before giving way to binary search. */
+	static const int kInterpolationSteps = 6;
+
+	/* Below this many entries, binary search is as quick. */
+	static const uint64_t kInterpolationMin = 64;
+
+	/* short_of(): returns the short address at the end of @address. */
+	static const char* short_of(const string& address) {
+		assert(address.length() >= kShortLen);
+		return address.data() + address.length() - kShortLen;
+	}
+
+	/* short_at(): returns the short address of entry @i. */
+	const char* short_at(uint64_t i) const {
+		return _data + i * kShortLen;
+	}
+
+	/* map_binary(): maps @filename and returns true if it is a binary
+	 * manifest, or returns false.
+	 */
+	bool map_binary(const string& filename) {
+		int fd = open(filename.c_str(), O_RDONLY);
+		if (fd < 0) return false;
+		struct stat st;
+		BinaryManifestHeader header;
+		if (fstat(fd, &st) || (size_t) st.st_size < sizeof(header)
+		    || pread(fd, &header, sizeof(header), 0)
+		    != (ssize_t) sizeof(header)
+		    || memcmp(header.magic, kBinaryManifestMagic,
+			      sizeof(header.magic))) {
+			close(fd);
+			return false;
+		}
+		uint64_t index_len = ((1ULL << header.index_bits) + 1)
+			* sizeof(uint32_t);
+		if (header.version != kBinaryManifestVersion
+		    || header.short_len != kShortLen
+		    || header.index_bits > BinaryManifestWriter::kMaxIndexBits
+		    || (uint64_t) st.st_size != sizeof(header)
+		    + header.entries * kShortLen + index_len) {
+			Logger::error("(manifest) % is malformed", filename);
+			assert(0);
+		}
+		_map_len = st.st_size;
+		_map = mmap(nullptr, _map_len, PROT_READ, MAP_PRIVATE, fd, 0);
+		close(fd);
+		assert(_map != MAP_FAILED);
+		_data = reinterpret_cast<const char*>(_map) + sizeof(header);
+		_size = header.entries;
+		_index = reinterpret_cast<const uint32_t*>(
+			_data + _size * kShortLen);
+		_index_bits = header.index_bits;
+		return true;
+	}
+
+	/* key(): returns the first eight bytes at @s as a big endian number,
+	 * so that keys compare like the bytes.
+	 */
+	static uint64_t key(const char* s) {
+		uint64_t ret;
+		memcpy(&ret, s, sizeof(ret));
+		return __builtin_bswap64(ret);
+	}
+
+	/* search(): returns the lower bound of @address. Each step probes
+	 * where interpolation puts it, and then a guard about sqrt(range)
+	 * past that on the far side; if the data is spread evenly, the guard
+	 * holds and the range shrinks to about its square root.
+	 */
+	uint64_t search(const string& address, uint64_t* probes) const {
+		const char* s = short_of(address);
+		uint64_t k = key(s);
+		/* the answer is in [lo, hi] */
+		uint64_t lo = 0, hi = _size;
+		if (_index) {
+			uint32_t p = BinaryManifestWriter::prefix(s, _index_bits);
+			lo = _index[p];
+			hi = _index[p + 1];
+			if (lo == hi) return lo;
+		}
+		for (int step = 0; step < kInterpolationSteps
+			     && hi - lo > kInterpolationMin; ++step) {
+			uint64_t klo = key(short_at(lo));
+			uint64_t khi = key(short_at(hi - 1));
+			if (k <= klo || k > khi || klo == khi) break;
+			uint64_t at = lo + (uint64_t) ((long double) (k - klo)
+				/ (khi - klo) * (hi - 1 - lo));
+			uint64_t guard = (uint64_t) sqrt((long double) (hi - lo));
+			if (less(at, s, probes)) {
+				lo = at + 1;
+				at = min(hi - 1, at + guard);
+				if (less(at, s, probes)) {
+					lo = at + 1;
+				} else {
+					hi = at;
+				}
+			} else {
+				hi = at;
+				at = at - lo > guard ? at - guard : lo;
+				if (less(at, s, probes)) {
+					lo = at + 1;
+				} else {
+					hi = at;
+				}
+			}
+			if (lo >= hi) break;
+		}
+		return binary(s, lo, hi, probes);
+	}
+
+	/* less(): returns whether entry @i sorts before @s, counting the
+	 * probe in @probes.
+	 */
+	bool less(uint64_t i, const char* s, uint64_t* probes) const {
+		if (probes) ++*probes;
+		return memcmp(short_at(i), s, kShortLen) < 0;
+	}
+
+	/* binary(): returns the first entry in [@lo, @hi) whose short address
+	 * does not sort before @s, or @hi.
+	 */
+	uint64_t binary(const char* s, uint64_t lo, uint64_t hi,
+			uint64_t* probes) const {
+		while (lo < hi) {
+			uint64_t mid = lo + (hi - lo) / 2;
+			if (less(mid, s, probes)) {
+				lo = mid + 1;
+			} else {
+				hi = mid;
+			}
+		}
+		return lo;
+	}
+
+	// Prohibit copy
+	AddressManifest(const AddressManifest& copy) {}
+
+	/* the short addresses, kShortLen bytes each, which are _shorts or
+	 * mapped
+	 */
+	const char* _data;
+	string _shorts;
+	uint64_t _size;
+
+	/* a binary manifest's prefix index and its bits */
+	const uint32_t* _index;
+	uint32_t _index_bits;
+
+	/* the mapping of a binary manifest */
+	void* _map;
+	size_t _map_len;
+};
+
+}  // namespace btpir
+
+#endif  // __BTPIR__PIR_CLIENT__ADDRESS_MANIFEST__H__
@@ -0,0 +1,152 @@
+/*
+   Copyright 2016, Joel Reardon, UC Berkeley
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef __BTPIR__PIR_CLIENT__HASHED_DB_CLIENT__H__
+#define __BTPIR__PIR_CLIENT__HASHED_DB_CLIENT__H__
+
+#include <cassert>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "build_database/block_list_codec.h"
+#include "build_database/hashed_pir_database.h"
+#include "build_database/pir_geometry.h"
+#include "ib/logger.h"
+#include "pir_client/address_db_client.h"
+
+using namespace std;
+using namespace ib;
+
+namespace btpir {
+
+/* HashedDBClient finds the main database blocks of an address in a hashed
+ * address database (hashed_pir_database.h). The parameter file is all it
+ * needs: the blocks to fetch follow from the address, and every lookup
+ * fetches as many, the candidate buckets and then the whole stash.
+ */
+class HashedDBClient {
+public:
+	/* Loads the parameter file @params_file, whose name, like the
+	 * database file's, gives the blocksize.
+	 */
+	HashedDBClient(const string& params_file)
+		: _blocksize(0), _hashes(0), _buckets(0), _stash_blocks(0),
+		  _seed(0) {
+		string suffix = ".params";
+		if (params_file.length() > suffix.length()) {
+			_blocksize = PIRGeometry::parse_blocksize(
+				params_file.substr(0, params_file.length()
+						   - suffix.length()));
+		}
+		ifstream fin(params_file);
+		fin >> _hashes >> _buckets >> _stash_blocks >> _seed;
+		if (!fin || !_blocksize || !_hashes || !_buckets) {
+			Logger::error("(client) % is not a hashed database "
+				      "parameter file", params_file);
+			assert(0);
+		}
+	}
+
+	/* Returns the bytes in a block. */
+	uint64_t blocksize() const {
+		return _blocksize;
+	}
+
+	/* Returns the blocks in the database. */
+	uint64_t blocks() const {
+		return _buckets + _stash_blocks;
+	}
+
+	/* blocks_to_fetch(): returns the blocks a lookup of @address fetches:
+	 * its candidate buckets, which may repeat, and then the stash.
+	 */
+	vector<uint64_t> blocks_to_fetch(const string& address) const {
+		vector<uint64_t> ret;
+		for (uint32_t h = 0; h < _hashes; ++h) {
+			ret.push_back(hashed_bucket(address, h, _seed, _buckets));
+		}
+		for (uint64_t i = 0; i < _stash_blocks; ++i) {
+			ret.push_back(_buckets + i);
+		}
+		return ret;
+	}
+
+	/* lookup(): sets @blocks to the main database blocks of @address,
+	 * fetching the hashed database's blocks with @fetch, and returns
+	 * true, or returns false if the address is not listed.
+	 */
+	bool lookup(const string& address, const BlockFetcher& fetch,
+		    vector<uint32_t>* blocks) const {
+		assert(address.length() == AddressDBClient::kAddressLen);
+		assert(blocks);
+		vector<uint64_t> wanted = blocks_to_fetch(address);
+		vector<string> data;
+		for (auto &x : wanted) {
+			data.push_back(fetch(x));
+			data.back().resize(_blocksize, 0);
+		}
+		bool found = false;
+		for (uint32_t h = 0; h < _hashes && !found; ++h) {
+			found = find(data[h], address, blocks);
+		}
+		if (found) return true;
+		string stash;
+		for (size_t i = _hashes; i < data.size(); ++i) stash += data[i];
+		return find(stash, address, blocks);
+	}
+
+protected:
+	/* find(): looks for the entry of @address among the entries back to
+	 * back in @data, and if it is there sets @blocks to its list and
+	 * returns true. The entries end at the end of @data or at an address
+	 * of zeros.
+	 */
+	static bool find(const string& data, const string& address,
+			 vector<uint32_t>* blocks) {
+		const size_t kAddressLen = AddressDBClient::kAddressLen;
+		const uint8_t* in = reinterpret_cast<const uint8_t*>(
+			data.data());
+		size_t pos = 0;
+		vector<uint32_t> list;
+		while (data.length() - pos > kAddressLen) {
+			if (!data.compare(pos, kAddressLen,
+					  string(kAddressLen, 0))) break;
+			bool match = !data.compare(pos, kAddressLen, address);
+			pos += kAddressLen;
+			size_t used = decode_block_list(
+				in + pos, data.length() - pos, &list);
+			if (!used) return false;
+			pos += used;
+			if (match) {
+				blocks->swap(list);
+				return true;
+			}
+		}
+		return false;
+	}
+
+	uint64_t _blocksize;
+	uint32_t _hashes;
+	uint64_t _buckets;
+	uint64_t _stash_blocks;
+	uint64_t _seed;
+};
+
+}  // namespace btpir
+
+#endif  // __BTPIR__PIR_CLIENT__HASHED_DB_CLIENT__H__
@@ -0,0 +1,92 @@
+#include "pir_client/address_manifest.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "ib/logger.h"
+
+using namespace std;
+using namespace ib;
+using namespace btpir;
+
+/* time_lookups(): looks up each of @addresses in @manifest, by interpolation
+ * or by binary search, and logs the time and probes per lookup. Returns a
+ * checksum of the results, so they are not optimized out.
+ */
+uint64_t time_lookups(const AddressManifest& manifest,
+		      const vector<string>& addresses, bool binary) {
+	uint64_t probes = 0, sum = 0;
+	auto start = chrono::steady_clock::now();
+	for (auto &x : addresses) {
+		sum += binary ? manifest.binary_lower_bound(x, &probes)
+			: manifest.lower_bound(x, &probes);
+	}
+	double secs = chrono::duration<double>(
+		chrono::steady_clock::now() - start).count();
+	uint64_t n = addresses.size();
+	Logger::info("(bench) % search: % ns and % probes per lookup",
+		     binary ? "binary" : "interpolation",
+		     n ? 1e9 * secs / n : 0,
+		     n ? (double) probes / n : 0);
+	return sum;
+}
+
+int main(int argc, char **argv) {
+	if (argc > 3) {
+		Logger::error("usage: % [addresses [lookups]]", argv[0]);
+		Logger::error("Builds a manifest of random short addresses "
+			      "(100 million if not given) and times looking "
+			      "up random addresses in it (1 million if not "
+			      "given), half of them listed, by interpolation "
+			      "and by binary search.");
+		return -1;
+	}
+	uint64_t count = 100000000;
+	if (argc >= 2) count = strtoull(argv[1], nullptr, 10);
+	uint64_t lookups = 1000000;
+	if (argc == 3) lookups = strtoull(argv[2], nullptr, 10);
+
+	mt19937_64 rng(1);
+	AddressManifest manifest;
+	manifest.reserve(count);
+	{
+		/* sorted keys make sorted short addresses */
+		vector<uint64_t> keys(count);
+		for (auto &x : keys) x = rng();
+		sort(keys.begin(), keys.end());
+		string address(AddressManifest::kShortLen, 0);
+		for (auto &x : keys) {
+			uint64_t be = __builtin_bswap64(x);
+			memcpy(&address[0], &be, sizeof(be));
+			for (size_t i = sizeof(be); i < address.length(); ++i) {
+				address[i] = (char) rng();
+			}
+			manifest.add(address);
+		}
+	}
+	Logger::info("(bench) % addresses in the manifest", manifest.size());
+
+	vector<string> addresses;
+	for (uint64_t i = 0; i < lookups; ++i) {
+		string address(AddressManifest::kShortLen, 0);
+		if (i % 2 && count) {
+			address = manifest.short_address(rng() % count);
+		} else {
+			for (auto &x : address) x = (char) rng();
+		}
+		addresses.push_back(address);
+	}
+
+	uint64_t a = time_lookups(manifest, addresses, false);
+	uint64_t b = time_lookups(manifest, addresses, true);
+	if (a != b) {
+		Logger::error("(bench) the searches disagree");
+		return -1;
+	}
+	return 0;
+}
@@ -0,0 +1,369 @@
+/*
+ * =====================================================================================
+   Copyright 2016
+   Joel Reardon, UC Berkeley
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ * =====================================================================================
+*/
+
+#include "pir_client/address_db_client.h"
+#include "pir_client/address_manifest.h"
+#include "pir_client/hashed_db_client.h"
+#include "pir_client/transaction_extractor.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <glob.h>
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+#include "build_database/transaction_processor.h"
+#include "ib/logger.h"
+
+using namespace btpir;
+using namespace ib;
+using namespace std;
+
+string random_address() {
+	static const char kChars[] = "123456789ABCDEFGHJKLMNPQRSTUVWXYZ"
+		"abcdefghijkmnopqrstuvwxyz";
+	string ret(AddressDBClient::kAddressLen, 0);
+	for (auto &x : ret) x = kChars[rand() % (sizeof(kChars) - 1)];
+	return ret;
+}
+
+/* find_file(): returns the one file matching @pattern. */
+string find_file(const string& pattern) {
+	glob_t g;
+	assert(!glob(pattern.c_str(), 0, nullptr, &g));
+	assert(g.gl_pathc == 1);
+	string ret = g.gl_pathv[0];
+	globfree(&g);
+	return ret;
+}
+
+string get_file(const string& name) {
+	ifstream fin(name, ios::binary);
+	stringstream ss;
+	ss << fin.rdbuf();
+	return ss.str();
+}
+
+/* fetcher(): returns a BlockFetcher for the blocks of @data, counting the
+ * blocks fetched in @fetched.
+ */
+BlockFetcher fetcher(const string& data, uint64_t blocksize,
+		     uint64_t* fetched) {
+	return [&data, blocksize, fetched](uint64_t i) {
+		++*fetched;
+		assert(i * blocksize < data.length());
+		return data.substr(i * blocksize, blocksize);
+	};
+}
+
+/* Interpolation and binary search agree, on even and uneven data. */
+void test_manifest() {
+	for (int uneven = 0; uneven < 2; ++uneven) {
+		vector<string> shorts;
+		for (int i = 0; i < 5000; ++i) {
+			string s(AddressManifest::kShortLen, 0);
+			for (auto &x : s) x = (char) rand();
+			/* a clump of near-equal and equal addresses */
+			if (uneven && i % 3) s.replace(0, 12, "clumpclumpcl");
+			if (i % 50 == 0 && !shorts.empty()) s = shorts.back();
+			shorts.push_back(s);
+		}
+		sort(shorts.begin(), shorts.end());
+		AddressManifest manifest;
+		for (auto &x : shorts) manifest.add(x);
+		assert(manifest.size() == shorts.size());
+		string bin_file = "test_pir_client.manifest.bin";
+		{
+			BinaryManifestWriter writer(bin_file);
+			for (auto &x : shorts) writer.add("prefix" + x);
+		}
+		AddressManifest binary(bin_file);
+		assert(binary.mapped());
+		assert(binary.size() == shorts.size());
+		assert(binary.short_address(77) == shorts[77]);
+		for (int i = 0; i < 3000; ++i) {
+			string s = i % 2 ? shorts[rand() % shorts.size()]
+				: string(AddressManifest::kShortLen, 0);
+			if (!(i % 2)) for (auto &x : s) x = (char) rand();
+			if (i % 7 == 0) s = string(20, uneven ? 'c' : '\xff');
+			uint64_t expected = std::lower_bound(
+				shorts.begin(), shorts.end(), s)
+				- shorts.begin();
+			assert(manifest.lower_bound(s) == expected);
+			assert(manifest.binary_lower_bound(s) == expected);
+			/* addresses are looked up by their last bytes */
+			assert(manifest.lower_bound("prefix" + s) == expected);
+			assert(binary.lower_bound(s) == expected);
+			assert(binary.binary_lower_bound(s) == expected);
+		}
+		remove(bin_file.c_str());
+	}
+	AddressManifest empty;
+	assert(empty.lower_bound(string(20, 'a')) == 0);
+
+	/* an empty binary manifest, and the index size */
+	{
+		BinaryManifestWriter writer("test_pir_client.manifest.bin");
+	}
+	AddressManifest binary("test_pir_client.manifest.bin");
+	assert(binary.mapped() && !binary.size());
+	assert(binary.lower_bound(string(20, 'a')) == 0);
+	remove("test_pir_client.manifest.bin");
+	assert(BinaryManifestWriter::index_bits(0) == 0);
+	assert(BinaryManifestWriter::index_bits(1000) == 5);
+	assert(BinaryManifestWriter::index_bits(1ULL << 30) == 16);
+}
+
+/* Builds the databases for random transactions and reads every address's
+ * transactions back through each address database. If @reorder, the
+ * transactions are spilled to disk and reordered for locality.
+ */
+void test_lookup(uint64_t main_blocksize, bool reorder) {
+	/* the databases are written to the current directory */
+	string dir = "test_pir_client_dir";
+	mkdir(dir.c_str(), 0755);
+	assert(!chdir(dir.c_str()));
+	vector<string> addresses;
+	for (int i = 0; i < 300; ++i) addresses.push_back(random_address());
+	map<string, set<string>> txs_of;
+	{
+		TransactionProcessor processor(".", "out");
+		processor.set_main_pir_blocksize(main_blocksize);
+		processor.set_skip_threshold(UINT32_MAX);
+		processor.set_hashed(true);
+		if (reorder) {
+			processor.spill_to_disk();
+			processor.set_reorder(true);
+		}
+		for (int i = 0; i < 2000; ++i) {
+			set<string> in;
+			size_t n = 1 + rand() % 3;
+			while (in.size() < n) {
+				/* a few addresses have many transactions */
+				size_t a = rand() % 4 ? rand() % addresses.size()
+					: rand() % 5;
+				in.insert(addresses[a]);
+			}
+			string tx(1 + rand() % (i % 10 ? 300 : 3000), 0);
+			for (auto &x : tx) x = (char) rand();
+			processor.add_tx(in, tx);
+			for (auto &x : in) txs_of[x].insert(tx);
+		}
+	}
+
+	string main_file = find_file("out_default_blocksize_*.pir");
+	string main_data = get_file(main_file);
+	uint64_t blocksize = PIRGeometry::parse_blocksize(main_file);
+	assert(blocksize == main_blocksize);
+
+	vector<vector<uint32_t>> expected(addresses.size());
+	for (int format = 1; format <= 3; ++format) {
+		string pattern = Logger::stringify("addr_db.fmt%_*.pir",
+						   format);
+		string db_file = find_file(pattern);
+		string db_data = get_file(db_file);
+		AddressDBClient client(db_file + ".manifest");
+		assert(client.format() == format);
+		/* the binary manifest starts every lookup at the same block */
+		AddressDBClient binary(db_file + ".manifest.bin");
+		assert(binary.manifest().mapped());
+		assert(binary.format() == format);
+		assert(binary.blocksize() == client.blocksize());
+		assert(binary.blocks() == client.blocks());
+		for (auto &x : addresses) {
+			assert(binary.first_block(x) == client.first_block(x));
+		}
+		assert(client.blocks() == (db_data.length()
+			+ client.blocksize() - 1) / client.blocksize());
+		uint64_t fetched = 0;
+		BlockFetcher fetch = fetcher(db_data, client.blocksize(),
+					     &fetched);
+
+		for (size_t a = 0; a < addresses.size(); ++a) {
+			vector<uint32_t> blocks;
+			bool found = client.lookup(addresses[a], fetch, &blocks);
+			assert(found == (txs_of.count(addresses[a]) > 0));
+			if (!found) continue;
+			if (format == 1) {
+				expected[a] = blocks;
+			} else {
+				assert(blocks == expected[a]);
+				continue;
+			}
+
+			vector<string> data;
+			for (auto &b : blocks) {
+				data.push_back(main_data.substr(b * blocksize,
+								blocksize));
+			}
+			vector<string> got = extract_transactions(blocks, data,
+								  blocksize);
+			set<string> got_set(got.begin(), got.end());
+			for (auto &x : txs_of[addresses[a]]) {
+				assert(got_set.count(x));
+			}
+		}
+		/* an unknown address is not found */
+		vector<uint32_t> blocks;
+		for (int i = 0; i < 50; ++i) {
+			assert(!client.lookup(random_address(), fetch, &blocks));
+		}
+		Logger::info("(test) fmt%: % blocks fetched for % lookups",
+			     format, fetched, addresses.size() + 50);
+	}
+
+	/* the hashed database gives the same blocks, with every lookup
+	 * fetching the same number of blocks
+	 */
+	string db_file = find_file("addr_db.fmt4_*.pir");
+	string db_data = get_file(db_file);
+	HashedDBClient hashed(db_file + ".params");
+	assert(hashed.blocks() * hashed.blocksize() == db_data.length());
+	uint64_t fetched = 0;
+	BlockFetcher fetch = fetcher(db_data, hashed.blocksize(), &fetched);
+	for (size_t a = 0; a < addresses.size(); ++a) {
+		vector<uint32_t> blocks;
+		bool found = hashed.lookup(addresses[a], fetch, &blocks);
+		assert(found == (txs_of.count(addresses[a]) > 0));
+		if (found) assert(blocks == expected[a]);
+		vector<uint32_t> none;
+		assert(!hashed.lookup(random_address(), fetch, &none));
+	}
+	uint64_t per_lookup = hashed.blocks_to_fetch(addresses[0]).size();
+	assert(fetched == 2 * addresses.size() * per_lookup);
+	Logger::info("(test) fmt4: % blocks fetched per lookup", per_lookup);
+
+	glob_t g;
+	glob("*", 0, nullptr, &g);
+	for (size_t i = 0; i < g.gl_pathc; ++i) remove(g.gl_pathv[i]);
+	globfree(&g);
+	assert(!chdir(".."));
+	rmdir(dir.c_str());
+}
+
+/* Addresses are found in a hashed database whose buckets are crowded, so
+ * that entries are evicted, and with entries too large for any bucket, so
+ * that the stash is used.
+ */
+void test_hashed() {
+	vector<string> addresses, entries;
+	for (int i = 0; i < 2000; ++i) {
+		addresses.push_back(random_address());
+		vector<uint32_t> blocks;
+		size_t n = 1 + (i % 100 ? rand() % 20 : 200 + rand() % 100);
+		for (size_t j = 0; j < n; ++j) {
+			blocks.push_back((blocks.empty() ? 0 : blocks.back())
+					 + 1 + rand() % 1000);
+		}
+		string entry = addresses.back();
+		append_block_list(blocks.data(), blocks.size(), &entry);
+		entries.push_back(entry);
+	}
+	uint64_t stash_entries = 0;
+	{
+		HashedPIRDatabase db(".", "test_hashed.fmt4");
+		db.set_pir_blocksize(300);
+		db.build(addresses, entries);
+		assert(db.buckets() > 0);
+		stash_entries = db.stash_entries();
+		assert(stash_entries >= 20);
+		assert(db.stash_blocks() > 0);
+	}
+	string db_file = find_file("test_hashed.fmt4_*.pir");
+	string db_data = get_file(db_file);
+	HashedDBClient client(db_file + ".params");
+	assert(client.blocksize() == 300);
+	uint64_t fetched = 0;
+	BlockFetcher fetch = fetcher(db_data, client.blocksize(), &fetched);
+	for (size_t i = 0; i < addresses.size(); ++i) {
+		vector<uint32_t> blocks;
+		assert(client.lookup(addresses[i], fetch, &blocks));
+		string entry = addresses[i];
+		append_block_list(blocks.data(), blocks.size(), &entry);
+		assert(entry == entries[i]);
+	}
+	vector<uint32_t> blocks;
+	assert(!client.lookup(random_address(), fetch, &blocks));
+	remove(db_file.c_str());
+	remove((db_file + ".params").c_str());
+}
+
+/* Every transaction in a whole database is extracted, in order. */
+void test_extract() {
+	const uint64_t kBlocksize = 50;
+	string db(4, 0);
+	vector<string> txs;
+	uint32_t block = 0;
+	for (int i = 0; i < 200; ++i) {
+		string tx(1 + rand() % 120, 0);
+		for (auto &x : tx) x = (char) rand();
+		txs.push_back(tx);
+		/* lay it out as TransactionPIRDatabase does */
+		if (kBlocksize - db.length() % kBlocksize < 4) {
+			db.append(kBlocksize - db.length() % kBlocksize, 0);
+			db.append(4, 0);
+			++block;
+		}
+		uint32_t len = tx.length();
+		string entry(reinterpret_cast<const char*>(&len), 4);
+		entry += tx;
+		for (size_t j = 0; j < entry.length(); ++j) {
+			if (db.length() % kBlocksize == 0) {
+				uint32_t left = entry.length() - j;
+				if (j == 0) left = 0;
+				db.append(reinterpret_cast<const char*>(&left),
+					  4);
+			}
+			db.push_back(entry[j]);
+		}
+	}
+	vector<uint32_t> blocks;
+	vector<string> data;
+	for (uint64_t b = 0; b * kBlocksize < db.length(); ++b) {
+		blocks.push_back(b);
+		data.push_back(db.substr(b * kBlocksize, kBlocksize));
+	}
+	assert(extract_transactions(blocks, data, kBlocksize) == txs);
+
+	/* leaving out a block drops the transactions that touch it */
+	blocks.erase(blocks.begin() + 10);
+	data.erase(data.begin() + 10);
+	vector<string> got = extract_transactions(blocks, data, kBlocksize);
+	assert(got.size() < txs.size());
+	for (auto &x : got) assert(find(txs.begin(), txs.end(), x) != txs.end());
+}
+
+int main(int argc, char** argv) {
+	test_manifest();
+	test_extract();
+	test_hashed();
+	test_lookup(64, false);
+	test_lookup(597, false);
+	test_lookup(597, true);
+	Logger::info("test_pir_client passed");
+}
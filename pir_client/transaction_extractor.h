@@ -0,0 +1,112 @@
+/*
+   Copyright 2016, Joel Reardon, UC Berkeley
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef __BTPIR__PIR_CLIENT__TRANSACTION_EXTRACTOR__H__
+#define __BTPIR__PIR_CLIENT__TRANSACTION_EXTRACTOR__H__
+
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace btpir {
+
+/* extract_transactions(): returns the transactions in the main database
+ * blocks @blocks, in order, whose contents are at the same index of @data.
+ *
+ * The main database (transaction_pir_database.h) holds each transaction as
+ * a 4-byte length and then its data, and these run on across blocks. Each
+ * block starts with a 4-byte count of the bytes left of the transaction
+ * that runs into it. A length is never split between blocks: when fewer
+ * than four bytes are left in a block they are zeros and the next
+ * transaction starts in the next block. A zero length ends the data.
+ *
+ * A transaction is returned if it starts and ends within a run of
+ * consecutive blocks of @blocks, which holds for every transaction of an
+ * address when @blocks is the list its address database gives. Those of
+ * other addresses that share the blocks are returned too.
+ */
+inline vector<string> extract_transactions(const vector<uint32_t>& blocks,
+					   const vector<string>& data,
+					   uint64_t blocksize) {
+	assert(blocks.size() == data.size());
+	const uint64_t kLenLen = sizeof(uint32_t);
+	vector<string> ret;
+	size_t i = 0;
+	while (i < blocks.size()) {
+		/* the run is blocks [i, end) */
+		size_t end = i + 1;
+		while (end < blocks.size() && blocks[end] == blocks[end - 1] + 1)
+			++end;
+
+		string block;
+		auto load = [&](size_t at) {
+			block = data[at];
+			block.resize(blocksize, 0);
+		};
+		auto remaining = [&]() {
+			uint32_t ret;
+			memcpy(&ret, block.data(), sizeof(ret));
+			return (uint64_t) ret;
+		};
+
+		/* find the first transaction that starts in the run */
+		size_t at = i;
+		load(at);
+		uint64_t pos = kLenLen + remaining();
+		while (pos >= blocksize && ++at < end) {
+			load(at);
+			pos = kLenLen + remaining();
+		}
+
+		while (at < end) {
+			if (blocksize - pos < kLenLen) {
+				if (++at == end) break;
+				load(at);
+				pos = kLenLen;
+				continue;
+			}
+			uint32_t len;
+			memcpy(&len, block.data() + pos, sizeof(len));
+			if (!len) break;
+			pos += kLenLen;
+			string tx;
+			tx.reserve(len);
+			while (tx.length() < len) {
+				if (pos == blocksize) {
+					if (++at == end) break;
+					load(at);
+					pos = kLenLen;
+				}
+				uint64_t n = len - tx.length();
+				if (n > blocksize - pos) n = blocksize - pos;
+				tx.append(block, pos, n);
+				pos += n;
+			}
+			if (tx.length() < len) break;
+			ret.push_back(tx);
+		}
+		i = end;
+	}
+	return ret;
+}
+
+}  // namespace btpir
+
+#endif  // __BTPIR__PIR_CLIENT__TRANSACTION_EXTRACTOR__H__
@@ -0,0 +1,224 @@
+/*
+   Copyright 2016, Joel Reardon, UC Berkeley
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef __BTPIR__PIR_SERVER__HINT_PIR__H__
+#define __BTPIR__PIR_SERVER__HINT_PIR__H__
+
+#include <cassert>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+#include "build_database/pir_hints.h"
+#include "ib/logger.h"
+
+using namespace std;
+using namespace ib;
+
+namespace btpir {
+
+/* PIRHintClient makes hinted queries (see pir_hints.h) with the hints in a
+ * file written by PIRHintBuilder, and reads the block from their answers.
+ * Each hint is used at most once, ever: the spent ones are kept in a file
+ * next to the hint file, with ".spent" attached, a bit for each hint after
+ * the hint file's id, and each is written there before its query is made.
+ * The hint file must be this client's alone.
+ */
+class PIRHintClient {
+public:
+	/* Loads the sets and hints in @hint_file and the hints spent from
+	 * it.
+	 */
+	PIRHintClient(const string& hint_file) : _left(0), _spent_fd(-1) {
+		FILE* fin = fopen(hint_file.c_str(), "rb");
+		if (!fin) {
+			Logger::error("(hints) cannot read %", hint_file);
+			assert(0);
+		}
+		size_t ret = fread(&_header, sizeof(_header), 1, fin);
+		if (ret != 1 || memcmp(_header.magic, kPIRHintMagic,
+				       sizeof(kPIRHintMagic))
+		    || _header.version != kPIRHintVersion) {
+			Logger::error("(hints) % is not a hint file", hint_file);
+			assert(0);
+		}
+		_layout = PIRHintLayout::for_blocks(_header.blocks);
+		_sets.resize(_header.hints * _layout.chunks);
+		ret = fread(_sets.data(), sizeof(uint32_t), _sets.size(), fin);
+		assert(ret == _sets.size());
+		_parities.resize(_header.hints * _header.blocksize);
+		ret = fread(_parities.data(), 1, _parities.size(), fin);
+		assert(ret == _parities.size());
+		fclose(fin);
+		load_spent(hint_file + ".spent");
+	}
+
+	virtual ~PIRHintClient() {
+		if (_spent_fd >= 0) ::close(_spent_fd);
+	}
+
+	/* Returns the blocks in the database. */
+	uint64_t blocks() const {
+		return _header.blocks;
+	}
+
+	/* Returns the bytes in a block. */
+	uint64_t blocksize() const {
+		return _header.blocksize;
+	}
+
+	/* Returns the hints not yet used. */
+	uint64_t hints_left() const {
+		return _left;
+	}
+
+	/* query(): sets @offsets to a query for block @block and @hint to
+	 * the hint recover() needs to read its answer, and spends that hint.
+	 * Returns false if no unused hint covers the block, in which case a
+	 * linear-scan query is needed.
+	 */
+	bool query(uint64_t block, vector<uint32_t>* offsets, uint64_t* hint) {
+		assert(block < _header.blocks);
+		assert(offsets);
+		assert(hint);
+		uint64_t chunk = block / _layout.chunk_blocks;
+		uint32_t offset = block % _layout.chunk_blocks;
+		for (uint64_t h = 0; h < _header.hints; ++h) {
+			const uint32_t* set = &_sets[h * _layout.chunks];
+			if (_used[h] || set[chunk] != offset) continue;
+			spend(h);
+			offsets->resize(_layout.chunks);
+			_layout.random_offsets(offsets->data());
+			for (uint64_t c = 0; c < _layout.chunks; ++c) {
+				if (c != chunk) (*offsets)[c] = set[c];
+			}
+			*hint = h;
+			return true;
+		}
+		return false;
+	}
+
+	/* recover(): returns block @block from the @parities answering the
+	 * query made with @hint.
+	 */
+	string recover(const string& parities, uint64_t hint,
+		       uint64_t block) const {
+		uint64_t bs = _header.blocksize;
+		assert(parities.length() == _layout.chunks * bs);
+		assert(hint < _header.hints);
+		uint64_t chunk = block / _layout.chunk_blocks;
+		string ret = parities.substr(chunk * bs, bs);
+		const uint8_t* parity = &_parities[hint * bs];
+		for (uint64_t i = 0; i < bs; ++i) ret[i] ^= parity[i];
+		return ret;
+	}
+
+protected:
+	/* load_spent(): reads which hints are spent from @spent_file, or
+	 * starts it with none if it is missing or was kept for another hint
+	 * file.
+	 */
+	void load_spent(const string& spent_file) {
+		_spent_file = spent_file;
+		_spent.assign(sizeof(_header.id) + (_header.hints + 7) / 8, 0);
+		_spent_fd = open(spent_file.c_str(), O_RDWR | O_CREAT, 0600);
+		if (_spent_fd < 0) {
+			Logger::error("(hints) cannot open %", spent_file);
+			assert(0);
+		}
+		ssize_t got = pread(_spent_fd, &_spent[0], _spent.size(), 0);
+		if (got != (ssize_t) _spent.size()
+		    || memcmp(&_spent[0], _header.id, sizeof(_header.id))) {
+			_spent.assign(_spent.size(), 0);
+			memcpy(&_spent[0], _header.id, sizeof(_header.id));
+			bool good = !ftruncate(_spent_fd, 0)
+				&& write_spent(0, _spent.size());
+			if (!good) {
+				Logger::error("(hints) cannot write %",
+					      spent_file);
+				assert(0);
+			}
+		}
+		_used.assign(_header.hints, false);
+		_left = _header.hints;
+		for (uint64_t h = 0; h < _header.hints; ++h) {
+			uint8_t bits = _spent[sizeof(_header.id) + h / 8];
+			if (bits & (1 << (h % 8))) {
+				_used[h] = true;
+				--_left;
+			}
+		}
+	}
+
+	/* spend(): marks hint @h spent, on disk before it is used. */
+	void spend(uint64_t h) {
+		size_t at = sizeof(_header.id) + h / 8;
+		_spent[at] |= 1 << (h % 8);
+		if (!write_spent(at, 1)) {
+			Logger::error("(hints) cannot write %", _spent_file);
+			assert(0);
+		}
+		_used[h] = true;
+		--_left;
+	}
+
+	/* write_spent(): writes @len bytes of _spent from @at to the spent
+	 * file and syncs it. Returns false if that failed.
+	 */
+	bool write_spent(size_t at, size_t len) {
+		const char* data = &_spent[at];
+		while (len) {
+			ssize_t ret = pwrite(_spent_fd, data, len, at);
+			if (ret < 0 && errno == EINTR) continue;
+			if (ret <= 0) return false;
+			data += ret;
+			len -= ret;
+			at += ret;
+		}
+		return !fdatasync(_spent_fd);
+	}
+
+	// Prohibit copy
+	PIRHintClient(const PIRHintClient& copy) {}
+
+	PIRHintHeader _header;
+	PIRHintLayout _layout;
+
+	/* the offset in each chunk of each set */
+	vector<uint32_t> _sets;
+
+	/* the hint of each set */
+	vector<uint8_t> _parities;
+
+	/* which hints have been spent */
+	vector<bool> _used;
+	uint64_t _left;
+
+	/* the spent file, its descriptor, and its contents: the hint
+	   file's id and then a bit for each hint */
+	string _spent_file;
+	int _spent_fd;
+	string _spent;
+};
+
+}  // namespace btpir
+
+#endif  // __BTPIR__PIR_SERVER__HINT_PIR__H__
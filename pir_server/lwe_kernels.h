@@ -0,0 +1,130 @@
+/*
+   Copyright 2016, Joel Reardon, UC Berkeley
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef __BTPIR__PIR_SERVER__LWE_KERNELS__H__
+#define __BTPIR__PIR_SERVER__LWE_KERNELS__H__
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+
+#include "pir_server/xor_kernels.h"
+
+using namespace std;
+
+namespace btpir {
+
+/* The multiply-add kernels are the inner loop of the LWE server: for each of
+ * @count accumulators, acc[k][i] += scalars[k] * in[i] mod 2^32 for the @len
+ * bytes at @in. Each byte is widened to 32 bits once and used for all the
+ * accumulators, so a piece of the database is read once for a batch of
+ * queries. They come in the same instruction sets as the XOR kernels.
+ */
+typedef void (*MulAddFunc)(uint32_t* const* acc, const uint32_t* scalars,
+			   size_t count, const uint8_t* in, size_t len);
+
+/* mul_add_scalar(): the portable kernel. */
+inline void mul_add_scalar(uint32_t* const* acc, const uint32_t* scalars,
+			   size_t count, const uint8_t* in, size_t len) {
+	for (size_t k = 0; k < count; ++k) {
+		uint32_t s = scalars[k];
+		uint32_t* a = acc[k];
+		for (size_t i = 0; i < len; ++i) a[i] += s * in[i];
+	}
+}
+
+#ifdef BTPIR_X86
+/* mul_add_avx2(): 32 bytes at a time, widened into four vectors of eight
+ * 32-bit lanes.
+ */
+__attribute__((target("avx2")))
+inline void mul_add_avx2(uint32_t* const* acc, const uint32_t* scalars,
+			 size_t count, const uint8_t* in, size_t len) {
+	size_t i = 0;
+	for (; i + 32 <= len; i += 32) {
+		__m256i x[4];
+		for (int j = 0; j < 4; ++j) {
+			x[j] = _mm256_cvtepu8_epi32(_mm_loadl_epi64(
+				reinterpret_cast<const __m128i*>(
+					in + i + 8 * j)));
+		}
+		for (size_t k = 0; k < count; ++k) {
+			__m256i s = _mm256_set1_epi32(scalars[k]);
+			__m256i* a = reinterpret_cast<__m256i*>(acc[k] + i);
+			for (int j = 0; j < 4; ++j) {
+				_mm256_storeu_si256(a + j, _mm256_add_epi32(
+					_mm256_loadu_si256(a + j),
+					_mm256_mullo_epi32(x[j], s)));
+			}
+		}
+	}
+	for (size_t k = 0; k < count; ++k) {
+		uint32_t* a = acc[k];
+		for (size_t j = i; j < len; ++j) a[j] += scalars[k] * in[j];
+	}
+}
+
+/* mul_add_avx512(): 64 bytes at a time, widened into four vectors of
+ * sixteen 32-bit lanes.
+ */
+__attribute__((target("avx512f")))
+inline void mul_add_avx512(uint32_t* const* acc, const uint32_t* scalars,
+			   size_t count, const uint8_t* in, size_t len) {
+	size_t i = 0;
+	for (; i + 64 <= len; i += 64) {
+		__m512i x[4];
+		for (int j = 0; j < 4; ++j) {
+			x[j] = _mm512_maskz_cvtepu8_epi32(0xffff,
+				_mm_loadu_si128(reinterpret_cast<const __m128i*>(
+					in + i + 16 * j)));
+		}
+		for (size_t k = 0; k < count; ++k) {
+			__m512i s = _mm512_set1_epi32(scalars[k]);
+			uint32_t* a = acc[k] + i;
+			for (int j = 0; j < 4; ++j) {
+				_mm512_storeu_si512(a + 16 * j, _mm512_add_epi32(
+					_mm512_loadu_si512(a + 16 * j),
+					_mm512_mullo_epi32(x[j], s)));
+			}
+		}
+	}
+	for (size_t k = 0; k < count; ++k) {
+		uint32_t* a = acc[k];
+		for (size_t j = i; j < len; ++j) a[j] += scalars[k] * in[j];
+	}
+}
+#endif
+
+/* mul_add_func(): returns the function for @kernel, which must be
+ * supported.
+ */
+inline MulAddFunc mul_add_func(XORKernel kernel) {
+	assert(kernel_supported(kernel));
+	switch (kernel) {
+#ifdef BTPIR_X86
+	case kAVX2Kernel:
+		return mul_add_avx2;
+	case kAVX512Kernel:
+		return mul_add_avx512;
+#endif
+	default:
+		return mul_add_scalar;
+	}
+}
+
+}  // namespace btpir
+
+#endif  // __BTPIR__PIR_SERVER__LWE_KERNELS__H__
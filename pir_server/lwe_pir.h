@@ -0,0 +1,214 @@
+/*
+   Copyright 2016, Joel Reardon, UC Berkeley
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef __BTPIR__PIR_SERVER__LWE_PIR__H__
+#define __BTPIR__PIR_SERVER__LWE_PIR__H__
+
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <sys/random.h>
+#include <vector>
+
+#include "ib/logger.h"
+
+using namespace std;
+using namespace ib;
+
+namespace btpir {
+
+/* Single-server PIR from learning with errors, after SimplePIR. The database
+ * file is a matrix D over Z_p with p = 256: column j is PIR block j and row r
+ * is byte r of every block, so there are blocksize rows and one column per
+ * block, and a short last block is padded with zeros. Arithmetic is mod
+ * q = 2^32, i.e., on uint32_t.
+ *
+ * A is a public blocks x n matrix over Z_q expanded from a seed. The server
+ * preprocesses the hint H = D A (blocksize x n) once and gives it to clients.
+ * To get block j the client picks a secret s in Z_q^n and sends
+ *	query = A s + e + delta u_j,
+ * where e is small noise, delta = q / p and u_j is the unit vector for j. The
+ * server answers D query, a blocksize vector, and the client computes
+ *	answer - H s = D e + delta D u_j
+ * and rounds each entry to a multiple of delta to read off column j, which is
+ * the block. The query costs 4 bytes per block and the answer 4 bytes per
+ * byte of a block.
+ */
+
+/* the LWE secret dimension */
+static const uint32_t kLWEDimension = 1024;
+
+/* bits of the plaintext modulus p */
+static const uint32_t kLWEPlainBits = 8;
+
+/* q / p, the scale of the selected column in an answer */
+static const uint32_t kLWEDelta = 1U << (32 - kLWEPlainBits);
+
+/* the standard deviation of the noise */
+static const double kLWESigma = 6.4;
+
+/* lwe_max_blocks(): returns the most blocks for which the noise D e stays
+ * below delta / 2 with six standard deviations to spare, for database bytes
+ * as large as they can be.
+ */
+inline uint64_t lwe_max_blocks() {
+	double root = (kLWEDelta / 2) / (6 * kLWESigma * 255);
+	return (uint64_t) (root * root);
+}
+
+/* lwe_matrix(): returns entry (@row, @col) of the public matrix A for
+ * @seed. Each entry is computed on its own, by SplitMix64 of its index, so
+ * the server and clients can expand any part of A without the rest. A is
+ * public, so it needs to look uniform rather than be secret; where the seed
+ * may be chosen by an adversary a cryptographic generator should take the
+ * place of SplitMix64.
+ */
+inline uint32_t lwe_matrix(uint64_t seed, uint64_t row, uint64_t col) {
+	uint64_t z = seed + (row * kLWEDimension + col + 1)
+		* 0x9e3779b97f4a7c15ULL;
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return (uint32_t) ((z ^ (z >> 31)) >> 32);
+}
+
+/* The hint file is an LWEHintHeader followed by H, blocksize rows of n
+ * uint32_t each.
+ */
+struct LWEHintHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t dimension;
+	uint64_t seed;
+	uint64_t blocks;
+	uint64_t blocksize;
+};
+
+static const char kLWEHintMagic[8] = {'B', 'T', 'P', 'I', 'R', 'L', 'W', '1'};
+static const uint32_t kLWEHintVersion = 1;
+
+/* LWEPIRClient makes queries and reads answers with a hint file. */
+class LWEPIRClient {
+public:
+	/* Loads the hint in @hint_file. */
+	LWEPIRClient(const string& hint_file) {
+		FILE* fin = fopen(hint_file.c_str(), "rb");
+		if (!fin) {
+			Logger::error("(lwe) cannot read %", hint_file);
+			assert(0);
+		}
+		size_t ret = fread(&_header, sizeof(_header), 1, fin);
+		if (ret != 1 || memcmp(_header.magic, kLWEHintMagic,
+				       sizeof(kLWEHintMagic))
+		    || _header.version != kLWEHintVersion
+		    || _header.dimension != kLWEDimension) {
+			Logger::error("(lwe) % is not a hint file", hint_file);
+			assert(0);
+		}
+		_hint.resize(_header.blocksize * kLWEDimension);
+		ret = fread(_hint.data(), sizeof(uint32_t), _hint.size(), fin);
+		assert(ret == _hint.size());
+		fclose(fin);
+	}
+
+	/* Returns the blocks in the database. */
+	uint64_t blocks() const {
+		return _header.blocks;
+	}
+
+	/* Returns the bytes in a block. */
+	uint64_t blocksize() const {
+		return _header.blocksize;
+	}
+
+	/* query(): returns a query for block @block, one word per block,
+	 * and sets @secret to what recover() needs to read its answer.
+	 */
+	vector<uint32_t> query(uint64_t block, vector<uint32_t>* secret) const {
+		assert(block < _header.blocks);
+		assert(secret);
+		secret->resize(kLWEDimension);
+		random_bytes(secret->data(), kLWEDimension * sizeof(uint32_t));
+		vector<uint64_t> bits(2 * _header.blocks);
+		random_bytes(bits.data(), bits.size() * sizeof(uint64_t));
+		vector<uint32_t> ret(_header.blocks);
+		for (uint64_t j = 0; j < _header.blocks; ++j) {
+			uint32_t x = noise(bits[2 * j], bits[2 * j + 1]);
+			for (uint32_t c = 0; c < kLWEDimension; ++c) {
+				x += lwe_matrix(_header.seed, j, c)
+					* (*secret)[c];
+			}
+			ret[j] = x;
+		}
+		ret[block] += kLWEDelta;
+		return ret;
+	}
+
+	/* recover(): returns the block from the @answer to the query made
+	 * with @secret.
+	 */
+	string recover(const vector<uint32_t>& answer,
+		       const vector<uint32_t>& secret) const {
+		assert(answer.size() == _header.blocksize);
+		assert(secret.size() == kLWEDimension);
+		string ret(_header.blocksize, 0);
+		for (uint64_t r = 0; r < _header.blocksize; ++r) {
+			const uint32_t* row = &_hint[r * kLWEDimension];
+			uint32_t x = answer[r];
+			for (uint32_t c = 0; c < kLWEDimension; ++c) {
+				x -= row[c] * secret[c];
+			}
+			ret[r] = (char) ((x + kLWEDelta / 2) >> (32 - kLWEPlainBits));
+		}
+		return ret;
+	}
+
+protected:
+	/* random_bytes(): fills @len bytes at @out from the kernel's
+	 * generator.
+	 */
+	static void random_bytes(void* out, size_t len) {
+		uint8_t* p = static_cast<uint8_t*>(out);
+		while (len) {
+			ssize_t ret = getrandom(p, len, 0);
+			assert(ret > 0);
+			p += ret;
+			len -= ret;
+		}
+	}
+
+	/* noise(): returns a sample of the rounded normal distribution with
+	 * standard deviation kLWESigma, mod 2^32, from the random words @a
+	 * and @b.
+	 */
+	static uint32_t noise(uint64_t a, uint64_t b) {
+		double u1 = ((a >> 11) + 1) * (1.0 / 9007199254740993.0);
+		double u2 = (b >> 11) * (1.0 / 9007199254740992.0);
+		double x = sqrt(-2 * log(u1)) * cos(2 * M_PI * u2);
+		return (uint32_t) (int32_t) llround(x * kLWESigma);
+	}
+
+	LWEHintHeader _header;
+
+	/* H, blocksize rows of kLWEDimension words */
+	vector<uint32_t> _hint;
+};
+
+}  // namespace btpir
+
+#endif  // __BTPIR__PIR_SERVER__LWE_PIR__H__
@@ -0,0 +1,299 @@
+/*
+   Copyright 2016, Joel Reardon, UC Berkeley
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef __BTPIR__PIR_SERVER__LWE_PIR_SERVER__H__
+#define __BTPIR__PIR_SERVER__LWE_PIR_SERVER__H__
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "ib/logger.h"
+#include "pir_server/lwe_kernels.h"
+#include "pir_server/lwe_pir.h"
+#include "pir_server/pir_file_server.h"
+
+using namespace std;
+using namespace ib;
+
+namespace btpir {
+
+/* LWEPIRServer answers single-server LWE PIR queries (see lwe_pir.h) against
+ * one database file, and makes the hint file clients need. A query is a word
+ * per block and an answer is a word per byte of a block, the product of the
+ * database matrix and the query.
+ *
+ * Batches are tiled like the XOR server's: for a group of queries, the
+ * database is walked kSelectBlocks blocks at a time and each of those a row
+ * tile at a time, so the group's accumulators for the tile stay in cache and
+ * each byte is widened once for the whole group. With worker threads, each
+ * worker adds into partial answers of its own, which are summed at the end.
+ * Shards are not supported.
+ */
+class LWEPIRServer : public PIRFileServer {
+public:
+	LWEPIRServer(const string& filename, uint64_t blocksize = 0)
+		: PIRFileServer(filename, blocksize, 0),
+		  _mul_add(mul_add_func(_kernel)) {
+		if (_geometry.blocks > lwe_max_blocks()) {
+			Logger::error("(lwe) % blocks is more than the % the "
+				      "noise allows; answers may be wrong",
+				      _geometry.blocks, lwe_max_blocks());
+		}
+	}
+
+	/* Returns the words in a query: one per block. */
+	uint64_t query_words() const {
+		return _geometry.blocks;
+	}
+
+	/* set_kernel(): answers with @kernel, which must be supported. */
+	virtual void set_kernel(XORKernel kernel) {
+		PIRFileServer::set_kernel(kernel);
+		_mul_add = mul_add_func(kernel);
+	}
+
+	/* answer(): sets the blocksize words at @response to the product of
+	 * the database and the query_words() words at @query.
+	 */
+	virtual void answer(const uint32_t* query, uint32_t* response) const {
+		answer_batch(&query, &response, 1);
+	}
+
+	/* answer(): as above, with vectors. */
+	virtual vector<uint32_t> answer(const vector<uint32_t>& query) const {
+		assert(query.size() == query_words());
+		vector<uint32_t> ret(_geometry.blocksize);
+		answer(query.data(), ret.data());
+		return ret;
+	}
+
+	/* answer_batch(): answers the @count queries at @queries into the
+	 * responses at the same index of @responses.
+	 */
+	virtual void answer_batch(const uint32_t* const* queries,
+				  uint32_t* const* responses,
+				  size_t count) const {
+		for (size_t i = 0; i < count; ++i) {
+			assert(queries[i]);
+			assert(responses[i]);
+			memset(responses[i], 0,
+			       _geometry.blocksize * sizeof(uint32_t));
+		}
+		if (_scheduler) {
+			answer_parallel(queries, responses, count,
+					_geometry.blocksize,
+					[this](const uint32_t* const* q,
+					       uint32_t* const* r, size_t n,
+					       uint64_t begin, uint64_t end) {
+				answer_range(q, r, n, begin, end);
+			}, [](uint32_t* out, const uint32_t* in,
+			      uint64_t words) {
+				for (uint64_t i = 0; i < words; ++i) {
+					out[i] += in[i];
+				}
+			});
+		} else {
+			answer_range(queries, responses, count, 0,
+				     _geometry.blocks);
+		}
+	}
+
+	/* answer_batch(): as above, with vectors. */
+	virtual vector<vector<uint32_t>> answer_batch(
+			const vector<vector<uint32_t>>& queries) const {
+		vector<vector<uint32_t>> ret(
+			queries.size(), vector<uint32_t>(_geometry.blocksize));
+		vector<const uint32_t*> in;
+		vector<uint32_t*> out;
+		for (size_t i = 0; i < queries.size(); ++i) {
+			assert(queries[i].size() == query_words());
+			in.push_back(queries[i].data());
+			out.push_back(ret[i].data());
+		}
+		answer_batch(in.data(), out.data(), queries.size());
+		return ret;
+	}
+
+	/* make_hint(): writes the hint H = D A for the matrix A of @seed to
+	 * @hint_file. Each column of H is the answer to a column of A as a
+	 * query, so the columns are answered in batches, spread over the
+	 * worker threads if there are any.
+	 */
+	virtual void make_hint(uint64_t seed, const string& hint_file) const {
+		uint64_t rows = _geometry.blocksize;
+		vector<uint32_t> columns(rows * kLWEDimension);
+		uint64_t group = hint_group();
+		uint64_t groups = (kLWEDimension + group - 1) / group;
+		auto work = [&](size_t worker, uint64_t begin, uint64_t end) {
+			for (uint64_t g = begin; g < end; ++g) {
+				uint64_t lo = g * group;
+				uint64_t n = min(group, kLWEDimension - lo);
+				vector<uint32_t*> acc(n);
+				for (uint64_t c = 0; c < n; ++c) {
+					acc[c] = &columns[(lo + c) * rows];
+				}
+				hint_columns(seed, lo, acc);
+			}
+		};
+		if (_scheduler) {
+			_scheduler->run(groups, 1, work);
+		} else {
+			work(0, 0, groups);
+		}
+
+		LWEHintHeader header;
+		memset(&header, 0, sizeof(header));
+		memcpy(header.magic, kLWEHintMagic, sizeof(header.magic));
+		header.version = kLWEHintVersion;
+		header.dimension = kLWEDimension;
+		header.seed = seed;
+		header.blocks = _geometry.blocks;
+		header.blocksize = rows;
+		FILE* fout = fopen(hint_file.c_str(), "wb");
+		if (!fout) {
+			Logger::error("(lwe) cannot write %", hint_file);
+			assert(0);
+		}
+		size_t ret = fwrite(&header, sizeof(header), 1, fout);
+		assert(ret == 1);
+		/* H is stored by rows, for the client's H s */
+		vector<uint32_t> row(kLWEDimension);
+		for (uint64_t r = 0; r < rows; ++r) {
+			for (uint64_t c = 0; c < kLWEDimension; ++c) {
+				row[c] = columns[c * rows + r];
+			}
+			ret = fwrite(row.data(), sizeof(uint32_t), row.size(),
+				     fout);
+			assert(ret == row.size());
+		}
+		ret = fclose(fout);
+		assert(!ret);
+		Logger::info("(lwe) wrote % byte hint: %", sizeof(header)
+			     + rows * kLWEDimension * sizeof(uint32_t),
+			     hint_file);
+	}
+
+protected:
+	/* The most bytes of a block handled at once in a batch. */
+	static const uint64_t kTileBytes = 1024;
+
+	/* The bytes of accumulator tiles a batch keeps in cache. */
+	static const uint64_t kCacheBudget = 256 << 10;
+
+	/* The blocks walked at once in a batch. */
+	static const uint64_t kSelectBlocks = 1024;
+
+	/* tile(): returns the rows of a tile. */
+	uint64_t tile() const {
+		return _geometry.blocksize < kTileBytes
+			? _geometry.blocksize : kTileBytes;
+	}
+
+	/* query_group(): returns the queries whose accumulators for a tile fit in
+	 * kCacheBudget.
+	 */
+	uint64_t query_group() const {
+		return max((uint64_t) 1,
+			   kCacheBudget / (tile() * sizeof(uint32_t)));
+	}
+
+	/* hint_group(): returns the columns of the hint made at once. */
+	uint64_t hint_group() const {
+		return min((uint64_t) kLWEDimension, query_group());
+	}
+
+	/* answer_range(): adds the product of the blocks in [@begin, @end)
+	 * and the @count @queries into their responses.
+	 */
+	void answer_range(const uint32_t* const* queries,
+			  uint32_t* const* responses, size_t count,
+			  uint64_t begin, uint64_t end) const {
+		size_t group = query_group();
+		vector<uint32_t> scalars(group);
+		for (size_t lo = 0; lo < count; lo += group) {
+			size_t n = min(group, count - lo);
+			for (uint64_t b = begin; b < end; b += kSelectBlocks) {
+				uint64_t stop = min(end, b + kSelectBlocks);
+				scan(b, stop, n, responses + lo,
+				     [&](uint64_t block) {
+					for (size_t k = 0; k < n; ++k) {
+						scalars[k] = queries[lo + k][block];
+					}
+					return scalars.data();
+				});
+			}
+		}
+	}
+
+	/* hint_columns(): sets the @acc columns of the hint from column @lo
+	 * on, which must be zero, to the product of the database and the
+	 * same columns of A for @seed.
+	 */
+	void hint_columns(uint64_t seed, uint64_t lo,
+			  const vector<uint32_t*>& acc) const {
+		size_t n = acc.size();
+		vector<uint32_t> scalars(n);
+		for (uint64_t b = 0; b < _geometry.blocks; b += kSelectBlocks) {
+			uint64_t stop = min(_geometry.blocks, b + kSelectBlocks);
+			scan(b, stop, n, acc.data(), [&](uint64_t block) {
+				for (size_t c = 0; c < n; ++c) {
+					scalars[c] = lwe_matrix(seed, block,
+								lo + c);
+				}
+				return scalars.data();
+			});
+		}
+	}
+
+	/* scan(): adds, for each block in [@begin, @end), the block times
+	 * @scalars(block)[k] into @acc[k] for each of the @count
+	 * accumulators, a row tile at a time. @scalars is called for each
+	 * block of each tile.
+	 */
+	template <typename F>
+	void scan(uint64_t begin, uint64_t end, size_t count,
+		  uint32_t* const* acc, F scalars) const {
+		uint64_t rows = tile();
+		vector<uint32_t*> tiles(count);
+		for (uint64_t row = 0; row < _geometry.blocksize; row += rows) {
+			for (size_t k = 0; k < count; ++k) {
+				tiles[k] = acc[k] + row;
+			}
+			for (uint64_t i = begin; i < end; ++i) {
+				uint64_t len = _geometry.block_len(i);
+				if (len <= row) continue;
+				len = min(len - row, rows);
+				_mul_add(tiles.data(), scalars(i), count,
+					 _data + i * _geometry.blocksize + row,
+					 len);
+			}
+		}
+	}
+
+	// Prohibit copy
+	LWEPIRServer(const LWEPIRServer& copy) : PIRFileServer(copy) {}
+
+	MulAddFunc _mul_add;
+};
+
+}  // namespace btpir
+
+#endif  // __BTPIR__PIR_SERVER__LWE_PIR_SERVER__H__
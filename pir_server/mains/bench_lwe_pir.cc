@@ -0,0 +1,75 @@
+#include "pir_server/lwe_pir_server.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "ib/logger.h"
+
+using namespace std;
+using namespace ib;
+using namespace btpir;
+
+int main(int argc, char **argv) {
+	if (argc < 2 || argc > 5) {
+		Logger::error("usage: % pir_file [queries [batch [threads]]]",
+			      argv[0]);
+		Logger::error("Answers random LWE PIR queries against "
+			      "pir_file with each kernel this machine "
+			      "supports, batch at a time per pass over the "
+			      "database (1 if not given), and reports the "
+			      "rate per thread. Queries are answered with one "
+			      "thread unless threads is given; 0 uses every "
+			      "CPU.");
+		return -1;
+	}
+	string filename = argv[1];
+	uint64_t queries = 10;
+	if (argc >= 3) queries = strtoull(argv[2], nullptr, 10);
+	uint64_t batch = 1;
+	if (argc >= 4) batch = strtoull(argv[3], nullptr, 10);
+	if (!batch) batch = 1;
+	size_t threads = 1;
+	if (argc == 5) threads = strtoul(argv[4], nullptr, 10);
+
+	LWEPIRServer server(filename);
+	server.set_threads(threads);
+	Logger::info("(bench) % threads", server.threads());
+	const PIRGeometry& geometry = server.geometry();
+	vector<vector<uint32_t>> query_set;
+	for (uint64_t i = 0; i < queries; ++i) {
+		vector<uint32_t> query(server.query_words());
+		for (auto &x : query) x = ((uint32_t) rand() << 16) ^ rand();
+		query_set.push_back(query);
+	}
+	vector<vector<uint32_t>> responses(
+		batch, vector<uint32_t>(geometry.blocksize));
+	vector<const uint32_t*> in(batch);
+	vector<uint32_t*> out(batch);
+	for (uint64_t i = 0; i < batch; ++i) out[i] = responses[i].data();
+
+	for (auto &kernel : supported_kernels()) {
+		server.set_kernel(kernel);
+		auto start = chrono::steady_clock::now();
+		for (uint64_t lo = 0; lo < queries; lo += batch) {
+			uint64_t n = min(batch, queries - lo);
+			for (uint64_t i = 0; i < n; ++i) {
+				in[i] = query_set[lo + i].data();
+			}
+			server.answer_batch(in.data(), out.data(), n);
+		}
+		double secs = chrono::duration<double>(
+			chrono::steady_clock::now() - start).count();
+		double scanned = (double) queries * geometry.size;
+		double rate = secs > 0 ? scanned / secs : 0;
+		Logger::info("(bench) % kernel, batches of %: % queries in % "
+			     "s, % ms each, % GB/s of database per thread",
+			     kernel_name(kernel), batch, queries, secs,
+			     queries ? 1000 * secs / queries : 0,
+			     rate / 1e9 / server.threads());
+	}
+	return 0;
+}
@@ -0,0 +1,123 @@
+#include "pir_server/xor_pir_server.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "ib/logger.h"
+
+using namespace std;
+using namespace ib;
+using namespace btpir;
+
+/* read_bandwidth(): returns the rate, in bytes per second, at which @kernel
+ * XORs a buffer of @bytes, too large for the caches, into a small
+ * accumulator. That is the most a scan of the database can reach.
+ */
+double read_bandwidth(XORKernel kernel, size_t bytes) {
+	const size_t kChunk = 4096;
+	vector<uint8_t> buf(bytes, 1), acc(kChunk, 0);
+	XORFunc f = xor_func(kernel);
+	double best = 0;
+	for (int round = 0; round < 3; ++round) {
+		auto start = chrono::steady_clock::now();
+		for (size_t i = 0; i < bytes; i += kChunk) {
+			f(&acc[0], &buf[i], kChunk);
+		}
+		double secs = chrono::duration<double>(
+			chrono::steady_clock::now() - start).count();
+		if (secs > 0 && bytes / secs > best) best = bytes / secs;
+	}
+	/* keep the loop from being optimized out */
+	if (acc[0] == 0xff) Logger::info("");
+	return best;
+}
+
+int main(int argc, char **argv) {
+	if (argc < 2 || argc > 6) {
+		Logger::error("usage: % pir_file [queries [blocksize [batch "
+			      "[threads]]]]", argv[0]);
+		Logger::error("Answers random XOR PIR queries against pir_file "
+			      "with each kernel this machine supports, and "
+			      "compares the rate to the memory bandwidth. The "
+			      "blocksize is taken from the file name if not "
+			      "given or 0. With a batch size, the queries are "
+			      "also answered that many per pass over the "
+			      "database. Queries are answered with one thread "
+			      "unless threads is given; 0 uses every CPU.");
+		return -1;
+	}
+	string filename = argv[1];
+	uint64_t queries = 10;
+	if (argc >= 3) queries = strtoull(argv[2], nullptr, 10);
+	uint64_t blocksize = 0;
+	if (argc >= 4) blocksize = strtoull(argv[3], nullptr, 10);
+	uint64_t batch = 0;
+	if (argc >= 5) batch = strtoull(argv[4], nullptr, 10);
+	size_t threads = 1;
+	if (argc == 6) threads = strtoul(argv[5], nullptr, 10);
+
+	XORPIRServer server(filename, blocksize);
+	server.set_threads(threads);
+	Logger::info("(bench) % threads", server.threads());
+	const PIRGeometry& geometry = server.geometry();
+	string response(geometry.blocksize, 0);
+	vector<string> query_set;
+	for (uint64_t i = 0; i < queries; ++i) {
+		string query(server.query_bytes(), 0);
+		for (auto &x : query) x = (char) rand();
+		query_set.push_back(query);
+	}
+
+	for (auto &kernel : supported_kernels()) {
+		double bandwidth = read_bandwidth(kernel, 256 << 20);
+		server.set_kernel(kernel);
+		uint64_t selected = 0;
+		auto start = chrono::steady_clock::now();
+		for (auto &query : query_set) {
+			selected += server.answer(
+				reinterpret_cast<const uint8_t*>(query.data()),
+				reinterpret_cast<uint8_t*>(&response[0]));
+		}
+		double secs = chrono::duration<double>(
+			chrono::steady_clock::now() - start).count();
+		double scanned = (double) selected * geometry.blocksize;
+		double rate = secs > 0 ? scanned / secs : 0;
+		Logger::info("(bench) % kernel: % queries in % s, % ms each",
+			     kernel_name(kernel), queries, secs,
+			     queries ? 1000 * secs / queries : 0);
+		Logger::info("(bench) % kernel: XORed % GB/s, memory % GB/s "
+			     "(% of bandwidth)", kernel_name(kernel),
+			     rate / 1e9, bandwidth / 1e9,
+			     bandwidth > 0 ? rate / bandwidth : 0);
+		if (!batch) continue;
+
+		vector<string> responses(batch, response);
+		vector<const uint8_t*> in(batch);
+		vector<uint8_t*> out(batch);
+		for (uint64_t i = 0; i < batch; ++i) {
+			out[i] = reinterpret_cast<uint8_t*>(&responses[i][0]);
+		}
+		start = chrono::steady_clock::now();
+		for (uint64_t lo = 0; lo < queries; lo += batch) {
+			uint64_t n = min(batch, queries - lo);
+			for (uint64_t i = 0; i < n; ++i) {
+				in[i] = reinterpret_cast<const uint8_t*>(
+					query_set[lo + i].data());
+			}
+			server.answer_batch(in.data(), out.data(), n);
+		}
+		secs = chrono::duration<double>(
+			chrono::steady_clock::now() - start).count();
+		rate = secs > 0 ? scanned / secs : 0;
+		Logger::info("(bench) % kernel, batches of %: % ms per query, "
+			     "XORed % GB/s (% of bandwidth)",
+			     kernel_name(kernel), batch,
+			     queries ? 1000 * secs / queries : 0, rate / 1e9,
+			     bandwidth > 0 ? rate / bandwidth : 0);
+	}
+	return 0;
+}
@@ -0,0 +1,39 @@
+#include "pir_server/lwe_pir_server.h"
+
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <sys/random.h>
+
+#include "ib/logger.h"
+
+using namespace std;
+using namespace ib;
+using namespace btpir;
+
+int main(int argc, char **argv) {
+	if (argc < 2 || argc > 4) {
+		Logger::error("usage: % pir_file [threads [seed]]", argv[0]);
+		Logger::error("Writes the hint clients need for LWE PIR "
+			      "queries against pir_file to pir_file.lwe_hint. "
+			      "The public matrix is expanded from seed, or "
+			      "from a random one if not given. Uses every CPU "
+			      "unless threads is given.");
+		return -1;
+	}
+	string filename = argv[1];
+	size_t threads = 0;
+	if (argc >= 3) threads = strtoul(argv[2], nullptr, 10);
+	uint64_t seed;
+	if (argc == 4) {
+		seed = strtoull(argv[3], nullptr, 10);
+	} else if (getrandom(&seed, sizeof(seed), 0) != sizeof(seed)) {
+		Logger::error("cannot get a random seed");
+		return -1;
+	}
+
+	LWEPIRServer server(filename);
+	server.set_threads(threads);
+	server.make_hint(seed, filename + ".lwe_hint");
+	return 0;
+}
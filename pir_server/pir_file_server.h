@@ -0,0 +1,255 @@
+/*
+   Copyright 2016, Joel Reardon, UC Berkeley
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef __BTPIR__PIR_SERVER__PIR_FILE_SERVER__H__
+#define __BTPIR__PIR_SERVER__PIR_FILE_SERVER__H__
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <memory>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <vector>
+
+#include "build_database/pir_geometry.h"
+#include "ib/logger.h"
+#include "pir_server/scan_scheduler.h"
+#include "pir_server/xor_kernels.h"
+
+using namespace std;
+using namespace ib;
+
+namespace btpir {
+
+/* PIRFileServer holds what every kind of PIR server needs of one database
+ * file written by build_database, e.g., the main database or an addr_db.fmt*
+ * file: the file, memory-mapped read-only and read in from the start since
+ * every query scans much of it, its geometry, the kernel instruction set and
+ * the worker threads. A shard of a main database is served by giving the
+ * number of its first block.
+ *
+ * By default queries are answered on the calling thread. set_threads() splits
+ * each scan over worker threads instead (see ScanScheduler).
+ */
+class PIRFileServer {
+public:
+	/* Maps @filename, a database with blocks of @blocksize bytes, or, if
+	 * @blocksize is 0, the blocksize in its name. @first_block is the
+	 * number of its first block in the whole database.
+	 */
+	PIRFileServer(const string& filename, uint64_t blocksize = 0,
+		      uint64_t first_block = 0)
+		: _filename(filename), _data(nullptr),
+		  _first_block(first_block), _kernel(best_kernel()) {
+		if (!blocksize) {
+			string name = filename.substr(filename.rfind('/') + 1);
+			blocksize = PIRGeometry::parse_blocksize(name);
+		}
+		if (!blocksize) {
+			Logger::error("(server) no blocksize for %", _filename);
+			assert(0);
+		}
+		_fd = open(_filename.c_str(), O_RDONLY);
+		if (_fd < 0) {
+			Logger::error("(server) cannot open %", _filename);
+			assert(0);
+		}
+		struct stat st;
+		int ret = fstat(_fd, &st);
+		assert(!ret);
+		_geometry = PIRGeometry::for_size(st.st_size, blocksize);
+		if (_geometry.size) {
+			int flags = MAP_PRIVATE;
+#ifdef MAP_POPULATE
+			flags |= MAP_POPULATE;
+#endif
+			void* map = mmap(nullptr, _geometry.size, PROT_READ,
+					 flags, _fd, 0);
+			assert(map != MAP_FAILED);
+			_data = static_cast<const uint8_t*>(map);
+			madvise(map, _geometry.size, MADV_WILLNEED);
+		}
+		Logger::info("(server) % blocks of % bytes from %, % kernel",
+			     _geometry.blocks, _geometry.blocksize, _filename,
+			     kernel_name(_kernel));
+	}
+
+	virtual ~PIRFileServer() {
+		if (_data) {
+			munmap(const_cast<uint8_t*>(_data), _geometry.size);
+		}
+		close(_fd);
+	}
+
+	/* Returns the geometry of the served file. */
+	const PIRGeometry& geometry() const {
+		return _geometry;
+	}
+
+	/* Returns the number of the first served block. */
+	uint64_t first_block() const {
+		return _first_block;
+	}
+
+	/* set_kernel(): answers with @kernel, which must be supported. */
+	virtual void set_kernel(XORKernel kernel) {
+		assert(kernel_supported(kernel));
+		_kernel = kernel;
+	}
+
+	/* set_threads(): answers queries with @threads worker threads, or
+	 * one per CPU if 0, pinned to CPUs in NUMA node order.
+	 */
+	virtual void set_threads(size_t threads) {
+		_scheduler.reset(threads == 1 ? nullptr
+				 : new ScanScheduler(threads));
+	}
+
+	/* Returns the number of threads that answer queries. */
+	size_t threads() const {
+		return _scheduler ? _scheduler->threads() : 1;
+	}
+
+	/* localize(): replaces the mapping of the file with a private copy
+	 * in memory, of which each worker copies the share of blocks it
+	 * starts each scan with. The kernel places each page on the NUMA
+	 * node of the worker that first touches it, so the workers mostly
+	 * read memory local to them. It costs memory outside the page cache
+	 * and is only worth it on machines with several nodes.
+	 */
+	virtual void localize() {
+		assert(_scheduler);
+		if (!_geometry.size) return;
+		void* map = mmap(nullptr, _geometry.size,
+				 PROT_READ | PROT_WRITE,
+				 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		assert(map != MAP_FAILED);
+		uint8_t* copy = static_cast<uint8_t*>(map);
+		_scheduler->run(_geometry.blocks, steal_blocks(),
+				[this, copy](size_t worker, uint64_t begin,
+					     uint64_t end) {
+			uint64_t from = begin * _geometry.blocksize;
+			uint64_t to = min(_geometry.size,
+					  end * _geometry.blocksize);
+			memcpy(copy + from, _data + from, to - from);
+		}, false);
+		mprotect(map, _geometry.size, PROT_READ);
+		munmap(const_cast<uint8_t*>(_data), _geometry.size);
+		_data = copy;
+		Logger::info("(server) localized % bytes over % threads",
+			     _geometry.size, threads());
+	}
+
+	/* Returns the kernel used. */
+	XORKernel kernel() const {
+		return _kernel;
+	}
+
+protected:
+	/* The bytes of database a worker takes at once, or steals at least. */
+	static const uint64_t kStealBytes = 1 << 20;
+
+	/* The most bytes of partial answers the workers keep. */
+	static const uint64_t kPartialBudget = 64 << 20;
+
+	/* steal_blocks(): returns the blocks a worker takes at once. */
+	uint64_t steal_blocks() const {
+		return max((uint64_t) 1, kStealBytes / _geometry.blocksize);
+	}
+
+	/* answer_parallel(): answers the @count @queries into @responses,
+	 * each @width elements of T, with the worker threads. Each worker
+	 * that takes part in a scan calls @answer(queries, partial, n, begin,
+	 * end) to answer n queries from blocks [begin, end) into partial
+	 * answers of its own. The workers then fold the partial answers into
+	 * the responses with @reduce(response, partial, width), a query each.
+	 * When the partial answers of all the queries would take more than
+	 * kPartialBudget bytes, the queries are answered in rounds that each
+	 * scan the database.
+	 */
+	template <typename Q, typename T, typename Answer, typename Reduce>
+	void answer_parallel(const Q* const* queries, T* const* responses,
+			     size_t count, uint64_t width, Answer answer,
+			     Reduce reduce) const {
+		assert(_scheduler);
+		size_t threads = _scheduler->threads();
+		size_t round = max((uint64_t) 1, kPartialBudget
+				   / (threads * width * sizeof(T)));
+		vector<vector<T>> partial(threads);
+		vector<vector<T*>> partial_ptrs(threads);
+		vector<char> used(threads);
+		for (size_t lo = 0; lo < count; lo += round) {
+			size_t n = min(round, count - lo);
+			fill(used.begin(), used.end(), 0);
+			_scheduler->run(_geometry.blocks, steal_blocks(),
+					[&](size_t worker, uint64_t begin,
+					    uint64_t end) {
+				vector<T*>& ptrs = partial_ptrs[worker];
+				if (!used[worker]) {
+					used[worker] = 1;
+					partial[worker].assign(n * width, 0);
+					T* mine = partial[worker].data();
+					ptrs.resize(n);
+					for (size_t q = 0; q < n; ++q) {
+						ptrs[q] = mine + q * width;
+					}
+				}
+				answer(queries + lo, ptrs.data(), n, begin,
+				       end);
+			});
+			_scheduler->run(n, 1, [&](size_t worker, uint64_t begin,
+						  uint64_t end) {
+				for (uint64_t q = begin; q < end; ++q) {
+					for (size_t w = 0; w < threads; ++w) {
+						if (!used[w]) continue;
+						reduce(responses[lo + q],
+						       partial_ptrs[w][q],
+						       width);
+					}
+				}
+			});
+		}
+	}
+
+	// Prohibit copy
+	PIRFileServer(const PIRFileServer& copy) {}
+
+	string _filename;
+	int _fd;
+
+	/* the mapped file, or null if it is empty */
+	const uint8_t* _data;
+
+	PIRGeometry _geometry;
+
+	/* number of the first block in the whole database */
+	uint64_t _first_block;
+
+	XORKernel _kernel;
+
+	/* the worker threads, or null to answer on the calling thread */
+	unique_ptr<ScanScheduler> _scheduler;
+};
+
+}  // namespace btpir
+
+#endif  // __BTPIR__PIR_SERVER__PIR_FILE_SERVER__H__
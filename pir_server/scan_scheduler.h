@@ -0,0 +1,298 @@
+/*
+   Copyright 2016, Joel Reardon, UC Berkeley
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef __BTPIR__PIR_SERVER__SCAN_SCHEDULER__H__
+#define __BTPIR__PIR_SERVER__SCAN_SCHEDULER__H__
+
+#include <algorithm>
+#include <cassert>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <pthread.h>
+#include <sched.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ib/logger.h"
+
+using namespace std;
+using namespace ib;
+
+namespace btpir {
+
+/* ScanScheduler spreads a range of items, e.g., the blocks of a database,
+ * over a fixed set of worker threads. Each run gives every worker an equal
+ * contiguous share, which it works through from the front a chunk at a time.
+ * A worker whose share is used up steals the back half of the largest share
+ * left, so a slow worker does not hold up the rest.
+ *
+ * Worker i always starts on share i, and the workers are pinned to CPUs in
+ * the order of their NUMA nodes, so the workers that share a node start on
+ * neighbouring parts of the range. Memory first touched by a worker during
+ * a run without stealing is then local to the worker that usually reads it.
+ */
+class ScanScheduler {
+public:
+	/* Starts @threads workers, or one per CPU this process may use if 0,
+	 * pinned to CPUs if @pin is set.
+	 */
+	ScanScheduler(size_t threads, bool pin = true)
+		: _shares(0), _f(nullptr), _chunk(0), _steal(true),
+		  _generation(0), _active(0), _stop(false), _stolen(0) {
+		vector<int> cpus = cpus_by_node();
+		if (!threads) threads = cpus.size();
+		if (!threads) threads = 1;
+		_shares = vector<Share>(threads);
+		for (size_t i = 0; i < threads; ++i) {
+			int cpu = -1;
+			if (pin && !cpus.empty()) {
+				cpu = threads <= cpus.size()
+					? cpus[i * cpus.size() / threads]
+					: cpus[i % cpus.size()];
+			}
+			_workers.push_back(thread([this, i, cpu]() {
+				work(i, cpu);
+			}));
+		}
+	}
+
+	/* Destructor stops the workers. */
+	virtual ~ScanScheduler() {
+		{
+			unique_lock<mutex> lock(_lock);
+			_stop = true;
+		}
+		_wake.notify_all();
+		for (auto &x : _workers) x.join();
+	}
+
+	/* Returns the number of workers. */
+	size_t threads() const {
+		return _workers.size();
+	}
+
+	/* run(): calls @f(worker, begin, end) on pieces [begin, end) of at
+	 * most @chunk items until all of [0, @items) is done, and returns
+	 * when every call has. Calls with the same worker never overlap. If
+	 * @steal is unset, each worker does exactly its own share. Runs from
+	 * different threads take turns.
+	 */
+	void run(uint64_t items, uint64_t chunk,
+		 const function<void(size_t, uint64_t, uint64_t)>& f,
+		 bool steal = true) {
+		assert(chunk);
+		unique_lock<mutex> turn(_turn);
+		size_t n = _shares.size();
+		for (size_t i = 0; i < n; ++i) {
+			_shares[i].next = items * i / n;
+			_shares[i].end = items * (i + 1) / n;
+		}
+		unique_lock<mutex> lock(_lock);
+		_f = &f;
+		_chunk = chunk;
+		_steal = steal;
+		_stolen = 0;
+		_active = n;
+		++_generation;
+		_wake.notify_all();
+		_done.wait(lock, [this]() { return !_active; });
+		_f = nullptr;
+	}
+
+	/* stolen(): returns the number of steals in the last run. */
+	uint64_t stolen() const {
+		return _stolen;
+	}
+
+	/* cpus_by_node(): returns the CPUs this process may run on, those of
+	 * NUMA node 0 first, then those of node 1, and so on. Machines that do
+	 * not list their nodes count as one node.
+	 */
+	static vector<int> cpus_by_node() {
+		vector<int> ret;
+		cpu_set_t allowed;
+		CPU_ZERO(&allowed);
+		if (sched_getaffinity(0, sizeof(allowed), &allowed)) {
+			return ret;
+		}
+		vector<bool> seen(CPU_SETSIZE, false);
+		for (int node = 0; ; ++node) {
+			string name = Logger::stringify(
+				"/sys/devices/system/node/node%/cpulist", node);
+			FILE* f = fopen(name.c_str(), "r");
+			if (!f) break;
+			int lo, hi;
+			while (fscanf(f, "%d", &lo) == 1) {
+				hi = lo;
+				int c = fgetc(f);
+				if (c == '-') {
+					if (fscanf(f, "%d", &hi) != 1) break;
+					c = fgetc(f);
+				}
+				for (int cpu = lo; cpu <= hi && cpu < CPU_SETSIZE;
+				     ++cpu) {
+					if (!CPU_ISSET(cpu, &allowed) || seen[cpu])
+						continue;
+					seen[cpu] = true;
+					ret.push_back(cpu);
+				}
+				if (c != ',') break;
+			}
+			fclose(f);
+		}
+		for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+			if (CPU_ISSET(cpu, &allowed) && !seen[cpu]) {
+				ret.push_back(cpu);
+			}
+		}
+		return ret;
+	}
+
+protected:
+	/* What is left of one worker's share. Each is on its own cache line,
+	   as its owner takes from it often. */
+	struct alignas(64) Share {
+		Share() : next(0), end(0) {}
+		Share(const Share& copy) : next(copy.next), end(copy.end) {}
+		mutex lock;
+		uint64_t next;
+		uint64_t end;
+	};
+
+	/* work(): the loop of worker @worker, pinned to @cpu unless it is
+	 * negative.
+	 */
+	void work(size_t worker, int cpu) {
+		if (cpu >= 0) {
+			cpu_set_t set;
+			CPU_ZERO(&set);
+			CPU_SET(cpu, &set);
+			pthread_setaffinity_np(pthread_self(), sizeof(set),
+					       &set);
+		}
+		uint64_t seen = 0;
+		while (true) {
+			{
+				unique_lock<mutex> lock(_lock);
+				_wake.wait(lock, [this, seen]() {
+					return _stop || _generation != seen;
+				});
+				if (_stop) return;
+				seen = _generation;
+			}
+			uint64_t begin, end;
+			while (take(worker, &begin, &end)) {
+				(*_f)(worker, begin, end);
+			}
+			unique_lock<mutex> lock(_lock);
+			if (!--_active) _done.notify_all();
+		}
+	}
+
+	/* take(): sets [@begin, @end) to the next piece for @worker, from
+	 * its own share or, if that is used up, a stolen one. Returns false
+	 * when there is nothing left.
+	 */
+	bool take(size_t worker, uint64_t* begin, uint64_t* end) {
+		Share& own = _shares[worker];
+		while (true) {
+			{
+				unique_lock<mutex> lock(own.lock);
+				if (own.next < own.end) {
+					*begin = own.next;
+					*end = min(own.end, own.next + _chunk);
+					own.next = *end;
+					return true;
+				}
+			}
+			if (!_steal || !steal(worker)) return false;
+		}
+	}
+
+	/* steal(): moves the back half of the largest share left to the
+	 * share of @worker. Returns false if every share is used up.
+	 */
+	bool steal(size_t worker) {
+		while (true) {
+			size_t victim = worker;
+			uint64_t most = 0;
+			for (size_t i = 0; i < _shares.size(); ++i) {
+				unique_lock<mutex> lock(_shares[i].lock);
+				uint64_t left = _shares[i].end - _shares[i].next;
+				if (_shares[i].next < _shares[i].end
+				    && left > most) {
+					most = left;
+					victim = i;
+				}
+			}
+			if (!most) return false;
+
+			uint64_t begin, end;
+			{
+				Share& share = _shares[victim];
+				unique_lock<mutex> lock(share.lock);
+				if (share.next >= share.end) continue;
+				uint64_t left = share.end - share.next;
+				begin = share.next + left / 2;
+				end = share.end;
+				share.end = begin;
+			}
+			Share& own = _shares[worker];
+			unique_lock<mutex> lock(own.lock);
+			own.next = begin;
+			own.end = end;
+			unique_lock<mutex> count(_lock);
+			++_stolen;
+			return true;
+		}
+	}
+
+	// Prohibit copy
+	ScanScheduler(const ScanScheduler& copy) {}
+
+	vector<Share> _shares;
+	vector<thread> _workers;
+
+	/* the work of the current run */
+	const function<void(size_t, uint64_t, uint64_t)>* _f;
+	uint64_t _chunk;
+	bool _steal;
+
+	/* counts the runs, so a worker can tell a new one has started */
+	uint64_t _generation;
+
+	/* workers still busy with the current run */
+	size_t _active;
+
+	bool _stop;
+	uint64_t _stolen;
+	mutex _lock;
+
+	/* held for the whole of a run */
+	mutex _turn;
+
+	condition_variable _wake;
+	condition_variable _done;
+};
+
+}  // namespace btpir
+
+#endif  // __BTPIR__PIR_SERVER__SCAN_SCHEDULER__H__
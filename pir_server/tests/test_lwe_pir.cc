@@ -0,0 +1,160 @@
+/*
+ * =====================================================================================
+   Copyright 2016
+   Joel Reardon, UC Berkeley
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ * =====================================================================================
+*/
+
+#include "pir_server/lwe_pir_server.h"
+
+#include <cassert>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "ib/logger.h"
+#include "pir_server/lwe_pir.h"
+
+using namespace btpir;
+using namespace ib;
+using namespace std;
+
+string random_bytes(size_t len) {
+	string ret(len, 0);
+	for (auto &x : ret) x = (char) rand();
+	return ret;
+}
+
+vector<uint32_t> random_words(size_t len) {
+	vector<uint32_t> ret(len);
+	for (auto &x : ret) x = ((uint32_t) rand() << 16) ^ rand();
+	return ret;
+}
+
+/* reference(): the product of the database and @query a word at a time. */
+vector<uint32_t> reference(const string& db, uint64_t blocksize,
+			   const vector<uint32_t>& query) {
+	vector<uint32_t> ret(blocksize, 0);
+	for (uint64_t b = 0; b * blocksize < db.length(); ++b) {
+		for (uint64_t i = 0; i < blocksize
+			     && b * blocksize + i < db.length(); ++i) {
+			ret[i] += query[b] * (uint8_t) db[b * blocksize + i];
+		}
+	}
+	return ret;
+}
+
+void test_kernels() {
+	for (auto &kernel : supported_kernels()) {
+		MulAddFunc f = mul_add_func(kernel);
+		for (size_t len = 0; len < 300; len += 1 + len / 8) {
+			for (size_t count : {1, 3}) {
+				string in = random_bytes(len + 1);
+				vector<uint32_t> scalars = random_words(count);
+				vector<vector<uint32_t>> acc, expected;
+				vector<uint32_t*> ptrs;
+				for (size_t k = 0; k < count; ++k) {
+					acc.push_back(random_words(len + 1));
+					expected.push_back(acc.back());
+					for (size_t i = 0; i < len; ++i) {
+						expected[k][i] += scalars[k]
+							* (uint8_t) in[i + 1];
+					}
+				}
+				for (auto &x : acc) ptrs.push_back(x.data());
+				/* unaligned on purpose, and the word past
+				 * the end must not change */
+				f(ptrs.data(), scalars.data(), count,
+				  reinterpret_cast<const uint8_t*>(in.data())
+				  + 1, len);
+				assert(acc == expected);
+			}
+		}
+	}
+}
+
+void test_lwe(uint64_t blocksize, uint64_t size) {
+	string db = random_bytes(size);
+	string name = PIRGeometry::filename("test_lwe_pir", 0, blocksize);
+	ofstream(name, ios::binary) << db;
+
+	LWEPIRServer server(name);
+	uint64_t blocks = server.geometry().blocks;
+	assert(blocks == (size + blocksize - 1) / blocksize);
+	assert(server.query_words() == blocks);
+
+	/* answers are the product with the database, with every kernel, in
+	 * batches and with threads */
+	vector<vector<uint32_t>> queries;
+	for (int i = 0; i < 70; ++i) queries.push_back(random_words(blocks));
+	vector<vector<uint32_t>> answers;
+	for (auto &query : queries) {
+		answers.push_back(reference(db, blocksize, query));
+	}
+	for (auto &kernel : supported_kernels()) {
+		server.set_kernel(kernel);
+		assert(server.answer(queries[0]) == answers[0]);
+		assert(server.answer_batch(queries) == answers);
+	}
+	server.set_threads(3);
+	assert(server.answer_batch(queries) == answers);
+	assert(server.answer(queries[1]) == answers[1]);
+
+	/* the hint does not depend on the threads */
+	string hint = name + ".lwe_hint";
+	server.make_hint(17, hint);
+	ifstream threaded_in(hint, ios::binary);
+	string threaded((istreambuf_iterator<char>(threaded_in)),
+			istreambuf_iterator<char>());
+	server.set_threads(1);
+	server.make_hint(17, hint);
+	ifstream single_in(hint, ios::binary);
+	string single((istreambuf_iterator<char>(single_in)),
+		      istreambuf_iterator<char>());
+	assert(threaded == single);
+	assert(single.length() == sizeof(LWEHintHeader)
+	       + blocksize * kLWEDimension * sizeof(uint32_t));
+
+	/* the client reads blocks back, the short last one padded */
+	LWEPIRClient client(hint);
+	assert(client.blocks() == blocks);
+	assert(client.blocksize() == blocksize);
+	for (uint64_t want = 0; want < blocks; want += 1 + blocks / 5) {
+		for (uint64_t b : {want, blocks - 1}) {
+			vector<uint32_t> secret;
+			vector<uint32_t> query = client.query(b, &secret);
+			string block = db.substr(b * blocksize, blocksize);
+			block.resize(blocksize, 0);
+			assert(client.recover(server.answer(query), secret)
+			       == block);
+		}
+	}
+
+	remove(name.c_str());
+	remove(hint.c_str());
+}
+
+int main(int argc, char** argv) {
+	test_kernels();
+	assert(lwe_max_blocks() > 1000);
+	test_lwe(100, 100 * 50 + 37);
+	test_lwe(64, 64 * 200);
+	test_lwe(1500, 1500 * 20 + 1);
+	Logger::info("test_lwe_pir passed with % kernels",
+		     supported_kernels().size());
+}
@@ -0,0 +1,280 @@
+/*
+ * =====================================================================================
+   Copyright 2016
+   Joel Reardon, UC Berkeley
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ * =====================================================================================
+*/
+
+#include "pir_server/xor_pir_server.h"
+
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "build_database/pir_hints.h"
+#include "ib/logger.h"
+#include "pir_server/hint_pir.h"
+
+using namespace btpir;
+using namespace ib;
+using namespace std;
+
+string random_bytes(size_t len) {
+	string ret(len, 0);
+	for (auto &x : ret) x = (char) rand();
+	return ret;
+}
+
+/* reference(): the answer to @query computed a byte at a time. */
+string reference(const string& db, uint64_t blocksize, const string& query) {
+	string ret(blocksize, 0);
+	for (uint64_t b = 0; b * blocksize < db.length(); ++b) {
+		if (!(query[b >> 3] & (0x80 >> (b & 7)))) continue;
+		for (uint64_t i = 0; i < blocksize
+			     && b * blocksize + i < db.length(); ++i) {
+			ret[i] ^= db[b * blocksize + i];
+		}
+	}
+	return ret;
+}
+
+void test_kernels() {
+	for (auto &kernel : supported_kernels()) {
+		XORFunc f = xor_func(kernel);
+		for (size_t len = 0; len < 700; ++len) {
+			string a = random_bytes(len + 1), b = random_bytes(len);
+			string expected = a;
+			for (size_t i = 0; i < len; ++i) expected[i] ^= b[i];
+			/* unaligned on purpose, and the byte past the end
+			 * must not change */
+			f(reinterpret_cast<uint8_t*>(&a[0]),
+			  reinterpret_cast<const uint8_t*>(b.data()), len);
+			assert(a == expected);
+		}
+	}
+}
+
+/* Every item is done exactly once, even when a worker is slow. */
+void test_scheduler() {
+	for (size_t threads : {1, 2, 5}) {
+		ScanScheduler scheduler(threads);
+		assert(scheduler.threads() == threads);
+		for (uint64_t items : {0, 1, 7, 1000}) {
+			vector<atomic<int>> done(items);
+			for (auto &x : done) x = 0;
+			scheduler.run(items, 3, [&](size_t worker, uint64_t begin,
+						    uint64_t end) {
+				assert(worker < threads);
+				assert(begin < end && end - begin <= 3);
+				if (!worker) this_thread::sleep_for(
+					chrono::microseconds(200));
+				for (uint64_t i = begin; i < end; ++i) ++done[i];
+			});
+			for (auto &x : done) assert(x == 1);
+			if (threads > 1 && items == 1000) {
+				assert(scheduler.stolen());
+			}
+		}
+	}
+	assert(!ScanScheduler::cpus_by_node().empty());
+}
+
+void test_parse_blocksize() {
+	assert(PIRGeometry::parse_blocksize(
+		"out_default_blocksize_598.pir_4761_598.pir") == 598);
+	assert(PIRGeometry::parse_blocksize("addr_db.fmt2_1357_117.pir")
+	       == 117);
+	assert(PIRGeometry::parse_blocksize(
+		PIRGeometry::shard_filename("x", 10, 4096, 3)) == 4096);
+	assert(PIRGeometry::parse_blocksize(
+		PIRGeometry::filename("dir/x", 10, 77)) == 77);
+	assert(PIRGeometry::parse_blocksize("addr_db.fmt2_1357_117.pir.manifest")
+	       == 0);
+	assert(PIRGeometry::parse_blocksize("x_.pir") == 0);
+	assert(PIRGeometry::parse_blocksize("x_12a.pir") == 0);
+}
+
+void test_answers(uint64_t blocksize, uint64_t size) {
+	string db = random_bytes(size);
+	string name = PIRGeometry::filename("test_xor_server", 0, blocksize);
+	ofstream(name, ios::binary) << db;
+
+	XORPIRServer server(name);
+	assert(server.geometry().blocksize == blocksize);
+	assert(server.geometry().blocks == (size + blocksize - 1) / blocksize);
+	uint64_t blocks = server.geometry().blocks;
+
+	for (auto &kernel : supported_kernels()) {
+		server.set_kernel(kernel);
+		for (int i = 0; i < 20; ++i) {
+			string query = random_bytes(server.query_bytes());
+			assert(server.answer(query)
+			       == reference(db, blocksize, query));
+		}
+
+		/* two servers: the queries differ only in the wanted block */
+		for (uint64_t want = 0; want < blocks; want += 1 + blocks / 7) {
+			string q1 = random_bytes(server.query_bytes());
+			string q2 = q1;
+			q2[want >> 3] ^= 0x80 >> (want & 7);
+			string a1 = server.answer(q1), a2 = server.answer(q2);
+			string block = db.substr(want * blocksize, blocksize);
+			block.resize(blocksize, 0);
+			for (uint64_t j = 0; j < blocksize; ++j) a1[j] ^= a2[j];
+			assert(a1 == block);
+		}
+	}
+
+	/* a batch gives the same answers, across several groups */
+	for (auto &count : {1, 5, 64, 65, 300}) {
+		vector<string> queries;
+		for (int i = 0; i < count; ++i) {
+			queries.push_back(random_bytes(server.query_bytes()));
+		}
+		vector<string> answers = server.answer_batch(queries);
+		assert(answers.size() == queries.size());
+		for (int i = 0; i < count; ++i) {
+			assert(answers[i] == server.answer(queries[i]));
+		}
+	}
+
+	/* so do several threads, before and after localizing */
+	vector<string> queries;
+	for (int i = 0; i < 70; ++i) {
+		queries.push_back(random_bytes(server.query_bytes()));
+	}
+	vector<string> answers = server.answer_batch(queries);
+	for (int round = 0; round < 2; ++round) {
+		for (size_t threads : {2, 3}) {
+			server.set_threads(threads);
+			assert(server.threads() == threads);
+			if (round) server.localize();
+			assert(server.answer_batch(queries) == answers);
+			assert(server.answer(queries[0]) == answers[0]);
+		}
+		server.set_threads(1);
+		assert(server.answer_batch(queries) == answers);
+	}
+
+	/* a shard answers its part of a query for the whole database */
+	uint64_t first = blocks / 3;
+	string shard_name = PIRGeometry::shard_filename("test_xor_server", 0,
+							blocksize, 1);
+	ofstream(shard_name, ios::binary) << db.substr(first * blocksize);
+	XORPIRServer shard(shard_name, 0, first);
+	assert(shard.query_bytes() == server.query_bytes());
+	string query = random_bytes(server.query_bytes());
+	string head = query;
+	for (uint64_t b = first; b < blocks; ++b) {
+		head[b >> 3] &= ~(0x80 >> (b & 7));
+	}
+	string a1 = server.answer(head), a2 = shard.answer(query);
+	for (uint64_t j = 0; j < blocksize; ++j) a1[j] ^= a2[j];
+	assert(a1 == server.answer(query));
+	assert(shard.answer_batch({query, head})
+	       == vector<string>({a2, shard.answer(head)}));
+
+	remove(name.c_str());
+	remove(shard_name.c_str());
+}
+
+/* Blocks read back with offline hints match the database, until the hints
+ * covering a block run out. Spent hints stay spent across restarts of the
+ * client, until its hint file is made again.
+ */
+void test_hints(uint64_t blocksize, uint64_t size) {
+	string db = random_bytes(size);
+	string name = PIRGeometry::filename("test_xor_hints", 0, blocksize);
+	ofstream(name, ios::binary) << db;
+	XORPIRServer server(name);
+	uint64_t blocks = server.geometry().blocks;
+	uint64_t hints = 4 * server.hint_layout().chunk_blocks;
+	PIRHintBuilder builder(name, blocksize, hints, 1, 2);
+	builder.build(name + ".hints");
+	string hint_file = PIRHintBuilder::client_file(name + ".hints", 0);
+	remove((hint_file + ".spent").c_str());
+
+	set<uint64_t> spent;
+	uint64_t served = 0, asked = 0;
+	{
+		PIRHintClient client(hint_file);
+		assert(client.blocks() == blocks);
+		assert(client.hints_left() == hints);
+		for (uint64_t b = 0; b < blocks; b += 10) {
+			++asked;
+			vector<uint32_t> offsets;
+			uint64_t hint;
+			if (!client.query(b, &offsets, &hint)) continue;
+			assert(spent.insert(hint).second);
+			++served;
+			string block = db.substr(b * blocksize, blocksize);
+			block.resize(blocksize, 0);
+			assert(client.recover(server.answer_hinted(offsets),
+					      hint, b) == block);
+		}
+		assert(served > asked / 2);
+		assert(client.hints_left() == hints - served);
+	}
+
+	/* each hint is used once, even by a client started again */
+	PIRHintClient client(hint_file);
+	assert(client.hints_left() == hints - served);
+	vector<uint32_t> offsets;
+	uint64_t hint;
+	uint64_t repeats = 0;
+	while (client.query(blocks - 1, &offsets, &hint)) {
+		assert(spent.insert(hint).second);
+		++repeats;
+		string block = db.substr((blocks - 1) * blocksize);
+		block.resize(blocksize, 0);
+		assert(client.recover(server.answer_hinted(offsets), hint,
+				      blocks - 1) == block);
+	}
+	assert(repeats <= hints - served);
+	assert(client.hints_left() == hints - served - repeats);
+	assert(PIRHintClient(hint_file).hints_left()
+	       == hints - served - repeats);
+
+	/* new hints start unspent */
+	builder.build(name + ".hints");
+	assert(PIRHintClient(hint_file).hints_left() == hints);
+
+	remove(name.c_str());
+	remove(hint_file.c_str());
+	remove((hint_file + ".spent").c_str());
+}
+
+int main(int argc, char** argv) {
+	test_kernels();
+	test_scheduler();
+	test_parse_blocksize();
+	test_answers(64, 64 * 40);
+	test_answers(117, 117 * 100 + 13);
+	test_answers(598, 598 * 37 + 1);
+	test_answers(4096, 4096 * 9 + 4000);
+	test_answers(5000, 5000 * 3000 + 2100);
+	test_hints(64, 64 * 400);
+	test_hints(117, 117 * 1000 + 13);
+	Logger::info("test_xor_pir_server passed with % kernels",
+		     supported_kernels().size());
+}
@@ -0,0 +1,189 @@
+/*
+   Copyright 2016, Joel Reardon, UC Berkeley
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef __BTPIR__PIR_SERVER__XOR_KERNELS__H__
+#define __BTPIR__PIR_SERVER__XOR_KERNELS__H__
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define BTPIR_X86 1
+#endif
+
+using namespace std;
+
+namespace btpir {
+
+/* The XOR kernels add (XOR) @len bytes of @in into @out, which is the inner
+ * loop of answering a query. Neither pointer needs to be aligned. The vector
+ * kernels are compiled for their instruction set with target attributes, so
+ * the program runs on any x86-64 machine and picks one with best_kernel()
+ * when it starts.
+ */
+enum XORKernel {
+	kScalarKernel,
+	kAVX2Kernel,
+	kAVX512Kernel,
+	kXORKernels
+};
+
+typedef void (*XORFunc)(uint8_t* out, const uint8_t* in, size_t len);
+
+/* xor_into_scalar(): the portable kernel, a machine word at a time. */
+inline void xor_into_scalar(uint8_t* out, const uint8_t* in, size_t len) {
+	size_t i = 0;
+	for (; i + 32 <= len; i += 32) {
+		uint64_t a[4], b[4];
+		memcpy(a, out + i, sizeof(a));
+		memcpy(b, in + i, sizeof(b));
+		for (int j = 0; j < 4; ++j) a[j] ^= b[j];
+		memcpy(out + i, a, sizeof(a));
+	}
+	for (; i < len; ++i) out[i] ^= in[i];
+}
+
+#ifdef BTPIR_X86
+/* xor_into_avx2(): 128 bytes per iteration in four 256-bit registers. */
+__attribute__((target("avx2")))
+inline void xor_into_avx2(uint8_t* out, const uint8_t* in, size_t len) {
+	size_t i = 0;
+	for (; i + 128 <= len; i += 128) {
+		__m256i* o = reinterpret_cast<__m256i*>(out + i);
+		const __m256i* p = reinterpret_cast<const __m256i*>(in + i);
+		__m256i a0 = _mm256_loadu_si256(o);
+		__m256i a1 = _mm256_loadu_si256(o + 1);
+		__m256i a2 = _mm256_loadu_si256(o + 2);
+		__m256i a3 = _mm256_loadu_si256(o + 3);
+		a0 = _mm256_xor_si256(a0, _mm256_loadu_si256(p));
+		a1 = _mm256_xor_si256(a1, _mm256_loadu_si256(p + 1));
+		a2 = _mm256_xor_si256(a2, _mm256_loadu_si256(p + 2));
+		a3 = _mm256_xor_si256(a3, _mm256_loadu_si256(p + 3));
+		_mm256_storeu_si256(o, a0);
+		_mm256_storeu_si256(o + 1, a1);
+		_mm256_storeu_si256(o + 2, a2);
+		_mm256_storeu_si256(o + 3, a3);
+	}
+	for (; i + 32 <= len; i += 32) {
+		__m256i* o = reinterpret_cast<__m256i*>(out + i);
+		_mm256_storeu_si256(o, _mm256_xor_si256(
+			_mm256_loadu_si256(o), _mm256_loadu_si256(
+				reinterpret_cast<const __m256i*>(in + i))));
+	}
+	xor_into_scalar(out + i, in + i, len - i);
+}
+
+/* xor_into_avx512(): 256 bytes per iteration in four 512-bit registers,
+ * and a masked load and store for the tail.
+ */
+__attribute__((target("avx512f,avx512bw")))
+inline void xor_into_avx512(uint8_t* out, const uint8_t* in, size_t len) {
+	size_t i = 0;
+	for (; i + 256 <= len; i += 256) {
+		uint8_t* o = out + i;
+		const uint8_t* p = in + i;
+		__m512i a0 = _mm512_loadu_si512(o);
+		__m512i a1 = _mm512_loadu_si512(o + 64);
+		__m512i a2 = _mm512_loadu_si512(o + 128);
+		__m512i a3 = _mm512_loadu_si512(o + 192);
+		a0 = _mm512_xor_si512(a0, _mm512_loadu_si512(p));
+		a1 = _mm512_xor_si512(a1, _mm512_loadu_si512(p + 64));
+		a2 = _mm512_xor_si512(a2, _mm512_loadu_si512(p + 128));
+		a3 = _mm512_xor_si512(a3, _mm512_loadu_si512(p + 192));
+		_mm512_storeu_si512(o, a0);
+		_mm512_storeu_si512(o + 64, a1);
+		_mm512_storeu_si512(o + 128, a2);
+		_mm512_storeu_si512(o + 192, a3);
+	}
+	for (; i + 64 <= len; i += 64) {
+		_mm512_storeu_si512(out + i, _mm512_xor_si512(
+			_mm512_loadu_si512(out + i),
+			_mm512_loadu_si512(in + i)));
+	}
+	if (i < len) {
+		__mmask64 mask = _cvtu64_mask64(~0ULL >> (64 - (len - i)));
+		__m512i a = _mm512_maskz_loadu_epi8(mask, out + i);
+		__m512i b = _mm512_maskz_loadu_epi8(mask, in + i);
+		_mm512_mask_storeu_epi8(out + i, mask, _mm512_xor_si512(a, b));
+	}
+}
+#endif
+
+/* kernel_supported(): returns true if this machine can run @kernel. */
+inline bool kernel_supported(XORKernel kernel) {
+	switch (kernel) {
+	case kScalarKernel:
+		return true;
+#ifdef BTPIR_X86
+	case kAVX2Kernel:
+		return __builtin_cpu_supports("avx2");
+	case kAVX512Kernel:
+		return __builtin_cpu_supports("avx512f")
+			&& __builtin_cpu_supports("avx512bw");
+#endif
+	default:
+		return false;
+	}
+}
+
+/* best_kernel(): returns the widest kernel this machine can run. */
+inline XORKernel best_kernel() {
+	if (kernel_supported(kAVX512Kernel)) return kAVX512Kernel;
+	if (kernel_supported(kAVX2Kernel)) return kAVX2Kernel;
+	return kScalarKernel;
+}
+
+/* xor_func(): returns the function for @kernel, which must be supported. */
+inline XORFunc xor_func(XORKernel kernel) {
+	assert(kernel_supported(kernel));
+	switch (kernel) {
+#ifdef BTPIR_X86
+	case kAVX2Kernel:
+		return xor_into_avx2;
+	case kAVX512Kernel:
+		return xor_into_avx512;
+#endif
+	default:
+		return xor_into_scalar;
+	}
+}
+
+/* kernel_name(): returns a short name for @kernel. */
+inline string kernel_name(XORKernel kernel) {
+	static const char* kNames[] = {"scalar", "avx2", "avx512"};
+	assert(kernel < kXORKernels);
+	return kNames[kernel];
+}
+
+/* supported_kernels(): returns every kernel this machine can run. */
+inline vector<XORKernel> supported_kernels() {
+	vector<XORKernel> ret;
+	for (int i = 0; i < kXORKernels; ++i) {
+		if (kernel_supported((XORKernel) i)) {
+			ret.push_back((XORKernel) i);
+		}
+	}
+	return ret;
+}
+
+}  // namespace btpir
+
+#endif  // __BTPIR__PIR_SERVER__XOR_KERNELS__H__
@@ -0,0 +1,302 @@
+/*
+   Copyright 2016, Joel Reardon, UC Berkeley
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef __BTPIR__PIR_SERVER__XOR_PIR_SERVER__H__
+#define __BTPIR__PIR_SERVER__XOR_PIR_SERVER__H__
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "build_database/pir_hints.h"
+#include "ib/logger.h"
+#include "pir_server/pir_file_server.h"
+#include "pir_server/xor_kernels.h"
+
+using namespace std;
+using namespace ib;
+
+namespace btpir {
+
+/* XORPIRServer answers information-theoretic XOR PIR queries against one
+ * database file. The client sends each of several non-colluding servers a
+ * bitmap of blocks such that the bitmaps differ only in the block it wants;
+ * each server returns the XOR of the blocks its bitmap selects, and the XOR
+ * of the answers is the block. A short last block is treated as padded with
+ * zeros. The query bitmap of a shard is for the whole database.
+ *
+ * With worker threads, each worker XORs its blocks into partial answers of
+ * its own, and these are XORed together at the end.
+ *
+ * A client holding offline hints (see pir_hints.h) can instead send the
+ * offsets of a hint set, which answer_hinted() answers by reading one block
+ * per chunk rather than scanning the database.
+ */
+class XORPIRServer : public PIRFileServer {
+public:
+	XORPIRServer(const string& filename, uint64_t blocksize = 0,
+		     uint64_t first_block = 0)
+		: PIRFileServer(filename, blocksize, first_block),
+		  _xor(xor_func(_kernel)) {}
+
+	/* Returns the bytes in a query: one bit for every block up to the
+	 * last one served.
+	 */
+	uint64_t query_bytes() const {
+		return block_bitmap_len(_first_block + _geometry.blocks);
+	}
+
+	/* set_kernel(): answers with @kernel, which must be supported. */
+	virtual void set_kernel(XORKernel kernel) {
+		PIRFileServer::set_kernel(kernel);
+		_xor = xor_func(kernel);
+	}
+
+	/* answer(): sets the blocksize bytes at @response to the XOR of the
+	 * served blocks selected by the @query bitmap, which has
+	 * query_bytes() bytes. Returns the number of blocks selected.
+	 */
+	virtual uint64_t answer(const uint8_t* query, uint8_t* response) const {
+		assert(query);
+		assert(response);
+		if (_scheduler) {
+			answer_batch(&query, &response, 1);
+			return count_selected(query);
+		}
+		memset(response, 0, _geometry.blocksize);
+		uint64_t selected = 0;
+		const uint8_t* block = _data;
+		for (uint64_t i = 0; i < _geometry.blocks; ++i) {
+			uint64_t b = _first_block + i;
+			if (query[b >> 3] & (0x80 >> (b & 7))) {
+				_xor(response, block, _geometry.block_len(i));
+				++selected;
+			}
+			block += _geometry.blocksize;
+		}
+		return selected;
+	}
+
+	/* answer(): as above, with the query and response as strings. */
+	virtual string answer(const string& query) const {
+		assert(query.length() == query_bytes());
+		string response(_geometry.blocksize, 0);
+		answer(reinterpret_cast<const uint8_t*>(query.data()),
+		       reinterpret_cast<uint8_t*>(&response[0]));
+		return response;
+	}
+
+	/* answer_batch(): answers the @count queries at @queries, each of
+	 * query_bytes() bytes, into the blocksize bytes at the same index of
+	 * @responses, as answer() would each one. Rather than scanning the
+	 * database once per query, each piece of it is read once for a whole
+	 * group of queries and XORed into every one that selects it.
+	 *
+	 * The responses are tiled so the working set stays in cache: a group
+	 * is as many queries as have a column tile of their responses fit in
+	 * kCacheBudget bytes, and the database is walked kSelectBlocks blocks
+	 * at a time, each time a column tile at a time. Which queries select
+	 * each block of the walk is worked out first, as a bit per query, so
+	 * the inner loop visits only the queries that need the block.
+	 */
+	virtual void answer_batch(const uint8_t* const* queries,
+				  uint8_t* const* responses,
+				  size_t count) const {
+		for (size_t i = 0; i < count; ++i) {
+			assert(queries[i]);
+			assert(responses[i]);
+			memset(responses[i], 0, _geometry.blocksize);
+		}
+		if (_scheduler) {
+			answer_parallel(queries, responses, count,
+					_geometry.blocksize,
+					[this](const uint8_t* const* q,
+					       uint8_t* const* r, size_t n,
+					       uint64_t begin, uint64_t end) {
+				answer_range(q, r, n, begin, end);
+			}, [this](uint8_t* out, const uint8_t* in,
+				  uint64_t len) {
+				_xor(out, in, len);
+			});
+		} else {
+			answer_range(queries, responses, count, 0,
+				     _geometry.blocks);
+		}
+	}
+
+	/* answer_batch(): as above, with the queries and responses as
+	 * strings.
+	 */
+	virtual vector<string> answer_batch(
+			const vector<string>& queries) const {
+		vector<string> ret(queries.size(),
+				   string(_geometry.blocksize, 0));
+		vector<const uint8_t*> in;
+		vector<uint8_t*> out;
+		for (size_t i = 0; i < queries.size(); ++i) {
+			assert(queries[i].length() == query_bytes());
+			in.push_back(reinterpret_cast<const uint8_t*>(
+				queries[i].data()));
+			out.push_back(reinterpret_cast<uint8_t*>(&ret[i][0]));
+		}
+		answer_batch(in.data(), out.data(), queries.size());
+		return ret;
+	}
+
+	/* Returns how the blocks are cut into chunks for hinted queries. */
+	PIRHintLayout hint_layout() const {
+		return PIRHintLayout::for_blocks(_geometry.blocks);
+	}
+
+	/* answer_hinted(): answers a hinted query, the offset in each chunk
+	 * of a set at @offsets. Sets the blocksize bytes at @parities + c *
+	 * blocksize, for each chunk c, to the XOR of the set's blocks in the
+	 * other chunks. Shards cannot answer hinted queries.
+	 */
+	virtual void answer_hinted(const uint32_t* offsets,
+				   uint8_t* parities) const {
+		assert(!_first_block);
+		PIRHintLayout layout = hint_layout();
+		uint64_t bs = _geometry.blocksize;
+		vector<uint8_t> all(bs, 0);
+		for (uint64_t c = 0; c < layout.chunks; ++c) {
+			assert(offsets[c] < layout.chunk_len(c));
+			uint64_t b = c * layout.chunk_blocks + offsets[c];
+			_xor(all.data(), _data + b * bs, _geometry.block_len(b));
+		}
+		for (uint64_t c = 0; c < layout.chunks; ++c) {
+			uint64_t b = c * layout.chunk_blocks + offsets[c];
+			uint8_t* out = parities + c * bs;
+			memcpy(out, all.data(), bs);
+			_xor(out, _data + b * bs, _geometry.block_len(b));
+		}
+	}
+
+	/* answer_hinted(): as above, with the parities as a string. */
+	virtual string answer_hinted(const vector<uint32_t>& offsets) const {
+		assert(offsets.size() == hint_layout().chunks);
+		string ret(offsets.size() * _geometry.blocksize, 0);
+		answer_hinted(offsets.data(),
+			      reinterpret_cast<uint8_t*>(&ret[0]));
+		return ret;
+	}
+
+protected:
+	/* The most bytes of a response handled at once in a batch. */
+	static const uint64_t kTileBytes = 2048;
+
+	/* The bytes of response tiles a batch keeps in cache. */
+	static const uint64_t kCacheBudget = 256 << 10;
+
+	/* The blocks whose selections are worked out at once in a batch. */
+	static const uint64_t kSelectBlocks = 1024;
+
+	/* count_selected(): returns the served blocks @query selects. */
+	uint64_t count_selected(const uint8_t* query) const {
+		uint64_t ret = 0;
+		for (uint64_t i = 0; i < _geometry.blocks; ++i) {
+			uint64_t b = _first_block + i;
+			if (query[b >> 3] & (0x80 >> (b & 7))) ++ret;
+		}
+		return ret;
+	}
+
+	/* answer_range(): XORs the served blocks in [@begin, @end) that each
+	 * of the @count @queries selects into its response, a group of
+	 * queries at a time.
+	 */
+	void answer_range(const uint8_t* const* queries,
+			  uint8_t* const* responses, size_t count,
+			  uint64_t begin, uint64_t end) const {
+		uint64_t tile = _geometry.blocksize < kTileBytes
+			? _geometry.blocksize : kTileBytes;
+		size_t group = max((uint64_t) 1, kCacheBudget / tile);
+		vector<uint64_t> select;
+		for (size_t lo = 0; lo < count; lo += group) {
+			size_t n = min(group, count - lo);
+			for (uint64_t b = begin; b < end; b += kSelectBlocks) {
+				uint64_t stop = min(end, b + kSelectBlocks);
+				select_queries(queries + lo, n, b, stop,
+					       &select);
+				scan(select, n, b, stop, tile, responses + lo);
+			}
+		}
+	}
+
+	/* select_queries(): sets @select to, for each served block in
+	 * [@begin, @end), a bitmap of which of the @count @queries select
+	 * it, in words of 64 queries.
+	 */
+	void select_queries(const uint8_t* const* queries, size_t count,
+			    uint64_t begin, uint64_t end,
+			    vector<uint64_t>* select) const {
+		size_t words = (count + 63) / 64;
+		select->assign((end - begin) * words, 0);
+		for (size_t q = 0; q < count; ++q) {
+			uint64_t bit = 1ULL << (q & 63);
+			uint64_t* row = select->data() + q / 64;
+			for (uint64_t i = begin; i < end; ++i) {
+				uint64_t b = _first_block + i;
+				if (queries[q][b >> 3] & (0x80 >> (b & 7))) {
+					row[(i - begin) * words] |= bit;
+				}
+			}
+		}
+	}
+
+	/* scan(): XORs each served block in [@begin, @end) into the
+	 * @responses of the @count queries that @select says want it, a
+	 * column tile of @tile bytes at a time.
+	 */
+	void scan(const vector<uint64_t>& select, size_t count,
+		  uint64_t begin, uint64_t end, uint64_t tile,
+		  uint8_t* const* responses) const {
+		size_t words = (count + 63) / 64;
+		for (uint64_t col = 0; col < _geometry.blocksize; col += tile) {
+			for (uint64_t i = begin; i < end; ++i) {
+				uint64_t len = _geometry.block_len(i);
+				if (len <= col) continue;
+				len = min(len - col, tile);
+				const uint8_t* block = _data
+					+ i * _geometry.blocksize + col;
+				const uint64_t* row = &select[(i - begin)
+							      * words];
+				for (size_t w = 0; w < words; ++w) {
+					uint64_t bits = row[w];
+					while (bits) {
+						size_t q = w * 64
+							+ __builtin_ctzll(bits);
+						bits &= bits - 1;
+						_xor(responses[q] + col,
+						     block, len);
+					}
+				}
+			}
+		}
+	}
+
+	// Prohibit copy
+	XORPIRServer(const XORPIRServer& copy) : PIRFileServer(copy) {}
+
+	XORFunc _xor;
+};
+
+}  // namespace btpir
+
+#endif  // __BTPIR__PIR_SERVER__XOR_PIR_SERVER__H__